@@ -22,7 +22,7 @@ template < class T, int Size > struct Block
     {
     }
 
-    void Add(const T & a_Item)
+    T* Add(const T & a_Item)
     {
         if (m_Size == Size)
         {
@@ -33,14 +33,15 @@ template < class T, int Size > struct Block
 
             m_Chain->m_Current = m_Next;
             ++m_Chain->m_NumBlocks;
-            m_Next->Add(a_Item);
-            return;
+            return m_Next->Add(a_Item);
         }
 
         assert( m_Size < Size );
-        m_Data[m_Size] = a_Item;
+        T* item = &m_Data[m_Size];
+        *item = a_Item;
         ++m_Size;
         ++m_Chain->m_NumItems;
+        return item;
     }
 
     Block<T, Size>*       m_Prev;
@@ -114,9 +115,9 @@ template < class T, int BlockSize > struct BlockChain
         }
     }
 
-    void push_back(const T & a_Item)
+    T* push_back(const T & a_Item)
     {
-        m_Current->Add(a_Item);
+        return m_Current->Add(a_Item);
     }
 
     void push_back( const T* a_Array, unsigned int a_Num )
@@ -0,0 +1,209 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;   // Last bytes of a block are always literals
+static const size_t MF_LIMIT = 12;       // No match starts this close to the end
+static const size_t MAX_OFFSET = 65535;
+
+//-----------------------------------------------------------------------------
+static inline uint32_t Read32( const char* a_Ptr )
+{
+    uint32_t value;
+    memcpy( &value, a_Ptr, sizeof( value ) );
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+static inline uint32_t Hash( uint32_t a_Sequence, uint32_t a_HashLog )
+{
+    return ( a_Sequence * 2654435761u ) >> ( 32 - a_HashLog );
+}
+
+//-----------------------------------------------------------------------------
+static inline char* WriteLength( char* o_Dest, size_t a_Length )
+{
+    while( a_Length >= 255 )
+    {
+        *o_Dest++ = (char)255;
+        a_Length -= 255;
+    }
+
+    *o_Dest++ = (char)a_Length;
+    return o_Dest;
+}
+
+//-----------------------------------------------------------------------------
+static inline bool ReadLength( const uint8_t* & io_Source, const uint8_t* a_End, size_t & io_Length )
+{
+    uint8_t byte;
+    do
+    {
+        if( io_Source >= a_End )
+            return false;
+        byte = *io_Source++;
+        io_Length += byte;
+    } while( byte == 255 );
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+BlockCompressor::BlockCompressor() : m_HashTable( size_t(1) << HASH_LOG )
+{
+}
+
+//-----------------------------------------------------------------------------
+size_t BlockCompressor::Compress( const char* a_Source, size_t a_SourceSize, char* o_Dest, size_t a_DestCapacity )
+{
+    // Positions are stored + 1, 0 marks an empty slot
+    std::fill( m_HashTable.begin(), m_HashTable.end(), 0 );
+
+    const char* destEnd = o_Dest + a_DestCapacity;
+    char* dest = o_Dest;
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t numMisses = 0;
+
+    while( a_SourceSize > MF_LIMIT && pos + MF_LIMIT < a_SourceSize )
+    {
+        uint32_t sequence = Read32( a_Source + pos );
+        uint32_t & entry = m_HashTable[Hash( sequence, HASH_LOG )];
+        size_t candidate = entry;
+        entry = uint32_t( pos + 1 );
+
+        if( candidate == 0 || pos - ( candidate - 1 ) > MAX_OFFSET || Read32( a_Source + candidate - 1 ) != sequence )
+        {
+            // Skip faster through incompressible data
+            pos += 1 + ( numMisses++ >> 6 );
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        numMisses = 0;
+
+        size_t matchLength = MIN_MATCH;
+        size_t matchLimit = a_SourceSize - LAST_LITERALS;
+        while( pos + matchLength < matchLimit && a_Source[match + matchLength] == a_Source[pos + matchLength] )
+        {
+            ++matchLength;
+        }
+
+        // Token, literals, offset and match length, worst case
+        size_t numLiterals = pos - anchor;
+        if( size_t( destEnd - dest ) < 1 + numLiterals + numLiterals / 255 + 1 + 2 + ( matchLength - MIN_MATCH ) / 255 + 1 )
+        {
+            return 0;
+        }
+
+        size_t literalCode = numLiterals < 15 ? numLiterals : 15;
+        size_t matchCode = matchLength - MIN_MATCH < 15 ? matchLength - MIN_MATCH : 15;
+        *dest++ = char( ( literalCode << 4 ) | matchCode );
+
+        if( literalCode == 15 )
+        {
+            dest = WriteLength( dest, numLiterals - 15 );
+        }
+
+        memcpy( dest, a_Source + anchor, numLiterals );
+        dest += numLiterals;
+
+        size_t offset = pos - match;
+        *dest++ = char( offset & 0xFF );
+        *dest++ = char( offset >> 8 );
+
+        if( matchCode == 15 )
+        {
+            dest = WriteLength( dest, matchLength - MIN_MATCH - 15 );
+        }
+
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    // Last literals
+    size_t numLiterals = a_SourceSize - anchor;
+    if( size_t( destEnd - dest ) < 1 + numLiterals + numLiterals / 255 + 1 )
+    {
+        return 0;
+    }
+
+    size_t literalCode = numLiterals < 15 ? numLiterals : 15;
+    *dest++ = char( literalCode << 4 );
+    if( literalCode == 15 )
+    {
+        dest = WriteLength( dest, numLiterals - 15 );
+    }
+
+    memcpy( dest, a_Source + anchor, numLiterals );
+    dest += numLiterals;
+
+    return dest - o_Dest;
+}
+
+//-----------------------------------------------------------------------------
+bool BlockCompressor::Decompress( const char* a_Source, size_t a_SourceSize, char* o_Dest, size_t a_DestSize )
+{
+    const uint8_t* src = (const uint8_t*)a_Source;
+    const uint8_t* srcEnd = src + a_SourceSize;
+    char* dest = o_Dest;
+    char* destEnd = o_Dest + a_DestSize;
+
+    while( src < srcEnd )
+    {
+        uint8_t token = *src++;
+
+        size_t numLiterals = token >> 4;
+        if( numLiterals == 15 && !ReadLength( src, srcEnd, numLiterals ) )
+            return false;
+
+        if( numLiterals > size_t( srcEnd - src ) || numLiterals > size_t( destEnd - dest ) )
+            return false;
+
+        memcpy( dest, src, numLiterals );
+        src += numLiterals;
+        dest += numLiterals;
+
+        // The last sequence has no match
+        if( src == srcEnd )
+            break;
+
+        if( srcEnd - src < 2 )
+            return false;
+
+        size_t offset = src[0] | ( src[1] << 8 );
+        src += 2;
+        if( offset == 0 || offset > size_t( dest - o_Dest ) )
+            return false;
+
+        size_t matchLength = token & 15;
+        if( matchLength == 15 && !ReadLength( src, srcEnd, matchLength ) )
+            return false;
+
+        matchLength += MIN_MATCH;
+        if( matchLength > size_t( destEnd - dest ) )
+            return false;
+
+        // Overlapping matches repeat the last offset bytes
+        const char* match = dest - offset;
+        if( offset >= matchLength )
+        {
+            memcpy( dest, match, matchLength );
+            dest += matchLength;
+        }
+        else
+        {
+            for( size_t i = 0; i < matchLength; ++i )
+            {
+                *dest++ = *match++;
+            }
+        }
+    }
+
+    return dest == destEnd;
+}
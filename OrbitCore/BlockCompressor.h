@@ -0,0 +1,32 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Fast LZ77 block compression using the LZ4 block format: sequences of a
+// token, literals, a 16 bit offset and a match length, greedy matching with
+// a single hash table probe. Trades ratio for speed so that the target's
+// sender thread keeps up with a 1 Gbit link. Blocks are independent, the
+// decompressed size has to be transmitted alongside.
+class BlockCompressor
+{
+public:
+    BlockCompressor();
+
+    static size_t GetMaxCompressedSize( size_t a_Size ) { return a_Size + a_Size / 255 + 16; }
+
+    // Returns the compressed size, 0 if it doesn't fit in a_DestCapacity
+    size_t Compress( const char* a_Source, size_t a_SourceSize, char* o_Dest, size_t a_DestCapacity );
+
+    // Fails on malformed input or if the output isn't exactly a_DestSize bytes
+    static bool Decompress( const char* a_Source, size_t a_SourceSize, char* o_Dest, size_t a_DestSize );
+
+protected:
+    static const uint32_t HASH_LOG = 14;
+    std::vector< uint32_t > m_HashTable;
+};
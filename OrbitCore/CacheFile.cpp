@@ -0,0 +1,58 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Core.h"
+#include "CacheFile.h"
+#include "Log.h"
+
+//-----------------------------------------------------------------------------
+bool CacheFile::CheckHeader( const std::wstring & a_FileName, const MappedFile & a_File, const char* a_Magic, uint32_t a_Version )
+{
+    Header header;
+    if( a_File.GetSize() < sizeof( header ) )
+    {
+        ORBIT_LOG( Format( L"Ignoring cache file %s\n", a_FileName.c_str() ) );
+        return false;
+    }
+
+    memcpy( &header, a_File.GetData(), sizeof( header ) );
+    if( memcmp( header.m_Magic, a_Magic, sizeof( header.m_Magic ) ) != 0 ||
+        header.m_Version != a_Version ||
+        header.m_Size != a_File.GetSize() - sizeof( header ) )
+    {
+        // Older version or truncated write, will be regenerated
+        ORBIT_LOG( Format( L"Ignoring cache file %s\n", a_FileName.c_str() ) );
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void CacheFile::OnCorrupted( const std::wstring & a_FileName )
+{
+    ORBIT_LOG( Format( L"Corrupted cache file %s\n", a_FileName.c_str() ) );
+}
+
+//-----------------------------------------------------------------------------
+bool CacheFile::Commit( std::ofstream & a_Stream, const std::wstring & a_TempName, const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version )
+{
+    Header header;
+    memcpy( header.m_Magic, a_Magic, sizeof( header.m_Magic ) );
+    header.m_Version = a_Version;
+    header.m_Size = (uint64_t)a_Stream.tellp() - sizeof( header );
+    a_Stream.seekp( 0 );
+    a_Stream.write( (const char*)&header, sizeof( header ) );
+    a_Stream.close();
+
+    // Readers only ever see complete files
+    if( a_Stream.fail() || !MoveFileExW( a_TempName.c_str(), a_FileName.c_str(), MOVEFILE_REPLACE_EXISTING ) )
+    {
+        ORBIT_LOG( Format( L"Could not write cache file %s\n", a_FileName.c_str() ) );
+        DeleteFileW( a_TempName.c_str() );
+        return false;
+    }
+
+    return true;
+}
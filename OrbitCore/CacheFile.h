@@ -0,0 +1,82 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "MappedFile.h"
+#include "Serialization.h"
+#include <fstream>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Binary archive stored in Orbit's cache directory. A header holds a magic,
+// a version and the payload size so that files of another version or cut
+// short are rejected instead of crashing the reader. Files are written under
+// a temporary name and renamed once complete.
+class CacheFile
+{
+public:
+    template<class T> static bool Load( const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version, T & o_Object );
+    template<class T> static bool Save( const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version, const T & a_Object );
+
+protected:
+    struct Header
+    {
+        char     m_Magic[4];
+        uint32_t m_Version;
+        uint64_t m_Size;
+    };
+
+    static bool CheckHeader( const std::wstring & a_FileName, const MappedFile & a_File, const char* a_Magic, uint32_t a_Version );
+    static void OnCorrupted( const std::wstring & a_FileName );
+    static bool Commit( std::ofstream & a_Stream, const std::wstring & a_TempName, const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version );
+};
+
+//-----------------------------------------------------------------------------
+template<class T> bool CacheFile::Load( const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version, T & o_Object )
+{
+    MappedFile file;
+    if( !file.Open( a_FileName ) || !CheckHeader( a_FileName, file, a_Magic, a_Version ) )
+    {
+        return false;
+    }
+
+    MemoryStreamBuffer buffer( file.GetData() + sizeof( Header ), (size_t)( file.GetSize() - sizeof( Header ) ) );
+    std::istream stream( &buffer );
+
+    try
+    {
+        cereal::BinaryInputArchive archive( stream );
+        archive( o_Object );
+    }
+    catch( std::exception & )
+    {
+        // Corrupted sizes can also surface as allocation failures
+        OnCorrupted( a_FileName );
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+template<class T> bool CacheFile::Save( const std::wstring & a_FileName, const char* a_Magic, uint32_t a_Version, const T & a_Object )
+{
+    std::wstring tempName = a_FileName + L".tmp";
+    std::ofstream stream( tempName, std::ios::binary );
+    if( stream.fail() )
+    {
+        return false;
+    }
+
+    // Size is patched by Commit, readers reject files without it
+    Header header = {};
+    stream.write( (const char*)&header, sizeof( header ) );
+
+    {
+        cereal::BinaryOutputArchive archive( stream );
+        archive( a_Object );
+    }
+
+    return Commit( stream, tempName, a_FileName, a_Magic, a_Version );
+}
@@ -0,0 +1,60 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "CallstackTable.h"
+
+//-----------------------------------------------------------------------------
+uint32_t CallstackTable::Intern( const DWORD64* a_Frames, int a_Depth )
+{
+    // Same hash as CallStack::Hash()
+    CallstackID hash = XXH64( a_Frames, a_Depth * sizeof( DWORD64 ), 0xca1157ac );
+
+    ScopeLock lock( m_Mutex );
+
+    auto result = m_HashToIndex.emplace( hash, (uint32_t)m_Entries.size() );
+    if( result.second )
+    {
+        Entry entry;
+        entry.m_Hash = hash;
+        entry.m_Offset = (uint32_t)m_Frames.size();
+        entry.m_Depth = (uint32_t)a_Depth;
+        m_Entries.push_back( entry );
+        m_Frames.insert( m_Frames.end(), a_Frames, a_Frames + a_Depth );
+    }
+
+    return result.first->second;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t CallstackTable::Intern( CallStack & a_CallStack )
+{
+    int depth = std::min( a_CallStack.m_Depth, (int)a_CallStack.m_Data.size() );
+    uint32_t index = Intern( a_CallStack.m_Data.data(), depth );
+    a_CallStack.m_Hash = GetHash( index );
+    return index;
+}
+
+//-----------------------------------------------------------------------------
+void CallstackTable::Clear()
+{
+    ScopeLock lock( m_Mutex );
+    m_Frames.clear();
+    m_Frames.shrink_to_fit();
+    m_Entries.clear();
+    m_Entries.shrink_to_fit();
+    m_HashToIndex.clear();
+}
+
+//-----------------------------------------------------------------------------
+CallStack CallstackTable::GetCallStack( uint32_t a_Index ) const
+{
+    const Entry & entry = m_Entries[a_Index];
+    const DWORD64* frames = m_Frames.data() + entry.m_Offset;
+
+    CallStack callstack;
+    callstack.m_Hash = entry.m_Hash;
+    callstack.m_Depth = (int)entry.m_Depth;
+    callstack.m_Data.assign( frames, frames + entry.m_Depth );
+    return callstack;
+}
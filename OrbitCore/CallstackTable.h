@@ -0,0 +1,38 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "Core.h"
+#include "Callstack.h"
+#include <vector>
+#include <unordered_map>
+
+//-----------------------------------------------------------------------------
+// Interned callstacks. Each unique callstack is stored once in a contiguous
+// frame arena and identified by a dense 32-bit index, so samples can be kept
+// as indices and deduplicated at capture time.
+class CallstackTable
+{
+public:
+    uint32_t Intern( const DWORD64* a_Frames, int a_Depth );
+    uint32_t Intern( CallStack & a_CallStack );
+    void Clear();
+
+    uint32_t       Size() const                      { return (uint32_t)m_Entries.size(); }
+    CallstackID    GetHash( uint32_t a_Index ) const  { return m_Entries[a_Index].m_Hash; }
+    CallStack      GetCallStack( uint32_t a_Index ) const;
+
+protected:
+    struct Entry
+    {
+        CallstackID m_Hash;
+        uint32_t    m_Offset;
+        uint32_t    m_Depth;
+    };
+
+    Mutex                                      m_Mutex;
+    std::vector< DWORD64 >                     m_Frames;
+    std::vector< Entry >                       m_Entries;
+    std::unordered_map< CallstackID, uint32_t > m_HashToIndex;
+};
@@ -13,6 +13,7 @@
 #include "OrbitSession.h"
 #include "Serialization.h"
 #include "Pdb.h"
+#include "ModuleManager.h"
 #include "Log.h"
 #include "Params.h"
 #include "EventTracer.h"
@@ -65,6 +66,7 @@ std::shared_ptr<Process>          Capture::GTargetProcess    = nullptr;
 std::shared_ptr<Session>          Capture::GSessionPresets   = nullptr;
 
 void(*Capture::GClearCaptureDataFunc)();
+void(*Capture::GCancelCaptureLoadingFunc)();
 void(*Capture::GSamplingDoneCallback)( std::shared_ptr<SamplingProfiler> & a_SamplingProfiler );
 std::vector< std::shared_ptr<SamplingProfiler> > GOldSamplingProfilers;
 bool Capture::GUnrealSupported = false;
@@ -184,6 +186,8 @@ bool Capture::StartCapture()
     GInjected = true;
     ++Message::GSessionID;
     GTcpServer->Send( Msg_NewSession );
+    GTcpServer->Send( Msg_HashReturnAddresses, (int)GParams.m_HashReturnAddresses );
+    GTcpServer->Send( Msg_SetCompression, (int)( GParams.m_CompressRemoteCaptures && IsRemote() ) );
     GTimerManager->StartRecording();
     
     ClearCaptureData();
@@ -234,6 +238,12 @@ void Capture::ToggleRecording()
 //-----------------------------------------------------------------------------
 void Capture::ClearCaptureData()
 {
+    // A capture still loading in the background writes into what is cleared here
+    if( GCancelCaptureLoadingFunc )
+    {
+        GCancelCaptureLoadingFunc();
+    }
+
     GSelectedFunctionsMap.clear();
     GFunctionCountMap.clear();
     GZoneNames.clear();
@@ -354,6 +364,13 @@ void Capture::SendDataTrackingInfo()
     {
         const std::shared_ptr<Rule> rule = pair.second;
         Function* func = rule->m_Function;
+
+        // Tracked variables are members, the target reads them through "this"
+        if( !func->IsMemberFunction() )
+        {
+            continue;
+        }
+
         Message msg( Msg_ArgTracking );
         ArgTrackingHeader & header = msg.m_Header.m_ArgTrackingHeader;
         ULONG64 address = (ULONG64)func->m_Pdb->GetHModule() + (ULONG64)func->m_Address;
@@ -456,6 +473,8 @@ void Capture::Update()
         GPdbDbg->Update();
     }
 
+    GModuleManager.Update();
+
     if( GInjected && !GTcpServer->HasConnection() )
     {
         StopCapture();
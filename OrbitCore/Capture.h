@@ -78,6 +78,7 @@ struct Capture
     static std::shared_ptr<Session>          GSessionPresets;
     static std::shared_ptr<CallStack>        GSelectedCallstack;
     static void( *GClearCaptureDataFunc )( );
+    static void( *GCancelCaptureLoadingFunc )( );
     static void( *GSamplingDoneCallback )( std::shared_ptr<SamplingProfiler> & a_SamplingProfiler );
     static std::map< ULONG64, Function* > GSelectedFunctionsMap;
     static std::map< ULONG64, Function* > GVisibleFunctionsMap;
@@ -0,0 +1,247 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Core.h"
+#include "CaptureFile.h"
+#include "Serialization.h"
+#include "PrintVar.h"
+#include "Log.h"
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+CaptureFileWriter::CaptureFileWriter() : m_NumTimers(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool CaptureFileWriter::Open( const std::wstring & a_FileName )
+{
+    m_File.open( a_FileName, std::ios::binary );
+    if( m_File.fail() )
+    {
+        return false;
+    }
+
+    CaptureFileHeader header;
+    memcpy( header.m_Magic, CaptureFile::MAGIC, sizeof( header.m_Magic ) );
+    header.m_Version = CaptureFile::VERSION;
+    m_File.write( (const char*)&header, sizeof( header ) );
+
+    m_PendingTimers.clear();
+    m_Chunks.clear();
+    m_NumTimers = 0;
+    return !m_File.fail();
+}
+
+//-----------------------------------------------------------------------------
+void CaptureFileWriter::AddTimer( const Timer & a_Timer )
+{
+    std::vector<Timer> & timers = m_PendingTimers[a_Timer.m_TID];
+    timers.push_back( a_Timer );
+    ++m_NumTimers;
+
+    if( timers.size() >= CaptureFile::NUM_TIMERS_PER_CHUNK )
+    {
+        WriteChunk( timers );
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CaptureFileWriter::AddTimers( const Timer* a_Timers, size_t a_NumTimers )
+{
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        AddTimer( a_Timers[i] );
+    }
+}
+
+//-----------------------------------------------------------------------------
+void CaptureFileWriter::WriteChunk( std::vector<Timer> & a_Timers )
+{
+    if( a_Timers.empty() )
+        return;
+
+    std::stable_sort( a_Timers.begin(), a_Timers.end(), []( const Timer & a, const Timer & b )
+    {
+        return a.m_Start < b.m_Start;
+    } );
+
+    CaptureChunk chunk;
+    chunk.m_ThreadId = a_Timers[0].m_TID;
+    chunk.m_NumTimers = (uint32_t)a_Timers.size();
+    chunk.m_MinStart = a_Timers.front().m_Start;
+    chunk.m_MaxEnd = a_Timers.front().m_End;
+    for( const Timer & timer : a_Timers )
+    {
+        chunk.m_MaxEnd = std::max( chunk.m_MaxEnd, timer.m_End );
+    }
+
+    m_TimerEncoder.Encode( a_Timers.data(), a_Timers.size(), m_EncodedTimers );
+    chunk.m_Offset = (uint64_t)m_File.tellp();
+    chunk.m_Size = (uint32_t)m_EncodedTimers.size();
+    m_File.write( (const char*)m_EncodedTimers.data(), m_EncodedTimers.size() );
+
+    m_Chunks.push_back( chunk );
+    a_Timers.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool CaptureFileWriter::Close( std::function< void( std::ostream & ) > a_WriteMetadata )
+{
+    for( auto & pair : m_PendingTimers )
+    {
+        WriteChunk( pair.second );
+    }
+    m_PendingTimers.clear();
+
+    uint64_t timerBytes = (uint64_t)m_File.tellp() - sizeof( CaptureFileHeader );
+
+    CaptureFileFooter footer;
+    footer.m_MetadataOffset = (uint64_t)m_File.tellp();
+    a_WriteMetadata( m_File );
+
+    footer.m_IndexOffset = (uint64_t)m_File.tellp();
+    {
+        cereal::BinaryOutputArchive archive( m_File );
+        archive( m_Chunks );
+    }
+
+    memcpy( footer.m_Magic, CaptureFile::MAGIC, sizeof( footer.m_Magic ) );
+    footer.m_Version = CaptureFile::VERSION;
+    m_File.write( (const char*)&footer, sizeof( footer ) );
+
+    uint64_t metadataBytes = footer.m_IndexOffset - footer.m_MetadataOffset;
+    size_t numChunks = m_Chunks.size();
+    PRINT_VAR( m_NumTimers );
+    PRINT_VAR( numChunks );
+    PRINT_VAR( timerBytes );
+    PRINT_VAR( metadataBytes );
+
+    bool success = !m_File.fail();
+    m_File.close();
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+CaptureFileReader::CaptureFileReader() : m_IsCaptureFile(false)
+{
+    memset( &m_Footer, 0, sizeof( m_Footer ) );
+}
+
+//-----------------------------------------------------------------------------
+CaptureFileReader::~CaptureFileReader()
+{
+}
+
+//-----------------------------------------------------------------------------
+bool CaptureFileReader::Open( const std::wstring & a_FileName )
+{
+    if( !m_File.Open( a_FileName ) )
+    {
+        return false;
+    }
+
+    const char* data = m_File.GetData();
+    uint64_t size = m_File.GetSize();
+
+    CaptureFileHeader header;
+    if( size < sizeof( header ) )
+    {
+        return false;
+    }
+
+    memcpy( &header, data, sizeof( header ) );
+    if( memcmp( header.m_Magic, CaptureFile::MAGIC, sizeof( header.m_Magic ) ) != 0 )
+    {
+        return false;
+    }
+
+    m_IsCaptureFile = true;
+
+    if( header.m_Version > CaptureFile::VERSION || size < sizeof( header ) + sizeof( m_Footer ) )
+    {
+        ORBIT_ERROR;
+        return false;
+    }
+
+    uint64_t footerOffset = size - sizeof( m_Footer );
+    memcpy( &m_Footer, data + footerOffset, sizeof( m_Footer ) );
+    if( memcmp( m_Footer.m_Magic, CaptureFile::MAGIC, sizeof( m_Footer.m_Magic ) ) != 0 ||
+        m_Footer.m_MetadataOffset < sizeof( header ) ||
+        m_Footer.m_MetadataOffset > m_Footer.m_IndexOffset ||
+        m_Footer.m_IndexOffset > footerOffset )
+    {
+        // Truncated capture, writer didn't get to close the file
+        ORBIT_ERROR;
+        return false;
+    }
+
+    MemoryStreamBuffer indexBuffer( data + m_Footer.m_IndexOffset, (size_t)( footerOffset - m_Footer.m_IndexOffset ) );
+    std::istream indexStream( &indexBuffer );
+    cereal::BinaryInputArchive archive( indexStream );
+    archive( m_Chunks );
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+std::istream & CaptureFileReader::GetMetadataStream()
+{
+    const char* metadata = m_File.GetData() + m_Footer.m_MetadataOffset;
+    size_t size = (size_t)( m_Footer.m_IndexOffset - m_Footer.m_MetadataOffset );
+    m_MetadataBuffer = std::make_unique<MemoryStreamBuffer>( metadata, size );
+    m_MetadataStream = std::make_unique<std::istream>( m_MetadataBuffer.get() );
+    return *m_MetadataStream;
+}
+
+//-----------------------------------------------------------------------------
+bool CaptureFileReader::ReadChunk( const CaptureChunk & a_Chunk, std::vector<Timer> & o_Timers )
+{
+    return DecodeChunk( a_Chunk, m_TimerDecoder, o_Timers );
+}
+
+//-----------------------------------------------------------------------------
+bool CaptureFileReader::DecodeChunk( const CaptureChunk & a_Chunk, TimerDecoder & a_Decoder, std::vector<Timer> & o_Timers ) const
+{
+    o_Timers.clear();
+    if( a_Chunk.m_Offset < sizeof( CaptureFileHeader ) ||
+        a_Chunk.m_Offset + a_Chunk.m_Size > m_Footer.m_MetadataOffset )
+    {
+        return false;
+    }
+
+    return a_Decoder.Decode( m_File.GetData() + a_Chunk.m_Offset, a_Chunk.m_Size, o_Timers )
+        && o_Timers.size() == a_Chunk.m_NumTimers;
+}
+
+//-----------------------------------------------------------------------------
+void CaptureFileReader::ReadTimersInRange( TickType a_Min, TickType a_Max, ChunkCallback a_Callback )
+{
+    std::vector<Timer> timers;
+    for( const CaptureChunk & chunk : m_Chunks )
+    {
+        if( chunk.Overlaps( a_Min, a_Max ) )
+        {
+            if( ReadChunk( chunk, timers ) )
+            {
+                a_Callback( chunk, timers );
+            }
+            else
+            {
+                ORBIT_LOG( Format( "Corrupted capture chunk at offset %llu\n", chunk.m_Offset ) );
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+ORBIT_SERIALIZE( CaptureChunk, 0 )
+{
+    ORBIT_NVP_VAL( 0, m_ThreadId );
+    ORBIT_NVP_VAL( 0, m_NumTimers );
+    ORBIT_NVP_VAL( 0, m_MinStart );
+    ORBIT_NVP_VAL( 0, m_MaxEnd );
+    ORBIT_NVP_VAL( 0, m_Offset );
+    ORBIT_NVP_VAL( 0, m_Size );
+}
@@ -0,0 +1,133 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "ScopeTimer.h"
+#include "SerializationMacros.h"
+#include "TimerCodec.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MemoryStreamBuffer;
+
+//-----------------------------------------------------------------------------
+// Chunked capture container.
+//
+//   CaptureFileHeader
+//   Timer chunks     : TimerCodec batches of a single thread, sorted by start
+//   Metadata         : cereal archive written by the caller (functions, process...)
+//   Chunk index      : cereal archive of std::vector<CaptureChunk>
+//   CaptureFileFooter: offsets of metadata and index
+//
+// Chunks are written as soon as a thread has accumulated enough timers, so
+// a capture can be streamed to disk while recording. Readers only need the
+// footer and index to find the chunks overlapping a time range.
+// The file layout is little endian and fixed between Win32 and x64.
+namespace CaptureFile
+{
+    static const char     MAGIC[4] = { 'O', 'R', 'B', 'C' };
+    static const uint32_t VERSION = 1;
+    static const uint32_t NUM_TIMERS_PER_CHUNK = 16 * 1024;
+}
+
+//-----------------------------------------------------------------------------
+struct CaptureFileHeader
+{
+    char     m_Magic[4];
+    uint32_t m_Version;
+};
+
+//-----------------------------------------------------------------------------
+struct CaptureFileFooter
+{
+    uint64_t m_MetadataOffset;
+    uint64_t m_IndexOffset;
+    char     m_Magic[4];
+    uint32_t m_Version;
+};
+
+//-----------------------------------------------------------------------------
+struct CaptureChunk
+{
+    CaptureChunk() : m_ThreadId(0), m_NumTimers(0), m_MinStart(0), m_MaxEnd(0), m_Offset(0), m_Size(0) {}
+
+    bool Overlaps( TickType a_Min, TickType a_Max ) const { return m_MinStart <= a_Max && m_MaxEnd >= a_Min; }
+
+    int      m_ThreadId;
+    uint32_t m_NumTimers;
+    TickType m_MinStart;
+    TickType m_MaxEnd;
+    uint64_t m_Offset;
+    uint32_t m_Size;
+
+    ORBIT_SERIALIZABLE;
+};
+
+//-----------------------------------------------------------------------------
+class CaptureFileWriter
+{
+public:
+    CaptureFileWriter();
+
+    bool Open( const std::wstring & a_FileName );
+    void AddTimer( const Timer & a_Timer );
+    void AddTimers( const Timer* a_Timers, size_t a_NumTimers );
+
+    // Flushes pending chunks, then a_WriteMetadata, index and footer
+    bool Close( std::function< void( std::ostream & ) > a_WriteMetadata );
+
+    uint64_t GetNumTimers() const { return m_NumTimers; }
+
+protected:
+    void WriteChunk( std::vector<Timer> & a_Timers );
+
+protected:
+    std::ofstream                                  m_File;
+    std::unordered_map< int, std::vector<Timer> >  m_PendingTimers;
+    std::vector< CaptureChunk >                    m_Chunks;
+    TimerEncoder                                   m_TimerEncoder;
+    std::vector< uint8_t >                         m_EncodedTimers;
+    uint64_t                                       m_NumTimers;
+};
+
+//-----------------------------------------------------------------------------
+// Reads a capture through a read-only file mapping, chunks are decoded
+// straight from the mapped pages and only when asked for.
+class CaptureFileReader
+{
+public:
+    CaptureFileReader();
+    ~CaptureFileReader();
+
+    // IsCaptureFile() tells a legacy capture apart from a truncated one
+    bool Open( const std::wstring & a_FileName );
+    bool IsCaptureFile() const { return m_IsCaptureFile; }
+
+    // Stream over the metadata written by the writer
+    std::istream & GetMetadataStream();
+
+    const std::vector< CaptureChunk > & GetChunks() const { return m_Chunks; }
+    bool ReadChunk( const CaptureChunk & a_Chunk, std::vector<Timer> & o_Timers );
+
+    // Thread safe as long as each thread uses its own decoder
+    bool DecodeChunk( const CaptureChunk & a_Chunk, TimerDecoder & a_Decoder, std::vector<Timer> & o_Timers ) const;
+
+    // Calls a_Callback for every chunk overlapping [a_Min, a_Max]
+    typedef std::function< void( const CaptureChunk & a_Chunk, std::vector<Timer> & a_Timers ) > ChunkCallback;
+    void ReadTimersInRange( TickType a_Min, TickType a_Max, ChunkCallback a_Callback );
+
+protected:
+    MappedFile                            m_File;
+    CaptureFileFooter                     m_Footer;
+    std::vector< CaptureChunk >           m_Chunks;
+    TimerDecoder                          m_TimerDecoder;
+    std::unique_ptr< MemoryStreamBuffer > m_MetadataBuffer;
+    std::unique_ptr< std::istream >       m_MetadataStream;
+    bool                                  m_IsCaptureFile;
+};
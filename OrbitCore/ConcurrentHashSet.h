@@ -0,0 +1,226 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+//-----------------------------------------------------------------------------
+// Lock-free set of 64 bit keys, any thread can insert. Slots are claimed with
+// a compare exchange and linear probing, keys are only removed by Clear.
+// When a table is half full, or a key can't be stored within MAX_PROBES
+// slots, a table twice as large is linked after it. Tables are never freed
+// before the set, so readers don't need to synchronize with growth. Once the
+// largest table is full, keys are reported as new: this costs redundant work
+// but never drops a key. Memory is bounded by the sum of all table sizes,
+// 2^(a_MaxLog2Capacity+1) slots at most.
+class ConcurrentHashSet
+{
+public:
+    static const uint32_t MAX_PROBES = 64;
+
+    //-----------------------------------------------------------------------------
+    explicit ConcurrentHashSet( uint32_t a_Log2Capacity = 16, uint32_t a_MaxLog2Capacity = 18 )
+        : m_First( a_Log2Capacity )
+        , m_MaxLog2Capacity( a_MaxLog2Capacity )
+    {
+    }
+
+    //-----------------------------------------------------------------------------
+    ~ConcurrentHashSet()
+    {
+        Table* table = m_First.m_Next.load();
+        while( table )
+        {
+            Table* next = table->m_Next.load();
+            delete table;
+            table = next;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    // Returns false only if a_Key was already in the set
+    bool Insert( uint64_t a_Key )
+    {
+        // 0 marks empty slots
+        if( a_Key == 0 )
+            return true;
+
+        for( Table* table = &m_First; table; table = GetNextTable( *table ) )
+        {
+            switch( table->Insert( a_Key ) )
+            {
+            case Inserted:  return true;
+            case Found:     return false;
+            case Full:      break;
+            }
+        }
+
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+    bool Contains( uint64_t a_Key ) const
+    {
+        if( a_Key == 0 )
+            return false;
+
+        for( const Table* table = &m_First; table; table = table->m_Next.load( std::memory_order_acquire ) )
+        {
+            if( table->Contains( a_Key ) )
+                return true;
+        }
+
+        return false;
+    }
+
+    //-----------------------------------------------------------------------------
+    // Can run concurrently with Insert, keys inserted meanwhile may be lost.
+    // Linked tables are kept for the next use of the set.
+    void Clear()
+    {
+        for( Table* table = &m_First; table; table = table->m_Next.load( std::memory_order_acquire ) )
+        {
+            table->Clear();
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    size_t Size() const
+    {
+        size_t size = 0;
+        for( const Table* table = &m_First; table; table = table->m_Next.load( std::memory_order_acquire ) )
+        {
+            size += table->m_Size.load( std::memory_order_relaxed );
+        }
+        return size;
+    }
+
+    //-----------------------------------------------------------------------------
+    size_t Capacity() const
+    {
+        size_t capacity = 0;
+        for( const Table* table = &m_First; table; table = table->m_Next.load( std::memory_order_acquire ) )
+        {
+            capacity += table->m_Mask + 1;
+        }
+        return capacity;
+    }
+
+protected:
+    enum InsertResult { Inserted, Found, Full };
+
+    //-----------------------------------------------------------------------------
+    struct Table
+    {
+        //-----------------------------------------------------------------------------
+        explicit Table( uint32_t a_Log2Capacity )
+            : m_Keys( new std::atomic<uint64_t>[ size_t(1) << a_Log2Capacity ] )
+            , m_Mask( ( size_t(1) << a_Log2Capacity ) - 1 )
+            , m_Log2Capacity( a_Log2Capacity )
+            , m_Size( 0 )
+            , m_Next( nullptr )
+        {
+            Clear();
+        }
+
+        //-----------------------------------------------------------------------------
+        InsertResult Insert( uint64_t a_Key )
+        {
+            // Keys already stored are still found in a table past its load factor
+            bool isFull = m_Size.load( std::memory_order_relaxed ) * 2 >= m_Mask + 1;
+
+            size_t slot = GetSlot( a_Key );
+            for( uint32_t i = 0; i < MAX_PROBES; ++i )
+            {
+                std::atomic<uint64_t> & entry = m_Keys[slot];
+                uint64_t key = entry.load( std::memory_order_relaxed );
+                if( key == a_Key )
+                    return Found;
+
+                if( key == 0 )
+                {
+                    if( isFull )
+                        return Full;
+
+                    if( entry.compare_exchange_strong( key, a_Key, std::memory_order_relaxed ) )
+                    {
+                        m_Size.fetch_add( 1, std::memory_order_relaxed );
+                        return Inserted;
+                    }
+
+                    // Lost the race, the winner might have inserted the same key
+                    if( key == a_Key )
+                        return Found;
+                }
+
+                slot = ( slot + 1 ) & m_Mask;
+            }
+
+            return Full;
+        }
+
+        //-----------------------------------------------------------------------------
+        bool Contains( uint64_t a_Key ) const
+        {
+            size_t slot = GetSlot( a_Key );
+            for( uint32_t i = 0; i < MAX_PROBES; ++i )
+            {
+                uint64_t key = m_Keys[slot].load( std::memory_order_relaxed );
+                if( key == a_Key )
+                    return true;
+                if( key == 0 )
+                    return false;
+                slot = ( slot + 1 ) & m_Mask;
+            }
+
+            return false;
+        }
+
+        //-----------------------------------------------------------------------------
+        void Clear()
+        {
+            for( size_t i = 0; i <= m_Mask; ++i )
+            {
+                m_Keys[i].store( 0, std::memory_order_relaxed );
+            }
+
+            m_Size = 0;
+        }
+
+        //-----------------------------------------------------------------------------
+        size_t GetSlot( uint64_t a_Key ) const
+        {
+            return (size_t)( ( a_Key * 0x9E3779B97F4A7C15ull ) >> ( 64 - m_Log2Capacity ) );
+        }
+
+        std::unique_ptr< std::atomic<uint64_t>[] > m_Keys;
+        size_t                                     m_Mask;
+        uint32_t                                   m_Log2Capacity;
+        std::atomic<size_t>                        m_Size;
+        std::atomic<Table*>                        m_Next;
+    };
+
+    //-----------------------------------------------------------------------------
+    // Links a table twice as large after a_Table if there is none yet
+    Table* GetNextTable( Table & a_Table )
+    {
+        Table* next = a_Table.m_Next.load( std::memory_order_acquire );
+        if( next || a_Table.m_Log2Capacity >= m_MaxLog2Capacity )
+            return next;
+
+        Table* table = new Table( a_Table.m_Log2Capacity + 1 );
+        if( a_Table.m_Next.compare_exchange_strong( next, table, std::memory_order_acq_rel ) )
+            return table;
+
+        // Another thread linked one first
+        delete table;
+        return next;
+    }
+
+protected:
+    Table    m_First;
+    uint32_t m_MaxLog2Capacity;
+};
@@ -3,6 +3,7 @@
 //-----------------------------------
 
 #include "ContextSwitch.h"
+#include <algorithm>
 
 //-----------------------------------------------------------------------------
 ContextSwitch::ContextSwitch( SwitchType a_Type ) : m_ThreadId( 0 )
@@ -18,4 +19,58 @@ ContextSwitch::ContextSwitch( SwitchType a_Type ) : m_ThreadId( 0 )
 ContextSwitch::~ContextSwitch()
 {
 
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+bool ContextSwitchStream::Add( const ContextSwitch & a_CS, ContextSwitch & o_Previous )
+{
+    if( m_Switches.empty() || m_Switches.back().m_Time <= a_CS.m_Time )
+    {
+        bool hasPrevious = !m_Switches.empty();
+        if( hasPrevious )
+        {
+            o_Previous = m_Switches.back();
+        }
+
+        m_Switches.push_back( a_CS );
+        return hasPrevious;
+    }
+
+    // Late event, usually only a few entries from the end
+    ++m_NumOutOfOrder;
+    auto it = std::upper_bound( m_Switches.begin(), m_Switches.end(), a_CS.m_Time, []( long long a_Time, const ContextSwitch & a_Switch )
+    {
+        return a_Time < a_Switch.m_Time;
+    } );
+
+    bool hasPrevious = it != m_Switches.begin();
+    if( hasPrevious )
+    {
+        o_Previous = *( it - 1 );
+    }
+
+    m_Switches.insert( it, a_CS );
+    return hasPrevious;
+}
+
+//-----------------------------------------------------------------------------
+void ContextSwitchStream::Clear()
+{
+    m_Switches.clear();
+    m_NumOutOfOrder = 0;
+}
+
+//-----------------------------------------------------------------------------
+void ContextSwitchStream::GetRange( long long a_Min, long long a_Max, const ContextSwitch* & o_Begin, const ContextSwitch* & o_End ) const
+{
+    auto Compare = []( const ContextSwitch & a_Switch, long long a_Time )
+    {
+        return a_Switch.m_Time < a_Time;
+    };
+
+    auto begin = std::lower_bound( m_Switches.begin(), m_Switches.end(), a_Min, Compare );
+    auto end = std::lower_bound( begin, m_Switches.end(), std::max( a_Min, a_Max ), Compare );
+
+    o_Begin = m_Switches.data() + ( begin - m_Switches.begin() );
+    o_End = m_Switches.data() + ( end - m_Switches.begin() );
+}
@@ -3,6 +3,9 @@
 //-----------------------------------
 #pragma once
 
+#include <cstddef>
+#include <vector>
+
 //-----------------------------------------------------------------------------
 struct ContextSwitch
 {
@@ -16,4 +19,28 @@ public:
     long long       m_Time;
     unsigned short  m_ProcessorIndex;
     unsigned char   m_ProcessorNumber;
-};
\ No newline at end of file
+};
+
+//-----------------------------------------------------------------------------
+// Context switches of a single core or thread, sorted by time. Events almost
+// always arrive in order and are appended, late ones are inserted in place.
+class ContextSwitchStream
+{
+public:
+    ContextSwitchStream() : m_NumOutOfOrder( 0 ) {}
+
+    // o_Previous receives the switch preceding a_CS in time, if any
+    bool Add( const ContextSwitch & a_CS, ContextSwitch & o_Previous );
+    void Clear();
+
+    // Switches with a_Min <= m_Time < a_Max, valid until the next Add
+    void GetRange( long long a_Min, long long a_Max, const ContextSwitch* & o_Begin, const ContextSwitch* & o_End ) const;
+
+    size_t Size() const           { return m_Switches.size(); }
+    size_t NumOutOfOrder() const  { return m_NumOutOfOrder; }
+    const std::vector< ContextSwitch > & GetSwitches() const { return m_Switches; }
+
+protected:
+    std::vector< ContextSwitch > m_Switches;
+    size_t                       m_NumOutOfOrder;
+};
@@ -750,7 +750,7 @@ void DiaParser::OrbitAddGlobalSymbol(IDiaSymbol* pSymbol)
         //Var.m_DataKind  = dataKind;
         //Var.m_TypeIndex = index;
 
-        GPdbDbg->AddGlobal(Var);
+        GetParsingPdb()->AddGlobal(Var);
     }
 }
 
@@ -0,0 +1,895 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "ElfFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+//-----------------------------------------------------------------------------
+// Layouts from the System V gABI, only 64 bit little endian files are handled
+namespace Elf
+{
+    static const uint8_t  CLASS_64       = 2;
+    static const uint8_t  DATA_LSB       = 1;
+    static const uint32_t SHT_SYMTAB     = 2;
+    static const uint32_t SHT_DYNSYM     = 11;
+    static const uint64_t SHF_COMPRESSED = 0x800;
+    static const uint16_t SHN_XINDEX     = 0xffff;
+    static const uint32_t PT_LOAD        = 1;
+    static const uint8_t  STT_FUNC       = 2;
+    static const uint8_t  STT_GNU_IFUNC  = 10;
+
+#pragma pack(push, 1)
+    struct Header
+    {
+        uint8_t  m_Ident[16];
+        uint16_t m_Type;
+        uint16_t m_Machine;
+        uint32_t m_Version;
+        uint64_t m_Entry;
+        uint64_t m_ProgramHeaderOffset;
+        uint64_t m_SectionHeaderOffset;
+        uint32_t m_Flags;
+        uint16_t m_HeaderSize;
+        uint16_t m_ProgramHeaderSize;
+        uint16_t m_NumProgramHeaders;
+        uint16_t m_SectionHeaderSize;
+        uint16_t m_NumSectionHeaders;
+        uint16_t m_SectionNameIndex;
+    };
+
+    struct SectionHeader
+    {
+        uint32_t m_Name;
+        uint32_t m_Type;
+        uint64_t m_Flags;
+        uint64_t m_Address;
+        uint64_t m_Offset;
+        uint64_t m_Size;
+        uint32_t m_Link;
+        uint32_t m_Info;
+        uint64_t m_Align;
+        uint64_t m_EntrySize;
+    };
+
+    struct ProgramHeader
+    {
+        uint32_t m_Type;
+        uint32_t m_Flags;
+        uint64_t m_Offset;
+        uint64_t m_Address;
+        uint64_t m_PhysicalAddress;
+        uint64_t m_FileSize;
+        uint64_t m_MemorySize;
+        uint64_t m_Align;
+    };
+
+    struct Symbol
+    {
+        uint32_t m_Name;
+        uint8_t  m_Info;
+        uint8_t  m_Other;
+        uint16_t m_SectionIndex;
+        uint64_t m_Value;
+        uint64_t m_Size;
+    };
+#pragma pack(pop)
+}
+
+//-----------------------------------------------------------------------------
+namespace Dwarf
+{
+    static const uint8_t LNS_COPY               = 1;
+    static const uint8_t LNS_ADVANCE_PC         = 2;
+    static const uint8_t LNS_ADVANCE_LINE       = 3;
+    static const uint8_t LNS_SET_FILE           = 4;
+    static const uint8_t LNS_CONST_ADD_PC       = 8;
+    static const uint8_t LNS_FIXED_ADVANCE_PC   = 9;
+    static const uint8_t LNE_END_SEQUENCE       = 1;
+    static const uint8_t LNE_SET_ADDRESS        = 2;
+    static const uint8_t LNE_DEFINE_FILE        = 3;
+    static const uint64_t LNCT_PATH             = 1;
+    static const uint64_t LNCT_DIRECTORY_INDEX  = 2;
+    static const uint64_t FORM_BLOCK            = 0x09;
+    static const uint64_t FORM_DATA1            = 0x0b;
+    static const uint64_t FORM_DATA2            = 0x05;
+    static const uint64_t FORM_DATA4            = 0x06;
+    static const uint64_t FORM_DATA8            = 0x07;
+    static const uint64_t FORM_DATA16           = 0x1e;
+    static const uint64_t FORM_STRING           = 0x08;
+    static const uint64_t FORM_STRP             = 0x0e;
+    static const uint64_t FORM_UDATA            = 0x0f;
+    static const uint64_t FORM_LINE_STRP        = 0x1f;
+}
+
+//-----------------------------------------------------------------------------
+// Bounds checked cursor, reads past the end return 0 and flag an error
+class DwarfReader
+{
+public:
+    DwarfReader( const uint8_t* a_Begin, const uint8_t* a_End ) : m_Pos( a_Begin ), m_End( a_End ), m_Error( false ) {}
+
+    template< class T > T Read()
+    {
+        T value = 0;
+        if( (size_t)( m_End - m_Pos ) < sizeof( T ) )
+        {
+            m_Error = true;
+            m_Pos = m_End;
+            return value;
+        }
+
+        memcpy( &value, m_Pos, sizeof( T ) );
+        m_Pos += sizeof( T );
+        return value;
+    }
+
+    uint64_t ReadOffset( uint32_t a_OffsetSize ) { return a_OffsetSize == 8 ? Read<uint64_t>() : Read<uint32_t>(); }
+
+    uint64_t ReadULEB()
+    {
+        uint64_t value = 0;
+        uint32_t shift = 0;
+        while( m_Pos < m_End )
+        {
+            uint8_t byte = *m_Pos++;
+            if( shift < 64 )
+                value |= (uint64_t)( byte & 0x7f ) << shift;
+            shift += 7;
+            if( ( byte & 0x80 ) == 0 )
+                return value;
+        }
+
+        m_Error = true;
+        return value;
+    }
+
+    int64_t ReadSLEB()
+    {
+        int64_t value = 0;
+        uint32_t shift = 0;
+        uint8_t byte = 0;
+        do
+        {
+            if( m_Pos >= m_End )
+            {
+                m_Error = true;
+                return value;
+            }
+
+            byte = *m_Pos++;
+            if( shift < 64 )
+                value |= (int64_t)( byte & 0x7f ) << shift;
+            shift += 7;
+        } while( byte & 0x80 );
+
+        if( shift < 64 && ( byte & 0x40 ) )
+            value |= -( (int64_t)1 << shift );
+        return value;
+    }
+
+    const char* ReadString()
+    {
+        const uint8_t* end = (const uint8_t*)memchr( m_Pos, 0, m_End - m_Pos );
+        if( end == nullptr )
+        {
+            m_Error = true;
+            m_Pos = m_End;
+            return "";
+        }
+
+        const char* str = (const char*)m_Pos;
+        m_Pos = end + 1;
+        return str;
+    }
+
+    void Skip( uint64_t a_Size )
+    {
+        if( (uint64_t)( m_End - m_Pos ) < a_Size )
+        {
+            m_Error = true;
+            m_Pos = m_End;
+            return;
+        }
+
+        m_Pos += a_Size;
+    }
+
+    uint64_t Remaining() const { return (uint64_t)( m_End - m_Pos ); }
+
+    const uint8_t* m_Pos;
+    const uint8_t* m_End;
+    bool           m_Error;
+};
+
+//-----------------------------------------------------------------------------
+struct LineStrings
+{
+    const char* m_LineStr;
+    uint64_t    m_LineStrSize;
+    const char* m_Str;
+    uint64_t    m_StrSize;
+};
+
+//-----------------------------------------------------------------------------
+struct LineUnit
+{
+    const uint8_t*                 m_Begin;
+    const uint8_t*                 m_End;
+    std::vector< ElfFile::LineRow > m_Rows;   // m_File is an index in m_Files
+    std::vector< std::string >     m_Files;
+};
+
+//-----------------------------------------------------------------------------
+static const char* GetString( const char* a_Strings, uint64_t a_Size, uint64_t a_Offset )
+{
+    if( a_Strings == nullptr || a_Offset >= a_Size || memchr( a_Strings + a_Offset, 0, a_Size - a_Offset ) == nullptr )
+    {
+        return "";
+    }
+
+    return a_Strings + a_Offset;
+}
+
+//-----------------------------------------------------------------------------
+static std::string JoinPath( const std::string & a_Directory, const std::string & a_File )
+{
+    bool isAbsolute = ( a_File.size() > 0 && ( a_File[0] == '/' || a_File[0] == '\\' ) ) || ( a_File.size() > 1 && a_File[1] == ':' );
+    if( isAbsolute || a_Directory.empty() )
+    {
+        return a_File;
+    }
+
+    return a_Directory + "/" + a_File;
+}
+
+//-----------------------------------------------------------------------------
+// DWARF 5 directory and file tables are described by (content, form) pairs
+static bool ReadEntryTable( DwarfReader & a_Reader, uint32_t a_OffsetSize, const LineStrings & a_Strings
+                          , std::vector< std::string > & o_Paths, std::vector< uint64_t > & o_DirectoryIndices )
+{
+    uint8_t numFormats = a_Reader.Read<uint8_t>();
+    std::vector< std::pair< uint64_t, uint64_t > > formats( numFormats );
+    for( auto & format : formats )
+    {
+        format.first = a_Reader.ReadULEB();
+        format.second = a_Reader.ReadULEB();
+    }
+
+    // Entries take at least a byte each, except with no formats at all
+    uint64_t numEntries = a_Reader.ReadULEB();
+    if( numEntries > a_Reader.Remaining() )
+        return false;
+
+    for( uint64_t i = 0; i < numEntries && !a_Reader.m_Error; ++i )
+    {
+        std::string path;
+        uint64_t directoryIndex = 0;
+
+        for( auto & format : formats )
+        {
+            const char* str = nullptr;
+            uint64_t value = 0;
+
+            switch( format.second )
+            {
+            case Dwarf::FORM_STRING:    str = a_Reader.ReadString(); break;
+            case Dwarf::FORM_LINE_STRP: str = GetString( a_Strings.m_LineStr, a_Strings.m_LineStrSize, a_Reader.ReadOffset( a_OffsetSize ) ); break;
+            case Dwarf::FORM_STRP:      str = GetString( a_Strings.m_Str, a_Strings.m_StrSize, a_Reader.ReadOffset( a_OffsetSize ) ); break;
+            case Dwarf::FORM_UDATA:     value = a_Reader.ReadULEB(); break;
+            case Dwarf::FORM_DATA1:     value = a_Reader.Read<uint8_t>(); break;
+            case Dwarf::FORM_DATA2:     value = a_Reader.Read<uint16_t>(); break;
+            case Dwarf::FORM_DATA4:     value = a_Reader.Read<uint32_t>(); break;
+            case Dwarf::FORM_DATA8:     value = a_Reader.Read<uint64_t>(); break;
+            case Dwarf::FORM_DATA16:    a_Reader.Skip( 16 ); break;
+            case Dwarf::FORM_BLOCK:     a_Reader.Skip( a_Reader.ReadULEB() ); break;
+            default:
+                // strx forms need .debug_str_offsets and the unit DIE, not supported
+                return false;
+            }
+
+            if( format.first == Dwarf::LNCT_PATH && str )
+                path = str;
+            else if( format.first == Dwarf::LNCT_DIRECTORY_INDEX )
+                directoryIndex = value;
+        }
+
+        o_Paths.push_back( path );
+        o_DirectoryIndices.push_back( directoryIndex );
+    }
+
+    return !a_Reader.m_Error;
+}
+
+//-----------------------------------------------------------------------------
+static bool ParseLineUnit( LineUnit & a_Unit, const LineStrings & a_Strings, uint64_t a_LoadBias )
+{
+    DwarfReader reader( a_Unit.m_Begin, a_Unit.m_End );
+
+    uint32_t offsetSize = 4;
+    uint64_t unitLength = reader.Read<uint32_t>();
+    if( unitLength == 0xffffffff )
+    {
+        offsetSize = 8;
+        unitLength = reader.Read<uint64_t>();
+    }
+
+    uint16_t version = reader.Read<uint16_t>();
+    if( version < 2 || version > 5 )
+    {
+        return false;
+    }
+
+    uint8_t addressSize = 8;
+    if( version >= 5 )
+    {
+        addressSize = reader.Read<uint8_t>();
+        reader.Read<uint8_t>(); // segment selector size
+    }
+
+    uint64_t headerLength = reader.ReadOffset( offsetSize );
+    if( reader.m_Error || headerLength > (uint64_t)( a_Unit.m_End - reader.m_Pos ) )
+    {
+        return false;
+    }
+
+    const uint8_t* program = reader.m_Pos + headerLength;
+
+    uint8_t minInstructionLength = reader.Read<uint8_t>();
+    if( version >= 4 )
+        reader.Read<uint8_t>(); // max ops per instruction, VLIW only
+    uint8_t defaultIsStmt = reader.Read<uint8_t>();
+    int8_t  lineBase = reader.Read<int8_t>();
+    uint8_t lineRange = reader.Read<uint8_t>();
+    uint8_t opcodeBase = reader.Read<uint8_t>();
+    (void)defaultIsStmt;
+
+    std::vector< uint8_t > opcodeLengths( opcodeBase > 0 ? opcodeBase - 1 : 0 );
+    for( uint8_t & length : opcodeLengths )
+    {
+        length = reader.Read<uint8_t>();
+    }
+
+    if( reader.m_Error || lineRange == 0 )
+    {
+        return false;
+    }
+
+    std::vector< std::string > directories;
+    if( version >= 5 )
+    {
+        std::vector< uint64_t > unused;
+        std::vector< uint64_t > directoryIndices;
+        if( !ReadEntryTable( reader, offsetSize, a_Strings, directories, unused ) ||
+            !ReadEntryTable( reader, offsetSize, a_Strings, a_Unit.m_Files, directoryIndices ) )
+        {
+            return false;
+        }
+
+        for( size_t i = 0; i < a_Unit.m_Files.size(); ++i )
+        {
+            if( directoryIndices[i] < directories.size() )
+                a_Unit.m_Files[i] = JoinPath( directories[(size_t)directoryIndices[i]], a_Unit.m_Files[i] );
+        }
+    }
+    else
+    {
+        // Directory 0 is the compilation directory, file indices start at 1
+        directories.push_back( "" );
+        for( const char* dir = reader.ReadString(); *dir && !reader.m_Error; dir = reader.ReadString() )
+        {
+            directories.push_back( dir );
+        }
+
+        a_Unit.m_Files.push_back( "" );
+        for( const char* file = reader.ReadString(); *file && !reader.m_Error; file = reader.ReadString() )
+        {
+            uint64_t directoryIndex = reader.ReadULEB();
+            reader.ReadULEB(); // modification time
+            reader.ReadULEB(); // length
+            a_Unit.m_Files.push_back( JoinPath( directoryIndex < directories.size() ? directories[(size_t)directoryIndex] : "", file ) );
+        }
+    }
+
+    if( reader.m_Error )
+    {
+        return false;
+    }
+
+    // Line number program
+    reader.m_Pos = program;
+
+    uint64_t address = 0;
+    uint32_t file = 1;
+    int64_t  line = 1;
+    size_t   sequenceStart = a_Unit.m_Rows.size();
+
+    auto EmitRow = [&]( bool a_EndSequence )
+    {
+        ElfFile::LineRow row;
+        row.m_Rva = address - a_LoadBias;
+        row.m_File = file;
+        row.m_Line = a_EndSequence ? 0 : (uint32_t)std::max( line, (int64_t)1 );
+        a_Unit.m_Rows.push_back( row );
+    };
+
+    while( reader.m_Pos < a_Unit.m_End && !reader.m_Error )
+    {
+        uint8_t opcode = reader.Read<uint8_t>();
+
+        if( opcode >= opcodeBase )
+        {
+            uint8_t adjusted = opcode - opcodeBase;
+            address += ( adjusted / lineRange ) * minInstructionLength;
+            line += lineBase + ( adjusted % lineRange );
+            EmitRow( false );
+        }
+        else if( opcode == 0 )
+        {
+            uint64_t length = reader.ReadULEB();
+            if( length == 0 || length > (uint64_t)( a_Unit.m_End - reader.m_Pos ) )
+                return false;
+
+            const uint8_t* next = reader.m_Pos + length;
+
+            uint8_t subOpcode = reader.Read<uint8_t>();
+            switch( subOpcode )
+            {
+            case Dwarf::LNE_END_SEQUENCE:
+            {
+                EmitRow( true );
+
+                // Code discarded by the linker keeps its line program with a
+                // tombstone address, and anything below the load bias is bogus
+                uint64_t start = a_Unit.m_Rows[sequenceStart].m_Rva + a_LoadBias;
+                if( start == 0 || start >= 0xfffffffffffffffeull || start < a_LoadBias )
+                {
+                    a_Unit.m_Rows.resize( sequenceStart );
+                }
+
+                sequenceStart = a_Unit.m_Rows.size();
+                address = 0;
+                file = 1;
+                line = 1;
+                break;
+            }
+            case Dwarf::LNE_SET_ADDRESS:
+                address = addressSize == 4 ? reader.Read<uint32_t>() : reader.Read<uint64_t>();
+                break;
+            case Dwarf::LNE_DEFINE_FILE:
+            {
+                const char* name = reader.ReadString();
+                uint64_t directoryIndex = reader.ReadULEB();
+                a_Unit.m_Files.push_back( JoinPath( directoryIndex < directories.size() ? directories[(size_t)directoryIndex] : "", name ) );
+                break;
+            }
+            default:
+                break;
+            }
+
+            reader.m_Pos = next;
+        }
+        else if( opcode == Dwarf::LNS_COPY )
+        {
+            EmitRow( false );
+        }
+        else if( opcode == Dwarf::LNS_ADVANCE_PC )
+        {
+            address += reader.ReadULEB() * minInstructionLength;
+        }
+        else if( opcode == Dwarf::LNS_ADVANCE_LINE )
+        {
+            line += reader.ReadSLEB();
+        }
+        else if( opcode == Dwarf::LNS_SET_FILE )
+        {
+            file = (uint32_t)reader.ReadULEB();
+        }
+        else if( opcode == Dwarf::LNS_CONST_ADD_PC )
+        {
+            address += ( ( 255 - opcodeBase ) / lineRange ) * minInstructionLength;
+        }
+        else if( opcode == Dwarf::LNS_FIXED_ADVANCE_PC )
+        {
+            address += reader.Read<uint16_t>();
+        }
+        else
+        {
+            // Column, stmt, basic block, prologue... only need skipping
+            for( uint8_t i = 0; i < opcodeLengths[opcode - 1]; ++i )
+            {
+                reader.ReadULEB();
+            }
+        }
+    }
+
+    // Drop a trailing sequence that was never terminated
+    a_Unit.m_Rows.resize( sequenceStart );
+    return !reader.m_Error;
+}
+
+//-----------------------------------------------------------------------------
+ElfFile::ElfFile() : m_LoadBias( 0 )
+                   , m_NumLineUnits( 0 )
+                   , m_NumFailedLineUnits( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+ElfFile::~ElfFile()
+{
+}
+
+//-----------------------------------------------------------------------------
+bool ElfFile::IsElf( const char* a_Data, uint64_t a_Size )
+{
+    return a_Size >= sizeof( Elf::Header ) && memcmp( a_Data, "\x7f" "ELF", 4 ) == 0;
+}
+
+//-----------------------------------------------------------------------------
+bool ElfFile::Open( const std::wstring & a_FileName )
+{
+    if( !m_File.Open( a_FileName ) || !IsElf( m_File.GetData(), m_File.GetSize() ) )
+    {
+        m_File.Close();
+        return false;
+    }
+
+    const char* data = m_File.GetData();
+    uint64_t size = m_File.GetSize();
+
+    Elf::Header header;
+    memcpy( &header, data, sizeof( header ) );
+    if( header.m_Ident[4] != Elf::CLASS_64 || header.m_Ident[5] != Elf::DATA_LSB )
+    {
+        m_Error = "only 64 bit little endian ELF files are supported";
+        m_File.Close();
+        return false;
+    }
+
+    // Program headers, addresses are made relative to the first loaded segment
+    bool foundLoad = false;
+    for( uint16_t i = 0; i < header.m_NumProgramHeaders; ++i )
+    {
+        uint64_t offset = header.m_ProgramHeaderOffset + (uint64_t)i * header.m_ProgramHeaderSize;
+        if( header.m_ProgramHeaderSize < sizeof( Elf::ProgramHeader ) || offset + sizeof( Elf::ProgramHeader ) > size )
+            break;
+
+        Elf::ProgramHeader programHeader;
+        memcpy( &programHeader, data + offset, sizeof( programHeader ) );
+        if( programHeader.m_Type == Elf::PT_LOAD && !foundLoad )
+        {
+            uint64_t align = programHeader.m_Align > 1 ? programHeader.m_Align : 1;
+            m_LoadBias = programHeader.m_Address & ~( align - 1 );
+            foundLoad = true;
+        }
+    }
+
+    // Section headers
+    std::vector< Elf::SectionHeader > sectionHeaders;
+    if( header.m_SectionHeaderSize >= sizeof( Elf::SectionHeader ) )
+    {
+        for( uint16_t i = 0; i < header.m_NumSectionHeaders; ++i )
+        {
+            uint64_t offset = header.m_SectionHeaderOffset + (uint64_t)i * header.m_SectionHeaderSize;
+            if( offset + sizeof( Elf::SectionHeader ) > size )
+                break;
+
+            Elf::SectionHeader sectionHeader;
+            memcpy( &sectionHeader, data + offset, sizeof( sectionHeader ) );
+            sectionHeaders.push_back( sectionHeader );
+        }
+    }
+
+    uint32_t nameIndex = header.m_SectionNameIndex;
+    if( nameIndex == Elf::SHN_XINDEX && !sectionHeaders.empty() )
+    {
+        nameIndex = sectionHeaders[0].m_Link;
+    }
+
+    const char* names = nullptr;
+    uint64_t namesSize = 0;
+    if( nameIndex < sectionHeaders.size() && sectionHeaders[nameIndex].m_Offset <= size && sectionHeaders[nameIndex].m_Size <= size - sectionHeaders[nameIndex].m_Offset )
+    {
+        names = data + sectionHeaders[nameIndex].m_Offset;
+        namesSize = sectionHeaders[nameIndex].m_Size;
+    }
+
+    m_Sections.clear();
+    for( const Elf::SectionHeader & sectionHeader : sectionHeaders )
+    {
+        Section section;
+        section.m_Name = GetString( names, namesSize, sectionHeader.m_Name );
+        section.m_Type = sectionHeader.m_Type;
+        section.m_Flags = sectionHeader.m_Flags;
+        section.m_Offset = sectionHeader.m_Offset;
+        section.m_Size = sectionHeader.m_Size;
+        section.m_Link = sectionHeader.m_Link;
+        section.m_EntrySize = sectionHeader.m_EntrySize;
+
+        // NOBITS sections and corrupted headers point outside of the file
+        if( section.m_Offset > size || section.m_Size > size - section.m_Offset )
+        {
+            section.m_Offset = 0;
+            section.m_Size = 0;
+        }
+
+        m_Sections.push_back( section );
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+const ElfFile::Section* ElfFile::FindSection( const char* a_Name ) const
+{
+    for( const Section & section : m_Sections )
+    {
+        if( section.m_Name == a_Name )
+            return &section;
+    }
+
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+const ElfFile::Section* ElfFile::FindSection( uint32_t a_Type ) const
+{
+    for( const Section & section : m_Sections )
+    {
+        if( section.m_Type == a_Type && section.m_Size > 0 )
+            return &section;
+    }
+
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+bool ElfFile::LoadSymbols()
+{
+    m_Symbols.clear();
+
+    // .symtab is a superset of .dynsym, the latter is all stripped binaries have
+    const Section* symbolTable = FindSection( Elf::SHT_SYMTAB );
+    if( symbolTable == nullptr )
+    {
+        symbolTable = FindSection( Elf::SHT_DYNSYM );
+    }
+
+    if( symbolTable == nullptr )
+    {
+        return false;
+    }
+
+    LoadSymbolTable( *symbolTable );
+
+    // Aliases share an address, keep the one with a size
+    std::sort( m_Symbols.begin(), m_Symbols.end(), []( const ElfSymbol & a, const ElfSymbol & b )
+    {
+        return a.m_Rva != b.m_Rva ? a.m_Rva < b.m_Rva : a.m_Size > b.m_Size;
+    } );
+
+    m_Symbols.erase( std::unique( m_Symbols.begin(), m_Symbols.end(), []( const ElfSymbol & a, const ElfSymbol & b )
+    {
+        return a.m_Rva == b.m_Rva;
+    } ), m_Symbols.end() );
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void ElfFile::LoadSymbolTable( const Section & a_SymbolTable )
+{
+    const char* data = m_File.GetData();
+    const char* strings = nullptr;
+    uint64_t stringsSize = 0;
+    if( a_SymbolTable.m_Link < m_Sections.size() )
+    {
+        strings = data + m_Sections[a_SymbolTable.m_Link].m_Offset;
+        stringsSize = m_Sections[a_SymbolTable.m_Link].m_Size;
+    }
+
+    uint64_t entrySize = std::max( a_SymbolTable.m_EntrySize, (uint64_t)sizeof( Elf::Symbol ) );
+    uint64_t numSymbols = a_SymbolTable.m_Size / entrySize;
+    m_Symbols.reserve( m_Symbols.size() + (size_t)numSymbols );
+
+    for( uint64_t i = 0; i < numSymbols; ++i )
+    {
+        Elf::Symbol symbol;
+        memcpy( &symbol, data + a_SymbolTable.m_Offset + i * entrySize, sizeof( symbol ) );
+
+        uint8_t type = symbol.m_Info & 0xf;
+        if( ( type != Elf::STT_FUNC && type != Elf::STT_GNU_IFUNC ) || symbol.m_SectionIndex == 0 || symbol.m_Value < m_LoadBias )
+            continue;
+
+        ElfSymbol elfSymbol;
+        elfSymbol.m_Rva = symbol.m_Value - m_LoadBias;
+        elfSymbol.m_Size = symbol.m_Size;
+        elfSymbol.m_Name = GetString( strings, stringsSize, symbol.m_Name );
+        if( elfSymbol.m_Name.empty() )
+            continue;
+
+#if !defined(_WIN32)
+        int status = 0;
+        char* demangled = abi::__cxa_demangle( elfSymbol.m_Name.c_str(), nullptr, nullptr, &status );
+        elfSymbol.m_PrettyName = ( status == 0 && demangled ) ? demangled : elfSymbol.m_Name;
+        free( demangled );
+#else
+        elfSymbol.m_PrettyName = elfSymbol.m_Name;
+#endif
+
+        m_Symbols.push_back( std::move( elfSymbol ) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool ElfFile::LoadLineTables( bool a_Parallel )
+{
+    m_LineRows.clear();
+    m_LineFiles.clear();
+    m_NumLineUnits = 0;
+    m_NumFailedLineUnits = 0;
+
+    const Section* debugLine = FindSection( ".debug_line" );
+    if( debugLine == nullptr || debugLine->m_Size == 0 )
+    {
+        return false;
+    }
+
+    if( debugLine->m_Flags & Elf::SHF_COMPRESSED )
+    {
+        m_Error = "compressed .debug_line is not supported";
+        return false;
+    }
+
+    const char* data = m_File.GetData();
+    LineStrings strings = { nullptr, 0, nullptr, 0 };
+    if( const Section* lineStr = FindSection( ".debug_line_str" ) )
+    {
+        strings.m_LineStr = data + lineStr->m_Offset;
+        strings.m_LineStrSize = lineStr->m_Size;
+    }
+    if( const Section* str = FindSection( ".debug_str" ) )
+    {
+        strings.m_Str = data + str->m_Offset;
+        strings.m_StrSize = str->m_Size;
+    }
+
+    // Unit boundaries only need the length fields, the rest is parsed per unit
+    std::vector< LineUnit > units;
+    const uint8_t* begin = (const uint8_t*)data + debugLine->m_Offset;
+    const uint8_t* end = begin + debugLine->m_Size;
+    DwarfReader reader( begin, end );
+    while( reader.m_Pos < end )
+    {
+        const uint8_t* unitBegin = reader.m_Pos;
+        uint64_t length = reader.Read<uint32_t>();
+        if( length == 0xffffffff )
+            length = reader.Read<uint64_t>();
+        else if( length >= 0xfffffff0 )
+            break;
+
+        reader.Skip( length );
+        if( reader.m_Error )
+            break;
+
+        LineUnit unit;
+        unit.m_Begin = unitBegin;
+        unit.m_End = reader.m_Pos;
+        units.push_back( std::move( unit ) );
+    }
+
+    // Units are handed out one at a time, their sizes vary a lot
+    std::atomic<size_t> nextUnit( 0 );
+    std::atomic<uint32_t> numFailedUnits( 0 );
+    auto ParseUnits = [&]()
+    {
+        for( size_t i = nextUnit++; i < units.size(); i = nextUnit++ )
+        {
+            LineUnit & unit = units[i];
+            if( !ParseLineUnit( unit, strings, m_LoadBias ) )
+            {
+                unit.m_Rows.clear();
+                ++numFailedUnits;
+            }
+        }
+    };
+
+    size_t numThreads = a_Parallel ? std::min( (size_t)std::max( std::thread::hardware_concurrency(), 1u ), units.size() ) : 1;
+    std::vector< std::thread > threads;
+    for( size_t i = 1; i < numThreads; ++i )
+    {
+        threads.push_back( std::thread( ParseUnits ) );
+    }
+
+    ParseUnits();
+    for( std::thread & thread : threads )
+    {
+        thread.join();
+    }
+
+    // Merge, file names are shared between units
+    std::unordered_map< std::string, uint32_t > fileIndices;
+    size_t numRows = 0;
+    for( const LineUnit & unit : units )
+    {
+        numRows += unit.m_Rows.size();
+    }
+    m_LineRows.reserve( numRows );
+
+    for( LineUnit & unit : units )
+    {
+        std::vector< uint32_t > remap( unit.m_Files.size() );
+        for( size_t i = 0; i < unit.m_Files.size(); ++i )
+        {
+            auto result = fileIndices.insert( std::make_pair( unit.m_Files[i], (uint32_t)m_LineFiles.size() ) );
+            if( result.second )
+            {
+                m_LineFiles.push_back( unit.m_Files[i] );
+            }
+            remap[i] = result.first->second;
+        }
+
+        for( LineRow row : unit.m_Rows )
+        {
+            if( row.m_File >= remap.size() )
+                continue;
+            row.m_File = remap[row.m_File];
+            m_LineRows.push_back( row );
+        }
+    }
+
+    // Several rows can share an address, keep the last one of the program
+    // like addr2line does. A sequence starting where another one ends wins.
+    std::stable_sort( m_LineRows.begin(), m_LineRows.end(), []( const LineRow & a, const LineRow & b )
+    {
+        return a.m_Rva != b.m_Rva ? a.m_Rva < b.m_Rva : ( a.m_Line == 0 && b.m_Line != 0 );
+    } );
+
+    size_t numUnique = 0;
+    for( size_t i = 0; i < m_LineRows.size(); ++i )
+    {
+        if( numUnique > 0 && m_LineRows[numUnique - 1].m_Rva == m_LineRows[i].m_Rva )
+            --numUnique;
+        m_LineRows[numUnique++] = m_LineRows[i];
+    }
+    m_LineRows.resize( numUnique );
+
+    m_NumLineUnits = (uint32_t)units.size();
+    m_NumFailedLineUnits = numFailedUnits;
+    return !m_LineRows.empty();
+}
+
+//-----------------------------------------------------------------------------
+bool ElfFile::FindLine( uint64_t a_Rva, std::string & o_File, uint32_t & o_Line ) const
+{
+    auto it = std::upper_bound( m_LineRows.begin(), m_LineRows.end(), a_Rva, []( uint64_t a_Value, const LineRow & a_Row )
+    {
+        return a_Value < a_Row.m_Rva;
+    } );
+
+    if( it == m_LineRows.begin() )
+    {
+        return false;
+    }
+
+    --it;
+    if( it->m_Line == 0 )
+    {
+        // Between sequences
+        return false;
+    }
+
+    o_File = m_LineFiles[it->m_File];
+    o_Line = it->m_Line;
+    return true;
+}
@@ -0,0 +1,82 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+struct ElfSymbol
+{
+    uint64_t    m_Rva;
+    uint64_t    m_Size;
+    std::string m_Name;
+    std::string m_PrettyName;
+};
+
+//-----------------------------------------------------------------------------
+// Native symbol backend for ELF modules. Function symbols come from .symtab,
+// or .dynsym for stripped binaries, and line tables from DWARF .debug_line.
+// Everything is read straight from a read-only mapping of the file and only
+// depends on the standard library, see CMakeLists.txt for the Linux build.
+// Addresses are relative to the first PT_LOAD segment, the same way Pdb
+// functions are relative to the module base.
+class ElfFile
+{
+public:
+    ElfFile();
+    ~ElfFile();
+
+    static bool IsElf( const char* a_Data, uint64_t a_Size );
+
+    bool Open( const std::wstring & a_FileName );
+    bool LoadSymbols();
+
+    // Compilation units are parsed on all cores unless a_Parallel is false,
+    // which callers already running on a worker should pass.
+    bool LoadLineTables( bool a_Parallel );
+
+    const std::vector< ElfSymbol > & GetSymbols() const { return m_Symbols; }
+    const std::string & GetError() const { return m_Error; }
+    size_t   GetNumLineRows() const { return m_LineRows.size(); }
+    uint32_t GetNumLineUnits() const { return m_NumLineUnits; }
+    uint32_t GetNumFailedLineUnits() const { return m_NumFailedLineUnits; }
+    bool   FindLine( uint64_t a_Rva, std::string & o_File, uint32_t & o_Line ) const;
+
+    struct Section
+    {
+        std::string m_Name;
+        uint32_t    m_Type;
+        uint64_t    m_Flags;
+        uint64_t    m_Offset;
+        uint64_t    m_Size;
+        uint32_t    m_Link;
+        uint64_t    m_EntrySize;
+    };
+
+    struct LineRow
+    {
+        uint64_t m_Rva;
+        uint32_t m_File;
+        uint32_t m_Line;   // 0 marks the end of a sequence
+    };
+
+protected:
+    const Section* FindSection( const char* a_Name ) const;
+    const Section* FindSection( uint32_t a_Type ) const;
+    void LoadSymbolTable( const Section & a_SymbolTable );
+
+protected:
+    MappedFile                  m_File;
+    std::vector< Section >      m_Sections;
+    uint64_t                    m_LoadBias;
+    std::vector< ElfSymbol >    m_Symbols;
+    std::vector< LineRow >      m_LineRows;
+    std::vector< std::string >  m_LineFiles;
+    uint32_t                    m_NumLineUnits;
+    uint32_t                    m_NumFailedLineUnits;
+    std::string                 m_Error;    // Why the last call failed, if known
+};
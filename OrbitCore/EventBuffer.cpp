@@ -4,62 +4,230 @@
 
 #include "EventBuffer.h"
 #include "Serialization.h"
+#include <algorithm>
 
 //-----------------------------------------------------------------------------
-void EventBuffer::Print()
+void CallstackEventShard::Add( const CallstackEvent & a_Event )
 {
-    PRINT("Orbit Callstack Events:");
+    // Run starts are published before the event so that readers never see an
+    // event without the run it belongs to.
+    size_t index = m_Events.Size();
+    if( index == 0 || a_Event.m_Time < m_LastTime )
+    {
+        m_RunStarts.push_back( index );
+    }
+
+    m_Events.push_back( a_Event );
+    m_LastTime = a_Event.m_Time;
+}
+
+//-----------------------------------------------------------------------------
+void CallstackEventShard::GetSpans( long long a_TimeBegin, long long a_TimeEnd, std::vector< CallstackEventSpan > & o_Spans ) const
+{
+    // Events first, runs appended afterwards start at or past numEvents
+    size_t numEvents = m_Events.Size();
+    size_t numRuns = m_RunStarts.Size();
+
+    auto timeLess = []( const CallstackEvent & a_Event, long long a_Time ){ return a_Event.m_Time < a_Time; };
+
+    for( size_t run = 0; run < numRuns; ++run )
+    {
+        size_t runBegin = m_RunStarts[run];
+        size_t runEnd = run + 1 < numRuns ? m_RunStarts[run + 1] : numEvents;
+        runEnd = std::min( runEnd, numEvents );
+
+        for( uint32_t segment = AppendBuffer< CallstackEvent >::GetSegmentIndex( runBegin ); runBegin < runEnd; ++segment )
+        {
+            size_t segmentStart = AppendBuffer< CallstackEvent >::GetSegmentStart( segment );
+            size_t segmentEnd = segmentStart + AppendBuffer< CallstackEvent >::GetSegmentSize( segment );
+            size_t end = std::min( runEnd, segmentEnd );
+
+            const CallstackEvent* data = m_Events.GetSegment( segment );
+            const CallstackEvent* first = data + ( runBegin - segmentStart );
+            const CallstackEvent* last = data + ( end - segmentStart );
+            runBegin = end;
+
+            if( ( last - 1 )->m_Time < a_TimeBegin )
+                continue;
+            if( first->m_Time >= a_TimeEnd )
+                break;
+
+            CallstackEventSpan span;
+            span.m_ThreadId = m_ThreadId;
+            span.m_Begin = std::lower_bound( first, last, a_TimeBegin, timeLess );
+            span.m_End = std::lower_bound( span.m_Begin, last, a_TimeEnd, timeLess );
+            if( span.m_Begin != span.m_End )
+            {
+                o_Spans.push_back( span );
+            }
+        }
+    }
+}
 
-    size_t numCallstacks = 0;
-    for( auto & pair : m_CallstackEvents )
+//-----------------------------------------------------------------------------
+CallstackEventShard* EventBuffer::GetShard( ThreadID a_ThreadId )
+{
+    if( m_LastShard && m_LastShard->GetThreadId() == a_ThreadId )
+    {
+        return m_LastShard;
+    }
+
+    CallstackEventShard* & shard = m_ShardMap[a_ThreadId];
+    if( shard == nullptr )
+    {
+        shard = new CallstackEventShard( a_ThreadId );
+        m_Shards.push_back( shard );
+    }
+
+    m_LastShard = shard;
+    return shard;
+}
+
+//-----------------------------------------------------------------------------
+void EventBuffer::AddCallstackEvent( const CallstackEvent & a_Event )
+{
+    GetShard( a_Event.m_TID )->Add( a_Event );
+    RegisterTime( a_Event.m_Time );
+    m_NumEvents.fetch_add( 1, std::memory_order_release );
+}
+
+//-----------------------------------------------------------------------------
+void EventBuffer::Reset()
+{
+    for( size_t i = 0; i < m_Shards.Size(); ++i )
     {
-        ThreadID threadID = pair.first;
-        std::map< long long, CallstackEvent > & callstacks = pair.second;
-        numCallstacks += callstacks.size();
+        delete m_Shards[i];
     }
 
+    m_Shards.clear();
+    m_ShardMap.clear();
+    m_LastShard = nullptr;
+    m_NumEvents = 0;
+    m_MinTime = LLONG_MAX;
+    m_MaxTime = 0;
+}
+
+//-----------------------------------------------------------------------------
+void EventBuffer::Print()
+{
+    PRINT("Orbit Callstack Events:");
+
+    size_t numCallstacks = m_NumEvents;
     PRINT_VAR( numCallstacks );
 
-    for( auto & pair : m_CallstackEvents )
+    for( size_t i = 0; i < m_Shards.Size(); ++i )
     {
-        ThreadID threadID = pair.first;
-        std::map< long long, CallstackEvent > & callstacks = pair.second;
+        const CallstackEventShard* shard = m_Shards[i];
+        ThreadID threadID = shard->GetThreadId();
+        size_t numEvents = shard->Size();
+        size_t numRuns = shard->NumRuns();
         PRINT_VAR( threadID );
-        PRINT_VAR( callstacks.size() );
+        PRINT_VAR( numEvents );
+        PRINT_VAR( numRuns );
+    }
+}
+
+//-----------------------------------------------------------------------------
+void EventBuffer::GetCallstackEventSpans( long long a_TimeBegin
+                                        , long long a_TimeEnd
+                                        , std::vector< CallstackEventSpan > & o_Spans
+                                        , ThreadID a_ThreadId /*=-1*/ ) const
+{
+    size_t numShards = m_Shards.Size();
+    for( size_t i = 0; i < numShards; ++i )
+    {
+        const CallstackEventShard* shard = m_Shards[i];
+        if( a_ThreadId == -1 || shard->GetThreadId() == a_ThreadId )
+        {
+            shard->GetSpans( a_TimeBegin, a_TimeEnd, o_Spans );
+        }
     }
 }
 
 //-----------------------------------------------------------------------------
 std::vector< CallstackEvent > EventBuffer::GetCallstackEvents( long long a_TimeBegin
                                                              , long long a_TimeEnd
-                                                             , ThreadID a_ThreadId /*=-1*/)
+                                                             , ThreadID a_ThreadId /*=-1*/) const
 {
+    std::vector< CallstackEventSpan > spans;
+    GetCallstackEventSpans( a_TimeBegin, a_TimeEnd, spans, a_ThreadId );
+
+    size_t numEvents = 0;
+    for( const CallstackEventSpan & span : spans )
+    {
+        numEvents += span.size();
+    }
+
     std::vector< CallstackEvent > callstackEvents;
-    for( auto & pair : m_CallstackEvents )
+    callstackEvents.reserve( numEvents );
+    for( const CallstackEventSpan & span : spans )
     {
-        ThreadID threadID = pair.first;
-        std::map< long long, CallstackEvent > & callstacks = pair.second;
+        callstackEvents.insert( callstackEvents.end(), span.begin(), span.end() );
+    }
 
-        if( a_ThreadId == -1 || threadID == a_ThreadId )
+    // Spans are sorted, only late runs and other threads need merging
+    if( spans.size() > 1 )
+    {
+        std::stable_sort( callstackEvents.begin(), callstackEvents.end(), []( const CallstackEvent & a, const CallstackEvent & b )
         {
-            for( auto it = callstacks.lower_bound( a_TimeBegin ); it != callstacks.end(); ++it )
-            {
-                long long time = it->first;
-                if( time < a_TimeEnd )
-                {
-                    callstackEvents.push_back( it->second );
-                }
-            }
-        }
+            return a.m_Time < b.m_Time;
+        } );
     }
 
     return callstackEvents;
 }
 
 //-----------------------------------------------------------------------------
-ORBIT_SERIALIZE( EventBuffer, 0 )
+void EventBuffer::GetNumEventsPerThread( std::map< ThreadID, uint32_t > & o_NumEvents ) const
+{
+    size_t numShards = m_Shards.Size();
+    for( size_t i = 0; i < numShards; ++i )
+    {
+        const CallstackEventShard* shard = m_Shards[i];
+        o_NumEvents[shard->GetThreadId()] = (uint32_t)shard->Size();
+    }
+}
+
+//-----------------------------------------------------------------------------
+ORBIT_SERIALIZE( EventBuffer, 1 )
 {
-    ORBIT_NVP_VAL( 0, m_CallstackEvents );
+    const bool isLoading = std::is_base_of< cereal::detail::InputArchiveBase, Archive >::value;
+    if( isLoading )
+    {
+        Reset();
+    }
+
+    if( a_Version == 0 )
+    {
+        // Captures saved before events were sharded per thread
+        std::map< ThreadID, std::map< long long, CallstackEvent > > callstackEvents;
+        ORBIT_NVP_VAL( 0, callstackEvents );
+        for( auto & pair : callstackEvents )
+        {
+            for( auto & eventPair : pair.second )
+            {
+                AddCallstackEvent( eventPair.second );
+            }
+        }
+    }
+    else
+    {
+        std::vector< CallstackEvent > callstackEvents;
+        if( !isLoading )
+        {
+            callstackEvents = GetCallstackEvents( LLONG_MIN, LLONG_MAX );
+        }
+
+        ORBIT_NVP_VAL( 1, callstackEvents );
+
+        if( isLoading )
+        {
+            for( const CallstackEvent & event : callstackEvents )
+            {
+                AddCallstackEvent( event );
+            }
+        }
+    }
 
     long long maxTime = m_MaxTime;
     ORBIT_NVP_VAL( 0, maxTime );
@@ -76,4 +244,4 @@ ORBIT_SERIALIZE( CallstackEvent, 0 )
     ORBIT_NVP_VAL( 0, m_Time );
     ORBIT_NVP_VAL( 0, m_Id );
     ORBIT_NVP_VAL( 0, m_TID );
-}
\ No newline at end of file
+}
@@ -9,6 +9,7 @@
 #include "SerializationMacros.h"
 
 #include <set>
+#include <unordered_map>
 
 //-----------------------------------------------------------------------------
 struct CallstackEvent
@@ -22,20 +23,164 @@ struct CallstackEvent
 };
 
 //-----------------------------------------------------------------------------
+// Events of one thread sorted by time
+struct CallstackEventSpan
+{
+    const CallstackEvent* begin() const { return m_Begin; }
+    const CallstackEvent* end() const   { return m_End; }
+    size_t size() const                 { return m_End - m_Begin; }
+
+    ThreadID              m_ThreadId;
+    const CallstackEvent* m_Begin;
+    const CallstackEvent* m_End;
+};
+
+//-----------------------------------------------------------------------------
+// Single producer, multiple readers append only array. Segments double in
+// size and are never moved, readers only look at the first Size() elements
+// which are published with release semantics.
+template < class T > class AppendBuffer
+{
+public:
+    static const uint32_t NUM_SEGMENTS = 32;
+    static const size_t   FIRST_SEGMENT_SIZE = 1024;
+
+    AppendBuffer() : m_Size(0), m_WriteSegment(0), m_WriteIndex(0)
+    {
+        for( std::atomic<T*> & segment : m_Segments )
+            segment = nullptr;
+    }
+
+    ~AppendBuffer()
+    {
+        clear();
+    }
+
+    //-----------------------------------------------------------------------------
+    // Not thread safe
+    void clear()
+    {
+        for( std::atomic<T*> & segment : m_Segments )
+        {
+            delete[] segment.load();
+            segment = nullptr;
+        }
+
+        m_Size = 0;
+        m_WriteSegment = 0;
+        m_WriteIndex = 0;
+    }
+
+    //-----------------------------------------------------------------------------
+    static size_t GetSegmentSize( uint32_t a_Segment )
+    {
+        return a_Segment == 0 ? FIRST_SEGMENT_SIZE : FIRST_SEGMENT_SIZE << ( a_Segment - 1 );
+    }
+
+    //-----------------------------------------------------------------------------
+    static size_t GetSegmentStart( uint32_t a_Segment )
+    {
+        return a_Segment == 0 ? 0 : FIRST_SEGMENT_SIZE << ( a_Segment - 1 );
+    }
+
+    //-----------------------------------------------------------------------------
+    static uint32_t GetSegmentIndex( size_t a_Index )
+    {
+        uint32_t segment = 0;
+        while( a_Index >= GetSegmentStart( segment + 1 ) )
+            ++segment;
+        return segment;
+    }
+
+    //-----------------------------------------------------------------------------
+    void push_back( const T & a_Item )
+    {
+        if( m_WriteIndex == GetSegmentSize( m_WriteSegment ) )
+        {
+            ++m_WriteSegment;
+            m_WriteIndex = 0;
+            assert( m_WriteSegment < NUM_SEGMENTS );
+        }
+
+        T* segment = m_Segments[m_WriteSegment].load( std::memory_order_relaxed );
+        if( segment == nullptr )
+        {
+            segment = new T[GetSegmentSize( m_WriteSegment )];
+            m_Segments[m_WriteSegment].store( segment, std::memory_order_relaxed );
+        }
+
+        segment[m_WriteIndex++] = a_Item;
+        m_Size.store( m_Size.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    }
+
+    //-----------------------------------------------------------------------------
+    // Only valid for indices below a Size() loaded by the same thread
+    const T* GetSegment( uint32_t a_Segment ) const { return m_Segments[a_Segment].load( std::memory_order_relaxed ); }
+    size_t   Size() const                           { return m_Size.load( std::memory_order_acquire ); }
+
+    //-----------------------------------------------------------------------------
+    const T & operator[]( size_t a_Index ) const
+    {
+        uint32_t segment = GetSegmentIndex( a_Index );
+        return GetSegment( segment )[a_Index - GetSegmentStart( segment )];
+    }
+
+protected:
+    std::atomic<T*>     m_Segments[NUM_SEGMENTS];
+    std::atomic<size_t> m_Size;
+
+    // Writer only
+    uint32_t            m_WriteSegment;
+    size_t              m_WriteIndex;
+};
+
+//-----------------------------------------------------------------------------
+// Callstack events of one thread. Events are appended as they arrive, a late
+// event starts a new sorted run rather than being inserted, so the writer
+// never moves published events and never blocks readers.
+class CallstackEventShard
+{
+public:
+    CallstackEventShard( ThreadID a_ThreadId ) : m_ThreadId( a_ThreadId ), m_LastTime( LLONG_MIN ) {}
+
+    void     Add( const CallstackEvent & a_Event );
+    ThreadID GetThreadId() const { return m_ThreadId; }
+    size_t   Size() const        { return m_Events.Size(); }
+    size_t   NumRuns() const     { return m_RunStarts.Size(); }
+
+    // Appends one span per sorted run and segment holding events in [a_TimeBegin, a_TimeEnd)
+    void GetSpans( long long a_TimeBegin, long long a_TimeEnd, std::vector< CallstackEventSpan > & o_Spans ) const;
+
+protected:
+    ThreadID                        m_ThreadId;
+    AppendBuffer< CallstackEvent >  m_Events;
+    AppendBuffer< size_t >          m_RunStarts;
+    long long                       m_LastTime;
+};
+
+//-----------------------------------------------------------------------------
+// Sampled callstacks sharded per thread. AddCallstackEvent is called from the
+// tracing session's event thread only and is lock free, readers can query
+// concurrently from any thread. Reset must not race with readers or writer.
 class EventBuffer
 {
 public:
-    EventBuffer() : m_MaxTime(0), m_MinTime(LLONG_MAX){}
-    ~EventBuffer(){}
+    EventBuffer() : m_MaxTime(0), m_MinTime(LLONG_MAX), m_NumEvents(0), m_LastShard(nullptr){}
+    ~EventBuffer(){ Reset(); }
 
     void Print();
-    void Reset(){ m_CallstackEvents.clear(); m_MinTime = LLONG_MAX; m_MaxTime = 0; }
-    std::map< ThreadID, std::map< long long, CallstackEvent > > & GetCallstacks(){ return m_CallstackEvents; }
-    Mutex & GetMutex(){ return m_Mutex; }
-    std::vector< CallstackEvent > GetCallstackEvents( long long a_TimeBegin, long long a_TimeEnd, ThreadID a_ThreadId = -1 );
+    void Reset();
+
+    // Spans stay valid until Reset, events are sorted within a span only
+    void GetCallstackEventSpans( long long a_TimeBegin, long long a_TimeEnd, std::vector< CallstackEventSpan > & o_Spans, ThreadID a_ThreadId = -1 ) const;
+
+    // Copy of the events in [a_TimeBegin, a_TimeEnd) merged by time
+    std::vector< CallstackEvent > GetCallstackEvents( long long a_TimeBegin, long long a_TimeEnd, ThreadID a_ThreadId = -1 ) const;
+    void GetNumEventsPerThread( std::map< ThreadID, uint32_t > & o_NumEvents ) const;
+
     long long GetMaxTime() const { return m_MaxTime; }
     long long GetMinTime() const { return m_MinTime; }
-    bool HasEvent() { ScopeLock lock( m_Mutex ); return m_CallstackEvents.size() > 0; }
+    bool HasEvent() const { return m_NumEvents > 0; }
 
     //-----------------------------------------------------------------------------
     void RegisterTime( long long a_Time )
@@ -49,17 +194,23 @@ public:
     //-----------------------------------------------------------------------------
     void AddCallstackEvent( long long a_Time, CallStack & a_CallStack )
     {
-        ScopeLock lock( m_Mutex );
-        std::map< long long, CallstackEvent > & threadMap = m_CallstackEvents[ a_CallStack.m_ThreadId ];
-        threadMap[a_Time] = CallstackEvent( a_Time, a_CallStack.Hash(), a_CallStack.m_ThreadId );
-        RegisterTime( a_Time );
+        AddCallstackEvent( CallstackEvent( a_Time, a_CallStack.Hash(), a_CallStack.m_ThreadId ) );
     }
 
+    void AddCallstackEvent( const CallstackEvent & a_Event );
+
     ORBIT_SERIALIZABLE;
 
 private:
-    Mutex m_Mutex;
-    std::map< ThreadID, std::map< long long, CallstackEvent > > m_CallstackEvents;
-    std::atomic<long long> m_MaxTime;
-    std::atomic<long long> m_MinTime;
-};
\ No newline at end of file
+    CallstackEventShard* GetShard( ThreadID a_ThreadId );
+
+private:
+    AppendBuffer< CallstackEventShard* >                 m_Shards;
+    std::atomic<long long>                               m_MaxTime;
+    std::atomic<long long>                               m_MinTime;
+    std::atomic<size_t>                                  m_NumEvents;
+
+    // Writer only
+    std::unordered_map< ThreadID, CallstackEventShard* > m_ShardMap;
+    CallstackEventShard*                                 m_LastShard;
+};
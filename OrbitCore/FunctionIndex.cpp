@@ -0,0 +1,141 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Core.h"
+#include "FunctionIndex.h"
+#include "OrbitModule.h"
+#include "OrbitFunction.h"
+#include "Pdb.h"
+#include "ScopeTimer.h"
+#include <algorithm>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+struct FunctionLastHit
+{
+    uint32_t  m_Generation;
+    DWORD64   m_Start;
+    DWORD64   m_End;
+    Function* m_Function;
+};
+
+static std::atomic<uint32_t>        GFunctionIndexGeneration( 0 );
+static thread_local FunctionLastHit GFunctionLastHit = { 0, 0, 0, nullptr };
+
+//-----------------------------------------------------------------------------
+FunctionIndex::FunctionIndex() : m_Generation( ++GFunctionIndexGeneration )
+{
+}
+
+//-----------------------------------------------------------------------------
+void FunctionIndex::Build( const std::map< DWORD64, std::shared_ptr<Module> > & a_Modules )
+{
+    SCOPE_TIMER_LOG( L"FunctionIndex::Build" );
+
+    std::vector< Entry > entries;
+
+    for( auto & pair : a_Modules )
+    {
+        const std::shared_ptr<Module> & module = pair.second;
+        if( !module->m_Pdb || module->m_Pdb->IsLoading() )
+            continue;
+
+        DWORD64 base = (DWORD64)module->m_Pdb->GetHModule();
+        for( Function & function : module->m_Pdb->GetFunctions() )
+        {
+            Entry entry;
+            entry.m_Start = base + function.m_Address;
+            entry.m_ModuleEnd = module->m_AddressEnd;
+            entry.m_Function = &function;
+            entries.push_back( entry );
+        }
+    }
+
+    Build( entries );
+}
+
+//-----------------------------------------------------------------------------
+void FunctionIndex::Build( std::vector< Entry > & a_Entries )
+{
+    // Stable so that the first function at an address wins, like std::map::insert
+    std::stable_sort( a_Entries.begin(), a_Entries.end(), []( const Entry & a, const Entry & b )
+    {
+        return a.m_Start < b.m_Start;
+    } );
+
+    m_Starts.clear();
+    m_Ends.clear();
+    m_Functions.clear();
+    m_Starts.reserve( a_Entries.size() );
+    m_Ends.reserve( a_Entries.size() );
+    m_Functions.reserve( a_Entries.size() );
+
+    for( size_t i = 0; i < a_Entries.size(); ++i )
+    {
+        if( i > 0 && a_Entries[i].m_Start == a_Entries[i-1].m_Start )
+            continue;
+
+        DWORD64 end = a_Entries[i].m_ModuleEnd;
+        if( i + 1 < a_Entries.size() )
+        {
+            end = std::min( end, a_Entries[i+1].m_Start );
+        }
+
+        m_Starts.push_back( a_Entries[i].m_Start );
+        m_Ends.push_back( end );
+        m_Functions.push_back( a_Entries[i].m_Function );
+    }
+}
+
+//-----------------------------------------------------------------------------
+Function* FunctionIndex::FindExact( DWORD64 a_Address ) const
+{
+    FunctionLastHit & lastHit = GFunctionLastHit;
+    if( lastHit.m_Generation == m_Generation && lastHit.m_Start == a_Address )
+    {
+        return lastHit.m_Function;
+    }
+
+    auto it = std::lower_bound( m_Starts.begin(), m_Starts.end(), a_Address );
+    if( it == m_Starts.end() || *it != a_Address )
+    {
+        return nullptr;
+    }
+
+    size_t index = it - m_Starts.begin();
+    lastHit.m_Generation = m_Generation;
+    lastHit.m_Start = m_Starts[index];
+    lastHit.m_End = m_Ends[index];
+    lastHit.m_Function = m_Functions[index];
+    return lastHit.m_Function;
+}
+
+//-----------------------------------------------------------------------------
+Function* FunctionIndex::FindProgramCounter( DWORD64 a_Address ) const
+{
+    FunctionLastHit & lastHit = GFunctionLastHit;
+    if( lastHit.m_Generation == m_Generation && a_Address >= lastHit.m_Start && a_Address < lastHit.m_End )
+    {
+        return lastHit.m_Function;
+    }
+
+    auto it = std::upper_bound( m_Starts.begin(), m_Starts.end(), a_Address );
+    if( it == m_Starts.begin() )
+    {
+        return nullptr;
+    }
+
+    size_t index = ( it - m_Starts.begin() ) - 1;
+    if( a_Address >= m_Ends[index] )
+    {
+        // Past the end of the module of the closest function
+        return nullptr;
+    }
+
+    lastHit.m_Generation = m_Generation;
+    lastHit.m_Start = m_Starts[index];
+    lastHit.m_End = m_Ends[index];
+    lastHit.m_Function = m_Functions[index];
+    return lastHit.m_Function;
+}
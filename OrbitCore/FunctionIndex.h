@@ -0,0 +1,43 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "BaseTypes.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+class Function;
+struct Module;
+
+//-----------------------------------------------------------------------------
+// Flat, immutable address to function index over all loaded modules.
+// Function start addresses are kept in one sorted array for binary search,
+// and each calling thread remembers its last hit, as consecutive lookups
+// usually land in the same function.
+class FunctionIndex
+{
+public:
+    FunctionIndex();
+
+    struct Entry
+    {
+        DWORD64   m_Start;
+        DWORD64   m_ModuleEnd;
+        Function* m_Function;
+    };
+
+    void Build( const std::map< DWORD64, std::shared_ptr<Module> > & a_Modules );
+    void Build( std::vector< Entry > & a_Entries );
+
+    Function* FindExact( DWORD64 a_Address ) const;
+    Function* FindProgramCounter( DWORD64 a_Address ) const;
+    size_t    Size() const { return m_Starts.size(); }
+
+protected:
+    std::vector< DWORD64 >   m_Starts;
+    std::vector< DWORD64 >   m_Ends;      // Next function start or module end
+    std::vector< Function* > m_Functions;
+    uint32_t                 m_Generation;
+};
@@ -12,6 +12,8 @@
 #include "Message.h"
 #include "OrbitType.h"
 #include "TimerManager.h"
+#include "ConcurrentHashSet.h"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <unordered_set>
@@ -22,6 +24,10 @@
 #include "../external/minhook/src/trampoline.h"
 
 const unsigned int MAX_DEPTH = 64;
+const size_t ARG_RECORD_BUFFER_SIZE = 64 * 1024;
+const double ARG_RECORD_FLUSH_MICROS = 16000.0;
+
+typedef std::unordered_map< ULONG64, FunctionArgInfo > FunctionArgsMap;
 
 //-----------------------------------------------------------------------------
 struct ContextScope
@@ -42,6 +48,47 @@ struct ContextScope
 #define SSE_SCOPE
 #endif
 
+//-----------------------------------------------------------------------------
+// Argument tracking records of one thread. The owning thread appends to it,
+// the TcpClient thread also flushes it when the capture stops, which is the
+// only time m_Mutex is contended. m_Data is allocated on the first record.
+struct ArgRecordBuffer
+{
+    ArgRecordBuffer() : m_Size( 0 )
+                      , m_NumRecords( 0 )
+                      , m_FlushTime( OrbitTicks() )
+                      , m_Thread( OpenThread( SYNCHRONIZE, FALSE, GetCurrentThreadId() ) ) {}
+    ~ArgRecordBuffer() { if( m_Thread ) CloseHandle( m_Thread ); }
+
+    // Called with m_Mutex held
+    void Flush()
+    {
+        if( m_NumRecords > 0 && GTcpClient )
+        {
+            Message msg( Msg_ArgRecords );
+            msg.m_Header.m_ArgRecordsHeader.m_NumRecords = m_NumRecords;
+            msg.m_Size = (int)m_Size;
+            GTcpClient->Send( msg, m_Data.data() );
+        }
+
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_Size = 0;
+        m_NumRecords = 0;
+        m_FlushTime = OrbitTicks();
+    }
+
+    Mutex             m_Mutex;
+    std::vector<char> m_Data;
+    size_t            m_Size;
+    int               m_NumRecords;
+    TickType          m_FlushTime;
+    HANDLE            m_Thread;
+};
+
 //-----------------------------------------------------------------------------
 struct ThreadLocalData
 {
@@ -50,34 +97,46 @@ struct ThreadLocalData
         m_Timers.reserve( MAX_DEPTH );
         m_ReturnAdresses.reserve( MAX_DEPTH );
         m_Contexts.reserve( MAX_DEPTH );
-        m_SentCallstacks.reserve( 1024 );
+        m_CallstacksByReturnAddresses.reserve( 1024 );
         m_SessionID = -1;
         m_ThreadID = GetCurrentThreadId();
         m_ZoneStack = 0;
+        m_TimerBuffer = GTimerManager ? GTimerManager->CreateThreadBuffer() : nullptr;
+        m_ArgRecords = nullptr;
     }
 
     __forceinline void CheckSessionId()
     {
         if( m_SessionID != Message::GSessionID )
         {
-            m_SentCallstacks.clear();
+            m_CallstacksByReturnAddresses.clear();
             m_SentLiterals.clear();
             m_SentActorNames.clear();
             m_SessionID = Message::GSessionID;
             Timer::ClearThreadDepthTLS();
             m_ZoneStack = 0;
+
+            if( m_ArgRecords )
+            {
+                ScopeLock lock( m_ArgRecords->m_Mutex );
+                m_ArgRecords->Reset();
+            }
         }
     }
 
     std::vector<ReturnAddress>      m_ReturnAdresses;
     std::vector<Timer>              m_Timers;
     std::vector<const Context*>     m_Contexts;
-    std::unordered_set<CallstackID> m_SentCallstacks;
+    std::unordered_map<DWORD64, CallstackID> m_CallstacksByReturnAddresses;
     std::unordered_set<char*>       m_SentLiterals;
     std::unordered_set<char*>       m_SentActorNames;
     int                             m_SessionID;
     DWORD                           m_ThreadID;
     int                             m_ZoneStack;
+    TimerManager::TimerBuffer*      m_TimerBuffer;
+
+    // Argument tracking records, created on the first tracked call
+    ArgRecordBuffer*                m_ArgRecords;
 };
 
 //-----------------------------------------------------------------------------
@@ -100,10 +159,11 @@ namespace Hijacking
     void* EpilogAlloc();
 
     __forceinline CallstackID SendCallstack( void* a_OriginalFunctionAddress, void** a_ReturnAddressLocation );
+    __forceinline DWORD64 GetReturnAddressHash( void* a_OriginalFunctionAddress );
     __forceinline void PushReturnAddress( void** a_ReturnAddress );
     __forceinline void PopReturnAddress();
     __forceinline void* GetReturnAddress();
-    __forceinline FunctionArgInfo* GetArgInfo( void* a_Address );
+    __forceinline const FunctionArgInfo* GetArgInfo( const FunctionArgsMap & a_ArgsMap, void* a_Address );
 
     thread_local ThreadLocalData* TlsData;
 
@@ -111,13 +171,35 @@ namespace Hijacking
     __forceinline void PushContext( const Context* a_Context, void* a_OriginalFunction );
     __forceinline void PushZoneContext( const Context* a_Context, void* a_OriginalFunction );
     __forceinline void PopContext();
-    __forceinline void SendContext( const Context* a_Context, EpilogContext* a_EpilogContext );
+    __forceinline void RecordArguments( void* a_OriginalFunction, const Context* a_Context );
+    __forceinline void ReadArgument( const Argument & a_Arg, const Context* a_Context, char* o_Data );
+    ArgRecordBuffer* CreateArgRecordBuffer();
     __forceinline void SetOriginalReturnAddresses();
     __forceinline void SetOverridenReturnAddresses();
     __forceinline void SendUObjectName( void* a_UnrealActor );
     
-    std::unordered_map< ULONG64, FunctionArgInfo > m_FunctionArgsMap;
+    // Prologs read the published map under their ArgRecordBuffer lock, it is
+    // never modified. The TcpClient thread edits the pending copy and publishes
+    // it once per batch of changes. Replaced maps are freed by
+    // FlushAllArgRecords, after it took every buffer lock once.
+    std::atomic<const FunctionArgsMap*>                  m_FunctionArgs( nullptr );
+    FunctionArgsMap                                      m_PendingFunctionArgs;
+    bool                                                 m_PendingFunctionArgsDirty = false;
+    std::vector< std::unique_ptr<const FunctionArgsMap> > m_RetiredFunctionArgs;
+
+    // Every thread's argument records, flushed together when the capture stops
+    Mutex                                                m_ArgRecordBuffersMutex;
+    std::vector< std::unique_ptr<ArgRecordBuffer> >      m_ArgRecordBuffers;
+
     std::unordered_set< ULONG64 >                  m_SendCallstacks;
+
+    // 16K slots, growing to 256K slots per table (~4MB in total). Past that, callstacks are
+    // simply sent again, the host dedups them by hash.
+    ConcurrentHashSet                              m_SentCallstacks( 14, 18 );
+    std::atomic<int>                               m_SentCallstacksSessionId( -1 );
+
+    // Written by the TcpClient thread, read by every hooked call
+    std::atomic<bool>                              m_HashReturnAddresses( false );
     OrbitUnrealInfo                                m_UnrealInfo;
     
     // On Win64, epilog context is at 40 bytes: 8 bytes (return address) + 32 bytes (shadow space)
@@ -132,23 +214,68 @@ namespace Hijacking
     HijackManager GHijackManager;
 }
 
+//-----------------------------------------------------------------------------
+__forceinline DWORD64 Hijacking::GetReturnAddressHash( void* a_OriginalFunctionAddress )
+{
+    // Call sites and stack locations of the hooked calls in flight on this
+    // thread. Unhooked frames in between are not seen, they are assumed to be
+    // the same when the hooked calls sit at the same stack depths.
+    DWORD64 hash = (DWORD64)a_OriginalFunctionAddress;
+    for( const ReturnAddress & ret : TlsData->m_ReturnAdresses )
+    {
+        hash = ( hash ^ (DWORD64)ret.m_OriginalReturnAddress ) * 0x9E3779B97F4A7C15ull;
+        hash = ( hash ^ (DWORD64)ret.m_AddressOfReturnAddress ) * 0x9E3779B97F4A7C15ull;
+    }
+
+    return hash ^ ( hash >> 32 );
+}
+
 //-----------------------------------------------------------------------------
 __forceinline CallstackID Hijacking::SendCallstack( void* a_OriginalFunctionAddress, void** a_ReturnAddressLocation )
 {
     /*bool needsCallstack = m_SendCallstacks.find( reinterpret_cast<ULONG64>( a_OriginalFunctionAddress ) ) != m_SendCallstacks.end();
     if( needsCallstack )*/
     {
+        // Skip the unwind entirely for a return address chain seen before
+        CallstackID* cachedHash = nullptr;
+        if( m_HashReturnAddresses.load( std::memory_order_relaxed ) )
+        {
+            cachedHash = &TlsData->m_CallstacksByReturnAddresses[GetReturnAddressHash( a_OriginalFunctionAddress )];
+            if( *cachedHash != 0 )
+            {
+                return *cachedHash;
+            }
+        }
+
         SetOriginalReturnAddresses();
         CallStackPOD cs = CallStackPOD::Walk( (DWORD64)a_OriginalFunctionAddress, (DWORD64)a_ReturnAddressLocation );
         SetOverridenReturnAddresses();
 
-        // Send callstack once (*per thread* for now, we should have a concurrent set or hashmap...)
-        if( TlsData->m_SentCallstacks.find( cs.m_Hash ) == TlsData->m_SentCallstacks.end() )
+        // Entries of previous sessions are recycled by the first thread to see a newer session.
+        // Session ids only grow, so a thread still on an older session never clears again.
+        // Keys are salted with the session so a stale entry can never suppress a send.
+        int sessionId = m_SentCallstacksSessionId;
+        while( sessionId < TlsData->m_SessionID )
+        {
+            if( m_SentCallstacksSessionId.compare_exchange_weak( sessionId, TlsData->m_SessionID ) )
+            {
+                m_SentCallstacks.Clear();
+                break;
+            }
+        }
+
+        // Send callstack once per session for the whole process
+        DWORD64 key = cs.m_Hash ^ ( (DWORD64)TlsData->m_SessionID * 0xC2B2AE3D27D4EB4Full );
+        if( m_SentCallstacks.Insert( key ) )
         {
-            TlsData->m_SentCallstacks.insert( cs.m_Hash );
             GTcpClient->Send( Msg_Callstack, (void*)&cs, cs.GetSizeInBytes() );
         }
 
+        if( cachedHash )
+        {
+            *cachedHash = cs.m_Hash;
+        }
+
         return cs.m_Hash;
     }
 
@@ -163,6 +290,7 @@ void Hijacking::Prolog( void* a_OriginalFunctionAddress, Context* a_Context, uns
 
     PushContext( a_Context, a_OriginalFunctionAddress );
     PushReturnAddress( &a_Context->m_RET.m_Ptr );
+    RecordArguments( a_OriginalFunctionAddress, a_Context );
 
     TlsData->m_Timers.push_back( Timer() );
     TlsData->m_Timers.back().m_FunctionAddress = reinterpret_cast<ULONG64>( a_OriginalFunctionAddress );
@@ -379,16 +507,11 @@ void* Hijacking::Epilog()
     timer.Stop();
     
     // Send timer
-    GTimerManager->Add( timer );
+    GTimerManager->Add( TlsData->m_TimerBuffer, timer );
 
     // Pop timer
     TlsData->m_Timers.pop_back();
 
-    // Get stack context
-    void * stackAddress = _AddressOfReturnAddress();
-    EpilogContext* epilogContext = (EpilogContext*)((char*)stackAddress + s_StackOffset );
-    
-    SendContext(TlsData->m_Contexts.back(), epilogContext);
     PopContext();
 
     void* ReturnAddress = TlsData->m_ReturnAdresses.back().m_OriginalReturnAddress;
@@ -443,7 +566,7 @@ void* Hijacking::EpilogZoneStop()
         }
 
         // Send timer
-        GTimerManager->Add( timer );
+        GTimerManager->Add( TlsData->m_TimerBuffer, timer );
 
         // Pop timer
         TlsData->m_Timers.pop_back();
@@ -481,12 +604,11 @@ void* Hijacking::EpilogAlloc()
     timer.m_Type = Timer::ALLOC;
 
     // Send timer
-    GTimerManager->Add( timer );
+    GTimerManager->Add( TlsData->m_TimerBuffer, timer );
 
     // Pop timer
     TlsData->m_Timers.pop_back();
 
-    SendContext( prologContext, epilogContext );
     PopContext();
 
     void* ReturnAddress = TlsData->m_ReturnAdresses.back().m_OriginalReturnAddress;
@@ -516,22 +638,16 @@ __forceinline void* Hijacking::GetReturnAddress()
 }
 
 //-----------------------------------------------------------------------------
-__forceinline FunctionArgInfo* Hijacking::GetArgInfo( void* a_Address )
+__forceinline const FunctionArgInfo* Hijacking::GetArgInfo( const FunctionArgsMap & a_ArgsMap, void* a_Address )
 {
-    auto it = m_FunctionArgsMap.find( (ULONG64)a_Address );
-    return it != m_FunctionArgsMap.end() ? &it->second : nullptr;
+    auto it = a_ArgsMap.find( (ULONG64)a_Address );
+    return it != a_ArgsMap.end() ? &it->second : nullptr;
 }
 
 //-----------------------------------------------------------------------------
 __forceinline void Hijacking::PushContext( const Context* a_Context, void* a_OriginalFunction )
 {
     TlsData->m_Contexts.push_back( a_Context );
-
-    // Note: disabled argument tracking in favor of better perf.  It required work anyway, will re-enable.
-    // FunctionArgInfo* argInfo = GetArgInfo( a_OriginalFunction );
-    // context->m_StackSize = argInfo ? argInfo->m_NumStackBytes : 0;
-    // memcpy( context, a_Context, Context::GetFixedDataSize() + context->m_StackSize );
-    // context->m_RET = (AddressType)a_OriginalFunction;
 }
 
 //-----------------------------------------------------------------------------
@@ -547,45 +663,152 @@ __forceinline void Hijacking::PopContext()
 }
 
 //-----------------------------------------------------------------------------
-inline void Hijacking::SendContext( const Context * a_Context, EpilogContext* a_EpilogContext )
+// Only the tracked bytes are recorded, in the prolog as the context lives on
+// the prolog's stack frame. Records are flushed when the buffer is full or
+// at the first tracked call after ARG_RECORD_FLUSH_MICROS. Records of threads
+// that stop calling tracked functions are sent by FlushAllArgRecords.
+__forceinline void Hijacking::RecordArguments( void* a_OriginalFunction, const Context* a_Context )
 {
-    return;
+    // Nothing tracked, the map itself can only be read under the buffer lock
+    if( !m_FunctionArgs.load( std::memory_order_relaxed ) )
+        return;
 
-    void* address = a_Context->GetRet();
-    FunctionArgInfo* argInfo = GetArgInfo( address );
-    size_t contextSize = sizeof(Context) + sizeof(EpilogContext);
-    size_t argDataSize = argInfo ? argInfo->m_ArgDataSize : 0;
-    std::vector<unsigned char> messageData( sizeof(SavedContext) + argDataSize );
-    
-    Message msg(Msg_SavedContext);
-    msg.m_Size = (int)messageData.size();
-    msg.m_Header.m_GenericHeader.m_Address = (ULONG64)address;
-    
-    // Contexts
-    size_t offset = 0;
-    memcpy( messageData.data(), a_Context, sizeof(Context) );
-    offset += sizeof(Context);
-    memcpy( messageData.data() + offset, a_EpilogContext, sizeof(EpilogContext) );
-    offset += sizeof(EpilogContext);
-
-    // Argument data
-    if( argInfo )
+    ThreadLocalData & tls = *TlsData;
+    if( !tls.m_ArgRecords )
     {
-        for( Argument & arg : argInfo->m_Args )
-        {
-            // TODO: Argument tracking was hijacked by data tracking
-            //       We should separate both concepts and revive argument
-            //       tracking.
-            void* This = a_Context->GetThis();
-            void* data = (void*)( (char*)This + arg.m_Offset );
-            memcpy( messageData.data() + offset, data, arg.m_NumBytes );
-            offset += arg.m_NumBytes;
-        }
+        tls.m_ArgRecords = CreateArgRecordBuffer();
+    }
+
+    ArgRecordBuffer & buffer = *tls.m_ArgRecords;
+    ScopeLock lock( buffer.m_Mutex );
+
+    const FunctionArgsMap* argsMap = m_FunctionArgs.load( std::memory_order_acquire );
+    if( !argsMap )
+        return;
+
+    const FunctionArgInfo* argInfo = GetArgInfo( *argsMap, a_OriginalFunction );
+    if( !argInfo )
+        return;
+
+    size_t recordSize = sizeof( ArgRecord ) + argInfo->m_ArgDataSize;
+    if( recordSize > ARG_RECORD_BUFFER_SIZE )
+        return;
+
+    // Members are read through "this", skip calls that don't have one
+    if( argInfo->m_ReadsThis && !a_Context->GetThis() )
+        return;
+
+    if( buffer.m_Data.empty() )
+    {
+        buffer.m_Data.resize( ARG_RECORD_BUFFER_SIZE );
+    }
+
+    if( buffer.m_Size + recordSize > ARG_RECORD_BUFFER_SIZE )
+    {
+        buffer.Flush();
+    }
+
+    ArgRecord record;
+    record.m_Function = (DWORD64)a_OriginalFunction;
+    record.m_Time = OrbitTicks();
+    record.m_ThreadId = tls.m_ThreadID;
+    record.m_DataSize = (DWORD)argInfo->m_ArgDataSize;
+
+    char* data = buffer.m_Data.data() + buffer.m_Size;
+    memcpy( data, &record, sizeof( record ) );
+    data += sizeof( record );
+
+    for( const Argument & arg : argInfo->m_Args )
+    {
+        ReadArgument( arg, a_Context, data );
+        data += arg.m_NumBytes;
+    }
+
+    buffer.m_Size += recordSize;
+    ++buffer.m_NumRecords;
+
+    if( MicroSecondsFromTicks( buffer.m_FlushTime, record.m_Time ) > ARG_RECORD_FLUSH_MICROS )
+    {
+        buffer.Flush();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Arguments without a register are member data at an offset from "this",
+// which RecordArguments checked for null. Register arguments read the integer
+// argument registers saved in the prolog context. Anything else is recorded
+// as zeros.
+__forceinline void Hijacking::ReadArgument( const Argument & a_Arg, const Context* a_Context, char* o_Data )
+{
+    const char* reg = nullptr;
+    size_t regSize = 0;
+
+    switch( a_Arg.m_Reg )
+    {
+    case CV_REG_NONE:
+        memcpy( o_Data, (char*)a_Context->GetThis() + a_Arg.m_Offset, a_Arg.m_NumBytes );
+        return;
+#ifdef _WIN64
+    case CV_AMD64_RCX: reg = (const char*)&a_Context->m_RCX; regSize = sizeof( IntReg ); break;
+    case CV_AMD64_RDX: reg = (const char*)&a_Context->m_RDX; regSize = sizeof( IntReg ); break;
+    case CV_AMD64_R8:  reg = (const char*)&a_Context->m_R8;  regSize = sizeof( IntReg ); break;
+    case CV_AMD64_R9:  reg = (const char*)&a_Context->m_R9;  regSize = sizeof( IntReg ); break;
+#else
+    case CV_REG_ECX:   reg = (const char*)&a_Context->m_ECX; regSize = sizeof( DWORD ); break;
+    case CV_REG_EDX:   reg = (const char*)&a_Context->m_EDX; regSize = sizeof( DWORD ); break;
+#endif
+    default: break;
+    }
+
+    if( reg && a_Arg.m_Offset + a_Arg.m_NumBytes <= regSize )
+    {
+        memcpy( o_Data, reg + a_Arg.m_Offset, a_Arg.m_NumBytes );
+    }
+    else
+    {
+        memset( o_Data, 0, a_Arg.m_NumBytes );
     }
+}
+
+//-----------------------------------------------------------------------------
+ArgRecordBuffer* Hijacking::CreateArgRecordBuffer()
+{
+    std::unique_ptr<ArgRecordBuffer> buffer = std::make_unique<ArgRecordBuffer>();
+    ArgRecordBuffer* argRecords = buffer.get();
+
+    ScopeLock lock( m_ArgRecordBuffersMutex );
+    m_ArgRecordBuffers.push_back( std::move( buffer ) );
+    return argRecords;
+}
+
+//-----------------------------------------------------------------------------
+void Hijacking::FlushAllArgRecords()
+{
+    // Prologs load the map under their buffer lock and buffers created
+    // meanwhile wait for m_ArgRecordBuffersMutex, so once every lock below
+    // was taken, no thread can still use a map replaced before this point.
+    std::vector< std::unique_ptr<const FunctionArgsMap> > retiredFunctionArgs;
+    retiredFunctionArgs.swap( m_RetiredFunctionArgs );
 
-    if ( GTimerManager )
+    ScopeLock lock( m_ArgRecordBuffersMutex );
+
+    for( size_t i = 0; i < m_ArgRecordBuffers.size(); )
     {
-        GTcpClient->Send(msg, (void*)messageData.data());
+        ArgRecordBuffer & buffer = *m_ArgRecordBuffers[i];
+        {
+            ScopeLock bufferLock( buffer.m_Mutex );
+            buffer.Flush();
+        }
+
+        // An exited thread can't record anymore, its flushed buffer is freed
+        if( buffer.m_Thread && WaitForSingleObject( buffer.m_Thread, 0 ) == WAIT_OBJECT_0 )
+        {
+            m_ArgRecordBuffers[i] = std::move( m_ArgRecordBuffers.back() );
+            m_ArgRecordBuffers.pop_back();
+            continue;
+        }
+
+        ++i;
     }
 }
 
@@ -752,14 +975,36 @@ bool Hijacking::ThawMainThread( OrbitWaitLoop * a_WaitLoop )
 //-----------------------------------------------------------------------------
 void Hijacking::ClearFunctionArguments()
 {
-    m_FunctionArgsMap.clear();
+    m_PendingFunctionArgs.clear();
+    m_PendingFunctionArgsDirty = true;
     m_SendCallstacks.clear();
+    PublishFunctionArguments();
 }
 
 //-----------------------------------------------------------------------------
 void Hijacking::SetFunctionArguments( ULONG64 a_FunctionAddress, const FunctionArgInfo & a_Args )
 {
-    m_FunctionArgsMap[a_FunctionAddress] = a_Args;
+    FunctionArgInfo & argInfo = m_PendingFunctionArgs[a_FunctionAddress];
+    argInfo = a_Args;
+    argInfo.m_ReadsThis = std::any_of( argInfo.m_Args.begin(), argInfo.m_Args.end(), []( const Argument & a_Arg ){ return a_Arg.m_Reg == CV_REG_NONE; } );
+    m_PendingFunctionArgsDirty = true;
+}
+
+//-----------------------------------------------------------------------------
+void Hijacking::PublishFunctionArguments()
+{
+    if( !m_PendingFunctionArgsDirty )
+        return;
+
+    m_PendingFunctionArgsDirty = false;
+
+    // An empty map is published as null so that Prologs skip the lookup
+    const FunctionArgsMap* argsMap = m_PendingFunctionArgs.empty() ? nullptr : new FunctionArgsMap( m_PendingFunctionArgs );
+    const FunctionArgsMap* previous = m_FunctionArgs.exchange( argsMap, std::memory_order_acq_rel );
+    if( previous )
+    {
+        m_RetiredFunctionArgs.emplace_back( previous );
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -768,6 +1013,12 @@ void Hijacking::TrackCallstack( ULONG64 a_FunctionAddress )
     m_SendCallstacks.insert( a_FunctionAddress );
 }
 
+//-----------------------------------------------------------------------------
+void Hijacking::SetHashReturnAddresses( bool a_Value )
+{
+    m_HashReturnAddresses.store( a_Value, std::memory_order_relaxed );
+}
+
 //-----------------------------------------------------------------------------
 void Hijacking::SetUnrealInfo( OrbitUnrealInfo & a_UnrealInfo )
 {
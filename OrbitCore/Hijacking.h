@@ -26,9 +26,19 @@ namespace Hijacking
     bool SuspendBusyLoopThread( OrbitWaitLoop* a_WaitLoop );
     bool ThawMainThread( OrbitWaitLoop* a_WaitLoop );
 
+    // Called from the TcpClient thread only. SetFunctionArguments changes are
+    // seen by hooked functions after the next PublishFunctionArguments.
     void ClearFunctionArguments();
     void SetFunctionArguments( ULONG64 a_FunctionAddress, const FunctionArgInfo & a_Args );
+    void PublishFunctionArguments();
     void TrackCallstack( ULONG64 a_FunctionAddress );
+
+    // Sends the argument records every thread still holds, also frees the
+    // replaced argument maps. Called from the TcpClient thread.
+    void FlushAllArgRecords();
+
+    // Reuse the callstack of a known chain of hooked return addresses instead of unwinding
+    void SetHashReturnAddresses( bool a_Value );
     void SetUnrealInfo( OrbitUnrealInfo & a_UnrealInfo );
 }
 
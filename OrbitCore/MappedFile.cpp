@@ -0,0 +1,149 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Platform.h"
+#include "MappedFile.h"
+
+#if !defined(_WIN32)
+#include <codecvt>
+#include <locale>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+//-----------------------------------------------------------------------------
+MappedFile::MappedFile() : m_File( INVALID_HANDLE_VALUE )
+                         , m_Mapping( nullptr )
+                         , m_Data( nullptr )
+                         , m_Size( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+bool MappedFile::Open( const std::wstring & a_FileName )
+{
+    Close();
+
+    m_File = ::CreateFileW( a_FileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL );
+    if( m_File == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if( !::GetFileSizeEx( m_File, &size ) || size.QuadPart == 0 || (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX )
+    {
+        // Empty files can't be mapped, 32 bit builds can't map more than the address space
+        Close();
+        return false;
+    }
+
+    m_Mapping = ::CreateFileMappingW( m_File, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( m_Mapping == nullptr )
+    {
+        Close();
+        return false;
+    }
+
+    m_Data = (const char*)::MapViewOfFile( m_Mapping, FILE_MAP_READ, 0, 0, 0 );
+    if( m_Data == nullptr )
+    {
+        Close();
+        return false;
+    }
+
+    m_Size = (uint64_t)size.QuadPart;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void MappedFile::Close()
+{
+    if( m_Data )
+    {
+        ::UnmapViewOfFile( m_Data );
+        m_Data = nullptr;
+    }
+
+    if( m_Mapping )
+    {
+        ::CloseHandle( m_Mapping );
+        m_Mapping = nullptr;
+    }
+
+    if( m_File != INVALID_HANDLE_VALUE )
+    {
+        ::CloseHandle( m_File );
+        m_File = INVALID_HANDLE_VALUE;
+    }
+
+    m_Size = 0;
+}
+
+#else
+//-----------------------------------------------------------------------------
+MappedFile::MappedFile() : m_File( -1 )
+                         , m_Data( nullptr )
+                         , m_Size( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+bool MappedFile::Open( const std::wstring & a_FileName )
+{
+    Close();
+
+    std::wstring_convert< std::codecvt_utf8<wchar_t> > converter;
+    m_File = ::open( converter.to_bytes( a_FileName ).c_str(), O_RDONLY );
+    if( m_File < 0 )
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if( ::fstat( m_File, &fileStat ) != 0 || fileStat.st_size == 0 || (uint64_t)fileStat.st_size > (uint64_t)SIZE_MAX )
+    {
+        Close();
+        return false;
+    }
+
+    void* data = ::mmap( nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, m_File, 0 );
+    if( data == MAP_FAILED )
+    {
+        Close();
+        return false;
+    }
+
+    m_Data = (const char*)data;
+    m_Size = (uint64_t)fileStat.st_size;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void MappedFile::Close()
+{
+    if( m_Data )
+    {
+        ::munmap( (void*)m_Data, (size_t)m_Size );
+        m_Data = nullptr;
+    }
+
+    if( m_File >= 0 )
+    {
+        ::close( m_File );
+        m_File = -1;
+    }
+
+    m_Size = 0;
+}
+#endif
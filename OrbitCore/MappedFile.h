@@ -0,0 +1,34 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Read-only view of a whole file, pages are faulted in by the OS on access.
+// Only depends on the platform headers so that it builds outside of Orbit.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open( const std::wstring & a_FileName );
+    void Close();
+
+    const char* GetData() const { return m_Data; }
+    uint64_t    GetSize() const { return m_Size; }
+    bool        IsOpen() const { return m_Data != nullptr; }
+
+protected:
+#if defined(_WIN32)
+    void*       m_File;     // HANDLE
+    void*       m_Mapping;  // HANDLE
+#else
+    int         m_File;
+#endif
+    const char* m_Data;
+    uint64_t    m_Size;
+};
@@ -9,11 +9,152 @@
 #include "Log.h"
 
 //-----------------------------------------------------------------------------
-MemoryTracker::MemoryTracker() : m_NumAllocatedBytes(0)
+static const size_t LIVE_ALLOCATION_TABLE_MIN_CAPACITY = 1024;
+
+//-----------------------------------------------------------------------------
+LiveAllocationTable::LiveAllocationTable()
+{
+    Clear();
+}
+
+//-----------------------------------------------------------------------------
+inline size_t LiveAllocationTable::GetSlot( DWORD64 a_Address ) const
+{
+    // Fibonacci hashing, allocations are aligned so the low bits carry no entropy
+    return (size_t)( ( a_Address * 0x9E3779B97F4A7C15ull ) >> m_Shift );
+}
+
+//-----------------------------------------------------------------------------
+bool LiveAllocationTable::Insert( const Entry & a_Entry, Entry & o_Previous )
+{
+    if( ( m_Size + 1 ) * 10 > m_Entries.size() * 7 )
+    {
+        Grow();
+    }
+
+    size_t slot = GetSlot( a_Entry.m_Address );
+    while( m_Entries[slot].m_Address != 0 )
+    {
+        if( m_Entries[slot].m_Address == a_Entry.m_Address )
+        {
+            // Missed the free, or realloc in place
+            o_Previous = m_Entries[slot];
+            m_Entries[slot] = a_Entry;
+            return true;
+        }
+
+        slot = ( slot + 1 ) & m_Mask;
+    }
+
+    m_Entries[slot] = a_Entry;
+    ++m_Size;
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool LiveAllocationTable::Remove( DWORD64 a_Address, Entry & o_Removed )
+{
+    size_t slot = GetSlot( a_Address );
+    while( m_Entries[slot].m_Address != a_Address )
+    {
+        if( m_Entries[slot].m_Address == 0 )
+        {
+            return false;
+        }
+
+        slot = ( slot + 1 ) & m_Mask;
+    }
+
+    o_Removed = m_Entries[slot];
+    --m_Size;
+
+    // Shift back following entries that would become unreachable
+    size_t hole = slot;
+    size_t next = ( hole + 1 ) & m_Mask;
+    while( m_Entries[next].m_Address != 0 )
+    {
+        size_t home = GetSlot( m_Entries[next].m_Address );
+        if( ( ( next - home ) & m_Mask ) >= ( ( next - hole ) & m_Mask ) )
+        {
+            m_Entries[hole] = m_Entries[next];
+            hole = next;
+        }
+
+        next = ( next + 1 ) & m_Mask;
+    }
+
+    m_Entries[hole].m_Address = 0;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void LiveAllocationTable::Grow()
+{
+    std::vector< Entry > entries( m_Entries.size() * 2 );
+    entries.swap( m_Entries );
+    m_Mask = m_Entries.size() - 1;
+    --m_Shift;
+
+    for( const Entry & entry : entries )
+    {
+        if( entry.m_Address != 0 )
+        {
+            size_t slot = GetSlot( entry.m_Address );
+            while( m_Entries[slot].m_Address != 0 )
+            {
+                slot = ( slot + 1 ) & m_Mask;
+            }
+
+            m_Entries[slot] = entry;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void LiveAllocationTable::Clear()
+{
+    Entry empty = { 0, 0, 0 };
+    m_Entries.assign( LIVE_ALLOCATION_TABLE_MIN_CAPACITY, empty );
+    m_Entries.shrink_to_fit();
+    m_Size = 0;
+    m_Mask = LIVE_ALLOCATION_TABLE_MIN_CAPACITY - 1;
+    m_Shift = 64 - 10;
+}
+
+//-----------------------------------------------------------------------------
+MemoryTracker::MemoryTracker() : m_LastCallstackId(0)
+                               , m_LastCallstackIndex(0)
+                               , m_NumAllocatedBytes(0)
                                , m_NumFreedBytes(0)
                                , m_NumLiveBytes(0)
+                               , m_NumAllocs(0)
+                               , m_NumFrees(0)
+                               , m_SnapshotPeriodMs(10.0)
+                               , m_SnapshotPeriod(0)
+                               , m_NextSnapshotTime(0)
 {
+}
+
+//-----------------------------------------------------------------------------
+inline uint32_t MemoryTracker::GetCallstackIndex( CallstackID a_CallstackId )
+{
+    // Allocations in a loop come from the same callstack
+    if( a_CallstackId == m_LastCallstackId && !m_CallstackStats.empty() )
+    {
+        return m_LastCallstackIndex;
+    }
+
+    auto result = m_CallstackToIndex.emplace( a_CallstackId, (uint32_t)m_CallstackStats.size() );
+    if( result.second )
+    {
+        CallstackMemoryStats stats;
+        stats.m_CallstackId = a_CallstackId;
+        m_CallstackStats.push_back( stats );
+    }
 
+    m_LastCallstackId = a_CallstackId;
+    m_LastCallstackIndex = result.first->second;
+    return m_LastCallstackIndex;
 }
 
 //-----------------------------------------------------------------------------
@@ -21,62 +162,135 @@ void MemoryTracker::ProcessAlloc( const Timer & a_Timer )
 {
     DWORD64 address = a_Timer.m_UserData[0];
     DWORD64 size = a_Timer.m_UserData[1];
-    
-    m_LiveAllocs[address] = a_Timer;
+
+    UpdateSnapshots( a_Timer.m_End );
+
     m_NumAllocatedBytes += size;
     m_NumLiveBytes += size;
+    ++m_NumAllocs;
+
+    uint32_t callstackIndex = GetCallstackIndex( a_Timer.m_CallstackHash );
+    CallstackMemoryStats & stats = m_CallstackStats[callstackIndex];
+    stats.m_AllocatedBytes += size;
+    ++stats.m_NumAllocs;
+
+    if( address == 0 )
+    {
+        // Failed allocation, nothing will be freed
+        m_NumLiveBytes -= size;
+        return;
+    }
 
-    /*PRINT_VAR((void*)address);
-    PRINT_VAR(size);*/
+    stats.m_LiveBytes += size;
+    ++stats.m_NumLiveAllocs;
+
+    LiveAllocationTable::Entry entry = { address, size, callstackIndex };
+    LiveAllocationTable::Entry previous;
+    if( m_LiveAllocs.Insert( entry, previous ) )
+    {
+        // The free of the previous block at this address was not seen
+        CallstackMemoryStats & previousStats = m_CallstackStats[previous.m_CallstackIndex];
+        previousStats.m_LiveBytes -= previous.m_Size;
+        --previousStats.m_NumLiveAllocs;
+        m_NumLiveBytes -= previous.m_Size;
+    }
 }
 
 //-----------------------------------------------------------------------------
 void MemoryTracker::ProcessFree( const Timer & a_Timer )
 {
     DWORD64 address = a_Timer.m_UserData[0];
-    Timer & timer = m_LiveAllocs[address];
-    DWORD64 freedSize = timer.m_UserData[1];
 
-    m_LiveAllocs.erase(address);
-    m_NumFreedBytes += freedSize;
-    m_NumLiveBytes -= freedSize;
+    UpdateSnapshots( a_Timer.m_Start );
+
+    LiveAllocationTable::Entry removed;
+    if( !m_LiveAllocs.Remove( address, removed ) )
+    {
+        // Allocated before the capture started, or free( nullptr )
+        return;
+    }
+
+    CallstackMemoryStats & stats = m_CallstackStats[removed.m_CallstackIndex];
+    stats.m_LiveBytes -= removed.m_Size;
+    --stats.m_NumLiveAllocs;
 
-    //PRINT_VAR(freedSize);
+    m_NumFreedBytes += removed.m_Size;
+    m_NumLiveBytes -= removed.m_Size;
+    ++m_NumFrees;
 }
 
 //-----------------------------------------------------------------------------
-void MemoryTracker::DumpReport()
+void MemoryTracker::UpdateSnapshots( TickType a_Time )
 {
-    DWORD64 NumLiveBytes = 0;
-    std::unordered_map< CallstackID, DWORD64 > callstackToBytes;
-    for( auto & pair : m_LiveAllocs )
+    if( a_Time < m_NextSnapshotTime )
     {
-        Timer & timer = pair.second;
-        DWORD64 size = timer.m_UserData[1];
-        CallstackID id = timer.m_CallstackHash;
-        callstackToBytes[id] += size;
-        NumLiveBytes += size;
+        return;
     }
 
-    std::multimap< DWORD64, CallstackID > bytesToCallstack;
-    for( auto & pair : callstackToBytes )
+    if( m_SnapshotPeriod == 0 )
     {
-        bytesToCallstack.insert( std::make_pair( pair.second, pair.first ) );
+        m_SnapshotPeriod = std::max( TicksFromMicroseconds( m_SnapshotPeriodMs * 1000.0 ), (TickType)1 );
     }
 
+    if( m_NextSnapshotTime != 0 )
+    {
+        MemorySnapshot snapshot;
+        snapshot.m_Time = m_NextSnapshotTime;
+        snapshot.m_LiveBytes = m_NumLiveBytes;
+        snapshot.m_AllocatedBytes = m_NumAllocatedBytes;
+        snapshot.m_FreedBytes = m_NumFreedBytes;
+        snapshot.m_NumAllocs = m_NumAllocs;
+        snapshot.m_NumFrees = m_NumFrees;
+
+        ScopeLock lock( m_SnapshotMutex );
+        m_Snapshots.push_back( snapshot );
+    }
+
+    // Idle periods don't produce snapshots, align on the bucket of a_Time.
+    // Events of other threads can arrive slightly late, they are accounted
+    // in the current bucket.
+    m_NextSnapshotTime = a_Time - ( a_Time % m_SnapshotPeriod ) + m_SnapshotPeriod;
+}
+
+//-----------------------------------------------------------------------------
+void MemoryTracker::GetSnapshots( std::vector< MemorySnapshot > & o_Snapshots )
+{
+    ScopeLock lock( m_SnapshotMutex );
+    o_Snapshots = m_Snapshots;
+}
+
+//-----------------------------------------------------------------------------
+void MemoryTracker::DumpReport()
+{
+    // Totals are maintained incrementally, only the live callstacks need sorting
+    std::vector< const CallstackMemoryStats* > liveStats;
+    for( const CallstackMemoryStats & stats : m_CallstackStats )
+    {
+        if( stats.m_LiveBytes > 0 )
+        {
+            liveStats.push_back( &stats );
+        }
+    }
+
+    std::sort( liveStats.begin(), liveStats.end(), []( const CallstackMemoryStats* a, const CallstackMemoryStats* b )
+    {
+        return a->m_LiveBytes > b->m_LiveBytes;
+    } );
+
     if( m_NumAllocatedBytes )
     {
-        ORBIT_VIZ( Format(L"NumLiveBytes: %llu\n", NumLiveBytes ) );
+        ORBIT_VIZ( Format(L"NumLiveBytes: %llu\n", m_NumLiveBytes ) );
+        ORBIT_VIZ( Format(L"NumLiveAllocs: %llu\n", (DWORD64)m_LiveAllocs.Size() ) );
     }
 
-    for( auto rit = bytesToCallstack.rbegin(); rit != bytesToCallstack.rend(); ++rit )
+    for( const CallstackMemoryStats* stats : liveStats )
     {
-        CallstackID id = rit->second;
+        CallstackID id = stats->m_CallstackId;
         std::shared_ptr<CallStack> callstack = Capture::GetCallstack( id );
 
-        DWORD64 numBytes = rit->first;
         DWORD64 cid = id;
-        std::wstring msg = Format( L"Callstack[%llu] allocated %llu bytes\n", cid, numBytes );
+        std::wstring msg = Format( L"Callstack[%llu] allocated %llu bytes live in %llu blocks (%llu bytes in %llu allocations total)\n"
+                                 , cid, stats->m_LiveBytes, stats->m_NumLiveAllocs, stats->m_AllocatedBytes, stats->m_NumAllocs );
         ORBIT_VIZ(msg);
         if( callstack )
         {
@@ -89,8 +303,20 @@ void MemoryTracker::DumpReport()
 //-----------------------------------------------------------------------------
 void MemoryTracker::Clear()
 {
-    m_LiveAllocs.clear();
+    m_LiveAllocs.Clear();
+    m_CallstackStats.clear();
+    m_CallstackToIndex.clear();
+    m_LastCallstackId = 0;
+    m_LastCallstackIndex = 0;
+
     m_NumAllocatedBytes = 0;
     m_NumFreedBytes = 0;
     m_NumLiveBytes = 0;
-}
\ No newline at end of file
+    m_NumAllocs = 0;
+    m_NumFrees = 0;
+
+    ScopeLock lock( m_SnapshotMutex );
+    m_Snapshots.clear();
+    m_SnapshotPeriod = 0;
+    m_NextSnapshotTime = 0;
+}
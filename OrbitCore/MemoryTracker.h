@@ -5,10 +5,72 @@
 
 #include "Core.h"
 #include "ScopeTimer.h"
+#include "CallstackTypes.h"
 
 #include <unordered_map>
+#include <vector>
 
-class Function;
+//-----------------------------------------------------------------------------
+// Live allocations by address. Open addressing with linear probing and
+// backward shift deletion, so there are no tombstones and no per node
+// allocation. Address 0 is the empty key, null allocations are never stored.
+class LiveAllocationTable
+{
+public:
+    struct Entry
+    {
+        DWORD64  m_Address;
+        DWORD64  m_Size;
+        uint32_t m_CallstackIndex;
+    };
+
+    LiveAllocationTable();
+
+    // Returns the previous entry when a_Address was already live
+    bool Insert( const Entry & a_Entry, Entry & o_Previous );
+    bool Remove( DWORD64 a_Address, Entry & o_Removed );
+    void Clear();
+
+    size_t Size() const     { return m_Size; }
+    size_t Capacity() const { return m_Entries.size(); }
+
+protected:
+    size_t GetSlot( DWORD64 a_Address ) const;
+    void   Grow();
+
+protected:
+    std::vector< Entry > m_Entries;
+    size_t               m_Size;
+    size_t               m_Mask;
+    uint32_t             m_Shift;
+};
+
+//-----------------------------------------------------------------------------
+struct CallstackMemoryStats
+{
+    CallstackMemoryStats() : m_CallstackId(0), m_LiveBytes(0), m_NumLiveAllocs(0), m_AllocatedBytes(0), m_NumAllocs(0) {}
+
+    CallstackID m_CallstackId;
+    DWORD64     m_LiveBytes;
+    DWORD64     m_NumLiveAllocs;
+    DWORD64     m_AllocatedBytes;
+    DWORD64     m_NumAllocs;
+};
+
+//-----------------------------------------------------------------------------
+// Cumulative counters at the end of a time bucket, rates are the difference
+// between two consecutive snapshots.
+struct MemorySnapshot
+{
+    TickType m_Time;
+    DWORD64  m_LiveBytes;
+    DWORD64  m_AllocatedBytes;
+    DWORD64  m_FreedBytes;
+    DWORD64  m_NumAllocs;
+    DWORD64  m_NumFrees;
+};
+
+//-----------------------------------------------------------------------------
 class MemoryTracker
 {
 public:
@@ -21,11 +83,32 @@ public:
     DWORD64 NumAllocatedBytes() const { return m_NumAllocatedBytes; }
     DWORD64 NumFreedBytes() const { return m_NumFreedBytes; }
     DWORD64 NumLiveBytes() const { return m_NumLiveBytes; }
+    DWORD64 NumLiveAllocs() const { return m_LiveAllocs.Size(); }
+
+    // Thread safe copy, snapshots are appended while timers are processed
+    void GetSnapshots( std::vector< MemorySnapshot > & o_Snapshots );
+    void SetSnapshotPeriodMs( double a_PeriodMs ) { m_SnapshotPeriodMs = a_PeriodMs; m_SnapshotPeriod = 0; }
+
+protected:
+    uint32_t GetCallstackIndex( CallstackID a_CallstackId );
+    void     UpdateSnapshots( TickType a_Time );
 
 protected:
-    std::unordered_map< DWORD64, Timer > m_LiveAllocs;
+    LiveAllocationTable                         m_LiveAllocs;
+    std::vector< CallstackMemoryStats >         m_CallstackStats;
+    std::unordered_map< CallstackID, uint32_t > m_CallstackToIndex;
+    CallstackID                                 m_LastCallstackId;
+    uint32_t                                    m_LastCallstackIndex;
+
     DWORD64 m_NumAllocatedBytes;
     DWORD64 m_NumFreedBytes;
     DWORD64 m_NumLiveBytes;
-};
+    DWORD64 m_NumAllocs;
+    DWORD64 m_NumFrees;
 
+    Mutex                          m_SnapshotMutex;
+    std::vector< MemorySnapshot >  m_Snapshots;
+    double                         m_SnapshotPeriodMs;
+    TickType                       m_SnapshotPeriod;
+    TickType                       m_NextSnapshotTime;
+};
@@ -49,7 +49,11 @@ enum MessageType : int16_t
     Msg_OrbitUnrealObject,
     Msg_MiniDump,
     Msg_UserData,
-    Msg_OrbitData
+    Msg_OrbitData,
+    Msg_HashReturnAddresses,
+    Msg_SetCompression,
+    Msg_CompressedBatch,
+    Msg_ArgRecords
 };
 
 //-----------------------------------------------------------------------------
@@ -73,6 +77,14 @@ struct ArgTrackingHeader
     int     m_NumArgs;
 };
 
+//-----------------------------------------------------------------------------
+// Msg_ArgRecords, the payload is m_NumRecords ArgRecords, each followed by
+// its tracked bytes
+struct ArgRecordsHeader
+{
+    int m_NumRecords;
+};
+
 //-----------------------------------------------------------------------------
 struct UnrealObjectHeader
 {
@@ -81,6 +93,15 @@ struct UnrealObjectHeader
     bool    m_WideStr  : 1;
 };
 
+//-----------------------------------------------------------------------------
+// Msg_CompressedBatch, the payload is a BlockCompressor block holding
+// complete framed messages
+struct CompressionHeader
+{
+    unsigned int m_UncompressedSize;
+    unsigned int m_CompressMicros;
+};
+
 //-----------------------------------------------------------------------------
 #pragma pack(push, 1)
 class Message
@@ -102,6 +123,8 @@ public:
         DataTransferHeader m_DataTransferHeader;
         ArgTrackingHeader  m_ArgTrackingHeader;
         UnrealObjectHeader m_UnrealObjectHeader;
+        CompressionHeader  m_CompressionHeader;
+        ArgRecordsHeader   m_ArgRecordsHeader;
     };
 
     MessageType    GetType()   const { return m_Type; }
@@ -162,5 +185,17 @@ struct OrbitUnrealInfo
     DWORD         m_EntryIndexOffset;
 };
 
+//-----------------------------------------------------------------------------
+// One call of a function with tracked arguments or member data. Followed by
+// m_DataSize bytes, the concatenation of the Arguments in the order they were
+// sent with Msg_ArgTracking.
+struct ArgRecord
+{
+    DWORD64 m_Function;
+    DWORD64 m_Time;
+    DWORD   m_ThreadId;
+    DWORD   m_DataSize;
+};
+
 #pragma pack(pop)
 
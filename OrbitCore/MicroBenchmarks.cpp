@@ -0,0 +1,455 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Core.h"
+#include "MicroBenchmarks.h"
+#include "TimerManager.h"
+#include "ContextSwitch.h"
+#include "FunctionIndex.h"
+#include "OrbitFunction.h"
+#include "OrbitModule.h"
+#include "OrbitProcess.h"
+#include "Pdb.h"
+#include "ScopeTimer.h"
+#include "Profiling.h"
+#include "Log.h"
+
+#include <cfloat>
+#include <chrono>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+//-----------------------------------------------------------------------------
+struct MicroBenchmarkOptions
+{
+    explicit MicroBenchmarkOptions( const std::string & a_Argument );
+    uint32_t Get( const std::string & a_Key, uint32_t a_Default ) const;
+
+    std::string                       m_Name;
+    std::map< std::string, uint32_t > m_Values;
+};
+
+//-----------------------------------------------------------------------------
+MicroBenchmarkOptions::MicroBenchmarkOptions( const std::string & a_Argument )
+{
+    std::vector< std::string > tokens = Tokenize( a_Argument, ":" );
+    m_Name = tokens.empty() ? "" : tokens[0];
+
+    if( tokens.size() > 1 )
+    {
+        for( const std::string & option : Tokenize( tokens[1], "," ) )
+        {
+            std::vector< std::string > keyValue = Tokenize( option, "=" );
+            if( keyValue.size() == 2 )
+            {
+                m_Values[keyValue[0]] = (uint32_t)atoi( keyValue[1].c_str() );
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+uint32_t MicroBenchmarkOptions::Get( const std::string & a_Key, uint32_t a_Default ) const
+{
+    auto it = m_Values.find( a_Key );
+    return it != m_Values.end() ? it->second : a_Default;
+}
+
+//-----------------------------------------------------------------------------
+// Producer side of a hooked call: start and stop a timer and hand it to the
+// TimerManager, either through the shared queue or a per-thread ring.
+static double MeasureHooks( uint32_t a_NumThreads, uint32_t a_NumHooks, bool a_UseThreadBuffers, size_t & o_NumBuffersLeft )
+{
+    TimerManager manager;
+    manager.StartRecording();
+
+    // Same polling as the client's sender thread
+    std::atomic<bool> exitRequested( false );
+    std::thread collector( [&]()
+    {
+        std::vector<Timer> timers( TimerManager::NUM_TIMERS_PER_BATCH );
+        while( !exitRequested )
+        {
+            if( manager.DequeueThreadTimers( timers.data(), timers.size() ) == 0 )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+        }
+    } );
+
+    std::atomic<TickType> totalTicks( 0 );
+    std::vector< std::thread > producers;
+    for( uint32_t i = 0; i < a_NumThreads; ++i )
+    {
+        producers.push_back( std::thread( [&]()
+        {
+            TimerManager::TimerBuffer* buffer = a_UseThreadBuffers ? manager.CreateThreadBuffer() : nullptr;
+            TickType start = OrbitTicks();
+            for( uint32_t j = 0; j < a_NumHooks; ++j )
+            {
+                Timer timer;
+                timer.m_FunctionAddress = j & 63;
+                timer.Start();
+                timer.Stop();
+                manager.Add( buffer, timer );
+            }
+            totalTicks += OrbitTicks() - start;
+        } ) );
+    }
+
+    for( std::thread & producer : producers )
+    {
+        producer.join();
+    }
+
+    // Buffers of the exited producers should be reclaimed once drained
+    std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+    o_NumBuffersLeft = manager.GetNumThreadBuffers();
+
+    exitRequested = true;
+    collector.join();
+    manager.Stop();
+
+    return MicroSecondsFromTicks( 0, totalTicks ) * 1000.0 / ( double( a_NumHooks ) * a_NumThreads );
+}
+
+//-----------------------------------------------------------------------------
+static void BenchmarkHooks( const MicroBenchmarkOptions & a_Options, std::vector< std::string > & o_Report )
+{
+    uint32_t maxThreads = a_Options.Get( "threads", std::max( std::thread::hardware_concurrency(), 1u ) );
+    uint32_t numHooks = a_Options.Get( "count", 1000000 );
+
+    o_Report.push_back( Format( "Hook overhead, %u timers per thread, ns per timer:\n", numHooks ) );
+    for( uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2 )
+    {
+        size_t numBuffersLeft = 0;
+        double sharedNs = MeasureHooks( numThreads, numHooks, false, numBuffersLeft );
+        double ringNs = MeasureHooks( numThreads, numHooks, true, numBuffersLeft );
+        o_Report.push_back( Format( "  %3u threads: shared queue %.1f per-thread ring %.1f (%u rings not reclaimed)\n"
+                                  , numThreads, sharedNs, ringNs, (uint32_t)numBuffersLeft ) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Returns ns per lookup, or -1 if any address was not found
+template< class FindFunction >
+static double MeasureLookups( const std::vector< DWORD64 > & a_Addresses, FindFunction a_Find )
+{
+    size_t numFound = 0;
+    TickType start = OrbitTicks();
+    for( DWORD64 address : a_Addresses )
+    {
+        numFound += a_Find( address ) != nullptr;
+    }
+    double ns = MicroSecondsFromTicks( start, OrbitTicks() ) * 1000.0 / a_Addresses.size();
+    return numFound == a_Addresses.size() ? ns : -1.0;
+}
+
+//-----------------------------------------------------------------------------
+// Address to function lookups as done for every incoming timer: the previous
+// module map + per-pdb map walk against the flat FunctionIndex, on its own and
+// through Process::GetFunctionFromAddress over synthetic modules.
+static void BenchmarkLookup( const MicroBenchmarkOptions & a_Options, std::vector< std::string > & o_Report )
+{
+    uint32_t numModules = a_Options.Get( "modules", 100 );
+    uint32_t numFunctionsPerModule = a_Options.Get( "functions", 2000 );
+    uint32_t numLookups = a_Options.Get( "count", 1000000 );
+    uint32_t runLength = std::max( a_Options.Get( "run", 8 ), 1u );
+
+    std::mt19937_64 random( 0 );
+    std::uniform_int_distribution<uint32_t> functionSize( 16, 1024 );
+
+    Process process;
+    std::vector< FunctionIndex::Entry > entries;
+    std::map< DWORD64, std::map< DWORD64, Function* > > moduleMaps;
+    std::vector< DWORD64 > programCounters;
+
+    DWORD64 moduleBase = 0x10000000;
+    for( uint32_t i = 0; i < numModules; ++i )
+    {
+        std::shared_ptr<Module> module = std::make_shared<Module>();
+        module->m_Pdb = std::make_shared<Pdb>( L"" );
+        module->m_Pdb->SetMainModule( (HMODULE)moduleBase );
+        std::vector< Function > & functions = module->m_Pdb->GetFunctions();
+        functions.resize( numFunctionsPerModule );
+
+        std::map< DWORD64, Function* > & functionMap = moduleMaps[moduleBase];
+        size_t firstEntry = entries.size();
+        DWORD64 address = moduleBase;
+        for( uint32_t j = 0; j < numFunctionsPerModule; ++j )
+        {
+            Function* function = &functions[j];
+            uint32_t size = functionSize( random );
+            function->m_Address = address - moduleBase;
+            function->m_Size = size;
+            functionMap[address] = function;
+            programCounters.push_back( address + size / 2 );
+
+            FunctionIndex::Entry entry = { address, 0, function };
+            entries.push_back( entry );
+            address += size;
+        }
+
+        for( size_t k = firstEntry; k < entries.size(); ++k )
+        {
+            entries[k].m_ModuleEnd = address;
+        }
+
+        module->m_AddressStart = moduleBase;
+        module->m_AddressEnd = address;
+        process.AddModule( module );
+
+        moduleBase = ( address + 0xFFFF ) & ~DWORD64( 0xFFFF );
+    }
+
+    FunctionIndex index;
+    index.Build( entries );
+
+    // Timers of a thread come in runs of calls to the same function
+    std::uniform_int_distribution<size_t> pick( 0, programCounters.size() - 1 );
+    std::vector< DWORD64 > lookups( numLookups );
+    for( uint32_t i = 0; i < numLookups; ++i )
+    {
+        lookups[i] = ( i % runLength ) == 0 ? programCounters[pick( random )] : lookups[i-1];
+    }
+
+    double mapNs = MeasureLookups( lookups, [&]( DWORD64 a_Address ) -> Function*
+    {
+        auto moduleIt = moduleMaps.upper_bound( a_Address );
+        if( moduleIt == moduleMaps.begin() )
+            return nullptr;
+        std::map< DWORD64, Function* > & functionMap = ( --moduleIt )->second;
+        auto functionIt = functionMap.upper_bound( a_Address );
+        return functionIt == functionMap.begin() ? nullptr : ( --functionIt )->second;
+    } );
+
+    double indexNs = MeasureLookups( lookups, [&]( DWORD64 a_Address )
+    {
+        return index.FindProgramCounter( a_Address );
+    } );
+
+    // First call builds the process' index outside of the measurement
+    process.GetFunctionFromAddress( 0, false );
+    double processNs = MeasureLookups( lookups, [&]( DWORD64 a_Address )
+    {
+        return process.GetFunctionFromAddress( a_Address, false );
+    } );
+
+    o_Report.push_back( Format( "Function lookup, %u functions, %u lookups in runs of %u, ns per lookup (-1 means wrong results):\n"
+                              , (uint32_t)index.Size(), numLookups, runLength ) );
+    o_Report.push_back( Format( "  std::map %.1f FunctionIndex %.1f Process %.1f\n", mapNs, indexNs, processNs ) );
+}
+
+//-----------------------------------------------------------------------------
+// Time sorted In/Out pairs on each core, in the order ETW would deliver them:
+// a_LatePerMille of the events arrive up to 64 events after their time.
+static std::vector< ContextSwitch > GenerateContextSwitches( uint32_t a_NumEvents, uint32_t a_NumCores, uint32_t a_NumThreads, uint32_t a_LatePerMille )
+{
+    std::mt19937_64 random( 0 );
+    std::uniform_int_distribution<uint32_t> pickCore( 0, a_NumCores - 1 );
+    std::uniform_int_distribution<uint32_t> pickThread( 1, a_NumThreads );
+    std::uniform_int_distribution<uint32_t> pickPerMille( 0, 999 );
+    std::uniform_int_distribution<uint32_t> pickDelay( 1, 64 );
+
+    std::vector< ContextSwitch > switches;
+    std::vector< uint32_t > runningThreads( a_NumCores, 0 );
+    long long time = 0;
+    while( switches.size() < a_NumEvents )
+    {
+        uint32_t core = pickCore( random );
+        ContextSwitch cs( runningThreads[core] ? ContextSwitch::Out : ContextSwitch::In );
+        cs.m_ThreadId = runningThreads[core] ? runningThreads[core] : pickThread( random );
+        cs.m_Time = time += 1 + pickPerMille( random );
+        cs.m_ProcessorIndex = (unsigned short)core;
+        cs.m_ProcessorNumber = (unsigned char)core;
+        runningThreads[core] = runningThreads[core] ? 0 : cs.m_ThreadId;
+        switches.push_back( cs );
+    }
+
+    std::vector< std::pair< size_t, size_t > > deliveryOrder( switches.size() );
+    for( size_t i = 0; i < switches.size(); ++i )
+    {
+        bool isLate = pickPerMille( random ) < a_LatePerMille;
+        deliveryOrder[i] = std::make_pair( isLate ? i + pickDelay( random ) : i, i );
+    }
+    std::stable_sort( deliveryOrder.begin(), deliveryOrder.end() );
+
+    std::vector< ContextSwitch > delivered;
+    delivered.reserve( switches.size() );
+    for( auto & pair : deliveryOrder )
+    {
+        delivered.push_back( switches[pair.second] );
+    }
+
+    return delivered;
+}
+
+//-----------------------------------------------------------------------------
+struct ContextSwitchQuery
+{
+    uint32_t  m_Core;
+    long long m_Min;
+    long long m_Max;
+};
+
+//-----------------------------------------------------------------------------
+struct ContextSwitchReplay
+{
+    ContextSwitchReplay() : m_AddNs( DBL_MAX ), m_RangeNs( DBL_MAX ), m_NumInRange( 0 ), m_NumOutOfOrder( 0 ) {}
+
+    double m_AddNs;
+    double m_RangeNs;
+    size_t m_NumInRange;
+    size_t m_NumOutOfOrder;
+};
+
+//-----------------------------------------------------------------------------
+// Previous containers, for reference
+static void ReplayContextSwitchMaps( const std::vector< ContextSwitch > & a_Events, const std::vector< ContextSwitchQuery > & a_Queries
+                                   , uint32_t a_NumCores, ContextSwitchReplay & o_Replay )
+{
+    std::vector< std::map< long long, ContextSwitch > > cores( a_NumCores );
+    std::unordered_map< uint32_t, std::map< long long, ContextSwitch > > threads;
+
+    TickType start = OrbitTicks();
+    for( const ContextSwitch & cs : a_Events )
+    {
+        cores[cs.m_ProcessorIndex][cs.m_Time] = cs;
+        threads[cs.m_ThreadId][cs.m_Time] = cs;
+    }
+    o_Replay.m_AddNs = std::min( o_Replay.m_AddNs, MicroSecondsFromTicks( start, OrbitTicks() ) * 1000.0 / std::max( a_Events.size(), (size_t)1 ) );
+
+    size_t numInRange = 0;
+    start = OrbitTicks();
+    for( const ContextSwitchQuery & query : a_Queries )
+    {
+        std::map< long long, ContextSwitch > & core = cores[query.m_Core];
+        for( auto it = core.lower_bound( query.m_Min ); it != core.end() && it->first < query.m_Max; ++it )
+        {
+            ++numInRange;
+        }
+    }
+    o_Replay.m_RangeNs = std::min( o_Replay.m_RangeNs, MicroSecondsFromTicks( start, OrbitTicks() ) * 1000.0 / std::max( a_Queries.size(), (size_t)1 ) );
+    o_Replay.m_NumInRange = numInRange;
+}
+
+//-----------------------------------------------------------------------------
+static void ReplayContextSwitchStreams( const std::vector< ContextSwitch > & a_Events, const std::vector< ContextSwitchQuery > & a_Queries
+                                      , uint32_t a_NumCores, ContextSwitchReplay & o_Replay )
+{
+    std::vector< ContextSwitchStream > cores( a_NumCores );
+    std::unordered_map< uint32_t, ContextSwitchStream > threads;
+
+    TickType start = OrbitTicks();
+    ContextSwitch previous;
+    for( const ContextSwitch & cs : a_Events )
+    {
+        cores[cs.m_ProcessorIndex].Add( cs, previous );
+        threads[cs.m_ThreadId].Add( cs, previous );
+    }
+    o_Replay.m_AddNs = std::min( o_Replay.m_AddNs, MicroSecondsFromTicks( start, OrbitTicks() ) * 1000.0 / std::max( a_Events.size(), (size_t)1 ) );
+
+    size_t numInRange = 0;
+    start = OrbitTicks();
+    for( const ContextSwitchQuery & query : a_Queries )
+    {
+        const ContextSwitch* begin = nullptr;
+        const ContextSwitch* end = nullptr;
+        cores[query.m_Core].GetRange( query.m_Min, query.m_Max, begin, end );
+        for( const ContextSwitch* cs = begin; cs != end; ++cs )
+        {
+            ++numInRange;
+        }
+    }
+    o_Replay.m_RangeNs = std::min( o_Replay.m_RangeNs, MicroSecondsFromTicks( start, OrbitTicks() ) * 1000.0 / std::max( a_Queries.size(), (size_t)1 ) );
+    o_Replay.m_NumInRange = numInRange;
+
+    o_Replay.m_NumOutOfOrder = 0;
+    for( ContextSwitchStream & core : cores )
+    {
+        o_Replay.m_NumOutOfOrder += core.NumOutOfOrder();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Replays a synthetic switch stream into per core and per thread containers
+// like TimeGraph::AddContextSwitch, then queries time windows on every core.
+// Streams run first, millions of freed map nodes leave allocator work that
+// would be billed to whatever runs next. The best of a few runs is kept.
+static void BenchmarkContextSwitches( const MicroBenchmarkOptions & a_Options, std::vector< std::string > & o_Report )
+{
+    uint32_t numEvents = a_Options.Get( "count", 1000000 );
+    uint32_t numCores = std::max( a_Options.Get( "cores", 16 ), 1u );
+    uint32_t numThreads = std::max( a_Options.Get( "threads", 500 ), 1u );
+    uint32_t latePerMille = a_Options.Get( "late", 10 );
+    uint32_t numQueries = a_Options.Get( "queries", 10000 );
+    uint32_t numRuns = std::max( a_Options.Get( "runs", 3 ), 1u );
+
+    std::vector< ContextSwitch > events = GenerateContextSwitches( numEvents, numCores, numThreads, latePerMille );
+    long long maxTime = events.empty() ? 0 : events.back().m_Time;
+
+    // Windows of ~1/1000th of the session
+    std::mt19937_64 random( 1 );
+    std::uniform_int_distribution<long long> pickTime( 0, std::max( maxTime, 1ll ) );
+    long long window = maxTime / 1000 + 1;
+    std::vector< ContextSwitchQuery > queries( numQueries );
+    for( uint32_t i = 0; i < numQueries; ++i )
+    {
+        queries[i].m_Core = i % numCores;
+        queries[i].m_Min = pickTime( random );
+        queries[i].m_Max = queries[i].m_Min + window;
+    }
+
+    ContextSwitchReplay maps;
+    ContextSwitchReplay streams;
+    for( uint32_t i = 0; i < numRuns; ++i )
+    {
+        ReplayContextSwitchStreams( events, queries, numCores, streams );
+    }
+
+    for( uint32_t i = 0; i < numRuns; ++i )
+    {
+        ReplayContextSwitchMaps( events, queries, numCores, maps );
+    }
+
+    o_Report.push_back( Format( "Context switches, %u events on %u cores, %u threads, %u late per 1000 (%u out of order on cores), best of %u:\n"
+                              , numEvents, numCores, numThreads, latePerMille, (uint32_t)streams.m_NumOutOfOrder, numRuns ) );
+    o_Report.push_back( Format( "  Add ns per event:   std::map %.1f ContextSwitchStream %.1f\n", maps.m_AddNs, streams.m_AddNs ) );
+    o_Report.push_back( Format( "  GetRange ns:        std::map %.1f ContextSwitchStream %.1f (%s)\n", maps.m_RangeNs, streams.m_RangeNs
+                              , maps.m_NumInRange == streams.m_NumInRange ? "same results" : "DIFFERENT RESULTS" ) );
+}
+
+//-----------------------------------------------------------------------------
+bool MicroBenchmarks::Handles( const std::string & a_Argument )
+{
+    return StartsWith( a_Argument, "benchmark-" );
+}
+
+//-----------------------------------------------------------------------------
+std::vector< std::string > MicroBenchmarks::Run( const std::string & a_Argument )
+{
+    MicroBenchmarkOptions options( a_Argument );
+    std::vector< std::string > report;
+
+    if( options.m_Name == "benchmark-hooks" )
+    {
+        BenchmarkHooks( options, report );
+    }
+    else if( options.m_Name == "benchmark-lookup" )
+    {
+        BenchmarkLookup( options, report );
+    }
+    else if( options.m_Name == "benchmark-contextswitches" )
+    {
+        BenchmarkContextSwitches( options, report );
+    }
+    else
+    {
+        ORBIT_LOG( Format( "Unknown benchmark: %s\n", options.m_Name.c_str() ) );
+    }
+
+    return report;
+}
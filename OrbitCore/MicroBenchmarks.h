@@ -0,0 +1,21 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// In-process micro benchmarks of the hot paths, run headless like TcpBenchmark:
+// "benchmark-hooks:threads=8,count=1000000". Options are key=value pairs after
+// the ':', omitted keys keep their default. Benchmarks: benchmark-hooks,
+// benchmark-lookup and benchmark-contextswitches.
+class MicroBenchmarks
+{
+public:
+    static bool Handles( const std::string & a_Argument );
+
+    // Returns the report, empty if the benchmark is unknown
+    static std::vector< std::string > Run( const std::string & a_Argument );
+};
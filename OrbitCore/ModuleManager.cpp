@@ -9,11 +9,16 @@
 #include "Capture.h"
 #include "OrbitProcess.h"
 #include "CoreApp.h"
+#include "Path.h"
+#include "Log.h"
+#include "ScopeTimer.h"
+#include <algorithm>
 
 ModuleManager GModuleManager;
 
 //-----------------------------------------------------------------------------
-ModuleManager::ModuleManager()
+ModuleManager::ModuleManager() : m_IsLoading(false)
+                               , m_FinishedLoading(false)
 {
     GPdbDbg = std::make_shared<Pdb>(L"");
 }
@@ -21,7 +26,10 @@ ModuleManager::ModuleManager()
 //-----------------------------------------------------------------------------
 ModuleManager::~ModuleManager()
 {
-
+    if( m_LoadingThread && m_LoadingThread->joinable() )
+    {
+        m_LoadingThread->join();
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -62,90 +70,197 @@ void ModuleManager::OnReceiveMessage( const Message & a_Msg )
 
 //-----------------------------------------------------------------------------
 void ModuleManager::LoadPdbAsync( const std::shared_ptr<Module> & a_Module, std::function<void()> a_CompletionCallback )
-{   
-    if (!a_Module->m_Loaded)
+{
+    std::vector< std::shared_ptr<Module> > modules = { a_Module };
+    LoadPdbAsync( modules, a_CompletionCallback );
+}
+
+//-----------------------------------------------------------------------------
+void ModuleManager::LoadPdbAsync( const std::vector<std::wstring> a_Modules, std::function<void()> a_CompletionCallback )
+{
+    m_UserCompletionCallback = a_CompletionCallback;
+
+    for( const std::wstring & pdbName : a_Modules )
     {
-        bool loadExports = a_Module->IsDll() && !a_Module->m_FoundPdb;
-        if( a_Module->m_FoundPdb || loadExports )
+        std::shared_ptr<Module> module = Capture::GTargetProcess->FindModule( Path::GetFileName( pdbName ) );
+        if( module && module->m_Pdb )
         {
-            std::wstring pdbName = loadExports ? a_Module->m_FullName : a_Module->m_PdbName;
-            m_UserCompletionCallback = a_CompletionCallback;
-
-            GPdbDbg = a_Module->m_Pdb;
-            if( GPdbDbg )
+            if( module->m_PdbName == L"" )
             {
-                GPdbDbg->SetMainModule((HMODULE)a_Module->m_AddressStart);
-                GPdbDbg->LoadPdbAsync(pdbName.c_str(), [&]() { this->OnPdbLoaded(); });
+                module->m_PdbName = module->m_FullName;
             }
+
+            AddRequest( module, module->m_PdbName );
         }
     }
+
+    StartLoading();
 }
 
 //-----------------------------------------------------------------------------
-void ModuleManager::LoadPdbAsync(const std::vector<std::wstring> a_Modules, std::function<void()> a_CompletionCallback)
+void ModuleManager::LoadPdbAsync( const std::vector< std::shared_ptr<Module> > & a_Modules, std::function<void()> a_CompletionCallback )
 {
     m_UserCompletionCallback = a_CompletionCallback;
-    m_ModulesQueue = a_Modules;
-    DequeueAndLoad();
-}
 
-//-----------------------------------------------------------------------------
-void ModuleManager::DequeueAndLoad()
-{
-    std::shared_ptr<Module> module = nullptr;
-    
-    while( module == nullptr && !m_ModulesQueue.empty() )
-    {
-        std::wstring pdbName = m_ModulesQueue.back();
-        m_ModulesQueue.pop_back();
-    
-        module = Capture::GTargetProcess->FindModule( Path::GetFileName( pdbName ) );
-        if( module )
+    for( const std::shared_ptr<Module> & module : a_Modules )
+    {
+        if( !module->m_Loaded && module->m_Pdb )
         {
-            GPdbDbg = module->m_Pdb;
-            if( module->m_PdbName == L"" )
+            bool loadExports = module->IsDll() && !module->m_FoundPdb;
+            if( module->m_FoundPdb || loadExports )
             {
-                module->m_PdbName = module->m_FullName;
+                AddRequest( module, loadExports ? module->m_FullName : module->m_PdbName );
             }
+        }
+    }
+
+    StartLoading();
+}
 
-            GPdbDbg->LoadPdbAsync( module->m_PdbName.c_str(), [&](){ this->OnPdbLoaded(); });
+//-----------------------------------------------------------------------------
+void ModuleManager::AddRequest( const std::shared_ptr<Module> & a_Module, const std::wstring & a_FileName )
+{
+    ScopeLock lock( m_Mutex );
+
+    for( PdbLoadRequest & request : m_PendingRequests )
+    {
+        if( request.m_Module == a_Module )
             return;
+    }
+
+    PdbLoadRequest request;
+    request.m_Module = a_Module;
+    request.m_FileName = a_FileName;
+    m_PendingRequests.push_back( request );
+}
+
+//-----------------------------------------------------------------------------
+void ModuleManager::StartLoading()
+{
+    if( m_IsLoading )
+    {
+        // Picked up in Update() when the current batch is done
+        return;
+    }
+
+    std::vector<PdbLoadRequest> requests;
+    {
+        ScopeLock lock( m_Mutex );
+        requests.swap( m_PendingRequests );
+    }
+
+    if( requests.empty() )
+    {
+        if( m_UserCompletionCallback )
+        {
+            m_UserCompletionCallback();
         }
+        return;
+    }
+
+    if( m_LoadingThread && m_LoadingThread->joinable() )
+    {
+        m_LoadingThread->join();
     }
 
-    // No module was found, call user callback
-    m_UserCompletionCallback();
+    m_IsLoading = true;
+    m_LoadingThread = std::make_unique<std::thread>( &ModuleManager::LoadPdbs, this, std::move( requests ) );
 }
 
 //-----------------------------------------------------------------------------
-void ModuleManager::OnPdbLoaded()
+void ModuleManager::LoadPdbs( std::vector<PdbLoadRequest> a_Requests )
 {
-    std::shared_ptr<Pdb> lastPdb = GPdbDbg;
-    AddPdb( lastPdb );
+    SCOPE_TIMER_LOG( Format( L"Loading %u modules", (unsigned)a_Requests.size() ) );
+
+    // Biggest first so that a large pdb doesn't end up alone at the end
+    std::sort( a_Requests.begin(), a_Requests.end(), []( const PdbLoadRequest & a, const PdbLoadRequest & b )
+    {
+        return a.m_Module->m_PdbSize > b.m_Module->m_PdbSize;
+    } );
 
-    if( !m_ModulesQueue.empty() )
     {
-        // Start loading next pdb on other thread
-        DequeueAndLoad();
+        SCOPE_TIMER_LOG( L"Parsing symbols" );
+
+        // One module per grab, workers pick the next module as soon as they are done
+        const auto prio = oqpi::task_priority::normal;
+        int32_t numWorkers = (int32_t)oqpi_tk::scheduler().workersCount( prio );
+        oqpi::atomic_partitioner partitioner( (int32_t)a_Requests.size(), 1, numWorkers );
+
+        oqpi_tk::parallel_for( "LoadPdbs", partitioner, prio, [&]( int32_t a_BatchIndex, int32_t a_ElementIndex )
+        {
+            PdbLoadRequest & request = a_Requests[a_ElementIndex];
+            std::shared_ptr<Pdb> & pdb = request.m_Module->m_Pdb;
+            pdb->SetMainModule( (HMODULE)request.m_Module->m_AddressStart );
+            pdb->ParseSymbols( request.m_FileName.c_str(), false );
+        } );
     }
-    
-    // Apply presets on last pdb
-    lastPdb->ApplyPresets();
 
-    if( m_ModulesQueue.empty() )
     {
-        m_UserCompletionCallback();
+        SCOPE_TIMER_LOG( L"Publishing symbols" );
+        ScopeLock lock( Capture::GTargetProcess->GetDataMutex() );
+
+        for( PdbLoadRequest & request : a_Requests )
+        {
+            request.m_Module->m_Pdb->ProcessData();
+            request.m_Module->m_Pdb->OnSymbolsLoaded();
+            request.m_Module->m_Loaded = true;
+        }
     }
+
+    for( PdbLoadRequest & request : a_Requests )
+    {
+        Pdb & pdb = *request.m_Module->m_Pdb;
+        ORBIT_LOG( Format( L"%s: %.0f ms, %u functions%s\n", pdb.GetName().c_str(), pdb.GetLoadTime(), (unsigned)pdb.GetFunctions().size(), pdb.IsLoadedFromCache() ? L" (cached)" : L"" ) );
+
+        // Outside of the data lock, next sessions will map this instead of walking DIA
+        if( !pdb.IsLoadedFromCache() )
+        {
+            pdb.Save();
+        }
+    }
+
+    ScopeLock lock( m_Mutex );
+    m_LoadedRequests = std::move( a_Requests );
+    m_FinishedLoading = true;
 }
 
 //-----------------------------------------------------------------------------
-void ModuleManager::AddPdb( const std::shared_ptr<Pdb> & a_Pdb )
-{ 
-    std::map< DWORD64, std::shared_ptr<Module> >& modules = Capture::GTargetProcess->GetModules();
+void ModuleManager::Update()
+{
+    if( !m_FinishedLoading )
+    {
+        return;
+    }
+
+    std::vector<PdbLoadRequest> loaded;
+    {
+        ScopeLock lock( m_Mutex );
+        loaded.swap( m_LoadedRequests );
+        m_FinishedLoading = false;
+    }
+
+    for( PdbLoadRequest & request : loaded )
+    {
+        request.m_Module->m_Pdb->ApplyPresets();
+        GPdbDbg = request.m_Module->m_Pdb;
+    }
+
+    m_IsLoading = false;
+
+    if( m_UserCompletionCallback )
+    {
+        m_UserCompletionCallback();
+    }
+
+    // Modules requested while we were loading
+    bool hasPendingRequests = false;
+    {
+        ScopeLock lock( m_Mutex );
+        hasPendingRequests = !m_PendingRequests.empty();
+    }
 
-    auto it = modules.find( (DWORD64)a_Pdb->GetHModule() );
-    if( it != modules.end() )
+    if( hasPendingRequests )
     {
-        it->second->m_Loaded = true;
+        StartLoading();
     }
 }
@@ -15,19 +15,36 @@ public:
     ~ModuleManager();
 
     void Init();
+    void Update();
     void OnReceiveMessage( const Message & a_Msg );
+
+    // Symbols of all modules are parsed concurrently on the oqpi scheduler,
+    // a_CompletionCallback is called from Update() once they are published.
     void LoadPdbAsync(const std::shared_ptr<Module> & a_Module, std::function<void()> a_CompletionCallback);
     void LoadPdbAsync(const std::vector<std::wstring> a_Modules, std::function<void()> a_CompletionCallback);
+    void LoadPdbAsync(const std::vector< std::shared_ptr<Module> > & a_Modules, std::function<void()> a_CompletionCallback);
+    bool IsLoading() const { return m_IsLoading; }
     
 protected:
-    void DequeueAndLoad();
-    void OnPdbLoaded();
+    struct PdbLoadRequest
+    {
+        std::shared_ptr<Module> m_Module;
+        std::wstring            m_FileName;
+    };
+
+    void AddRequest( const std::shared_ptr<Module> & a_Module, const std::wstring & a_FileName );
+    void StartLoading();
+    void LoadPdbs( std::vector<PdbLoadRequest> a_Requests );
     void ApplyPresets( std::shared_ptr<Pdb> & a_Pdb );
-    void AddPdb( const std::shared_ptr<Pdb> & a_Pdb );
 
 protected:
-    std::function<void()> m_UserCompletionCallback;
-    std::vector<std::wstring> m_ModulesQueue;
+    std::function<void()>          m_UserCompletionCallback;
+    Mutex                          m_Mutex;
+    std::vector<PdbLoadRequest>    m_PendingRequests;
+    std::vector<PdbLoadRequest>    m_LoadedRequests;
+    std::unique_ptr<std::thread>   m_LoadingThread;
+    std::atomic<bool>              m_IsLoading;
+    std::atomic<bool>              m_FinishedLoading;
 };
 
 extern ModuleManager GModuleManager;
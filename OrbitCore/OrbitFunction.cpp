@@ -208,7 +208,7 @@ const TCHAR* Function::GetCallingConventionString( int a_CallConv )
 }
 
 //-----------------------------------------------------------------------------
-ORBIT_SERIALIZE( Function, 1 )
+ORBIT_SERIALIZE( Function, 3 )
 {
     ORBIT_NVP_VAL( 0, m_Name );
     ORBIT_NVP_VAL( 0, m_PrettyName );
@@ -220,6 +220,8 @@ ORBIT_SERIALIZE( Function, 1 )
     ORBIT_NVP_VAL( 0, m_ModBase );
     ORBIT_NVP_VAL( 0, m_CallConv );
     ORBIT_NVP_VAL( 1, m_Stats );
+    ORBIT_NVP_VAL( 2, m_ParentId );
+    ORBIT_NVP_VAL( 3, m_Id );
 }
 
 //-----------------------------------------------------------------------------
@@ -270,8 +272,8 @@ void Function::ProcessArgumentInfo()
 //-----------------------------------------------------------------------------
 bool Function::IsMemberFunction()
 {
-    // TODO
-    return false;
+    // TODO: Static member functions also have a parent type
+    return m_ParentId != 0;
 }
 
 //-----------------------------------------------------------------------------
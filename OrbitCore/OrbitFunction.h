@@ -42,9 +42,10 @@ struct Argument
 //-----------------------------------------------------------------------------
 struct FunctionArgInfo
 {
-    FunctionArgInfo() : m_NumStackBytes(0), m_ArgDataSize(0) {}
+    FunctionArgInfo() : m_NumStackBytes(0), m_ArgDataSize(0), m_ReadsThis(false) {}
     int m_NumStackBytes;
     int m_ArgDataSize;
+    bool m_ReadsThis; // An argument is member data read through "this"
     std::vector< Argument > m_Args;
 };
 
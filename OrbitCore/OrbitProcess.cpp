@@ -16,6 +16,7 @@
 #include "Serialization.h"
 
 #include <tlhelp32.h>
+#include <algorithm>
 
 //-----------------------------------------------------------------------------
 Process::Process() : m_ID(0)
@@ -25,6 +26,8 @@ Process::Process() : m_ID(0)
                    , m_DebugInfoLoaded(false)
                    , m_IsRemote(false)
                    , m_IsElevated(false)
+                   , m_FunctionIndexDirty(true)
+                   , m_FunctionIndex(nullptr)
 {
 }
 
@@ -36,6 +39,8 @@ Process::Process(DWORD a_ID) : m_ID(a_ID)
                              , m_Is64Bit(false)
                              , m_DebugInfoLoaded(false)
                              , m_IsElevated(false)
+                             , m_FunctionIndexDirty(true)
+                             , m_FunctionIndex(nullptr)
 {
     Init();
 }
@@ -115,6 +120,15 @@ void Process::ClearTransients()
     m_Globals.clear();
     m_WatchedVariables.clear();
     m_NameToModuleMap.clear();
+    m_FunctionIndexDirty = true;
+
+    // Modules are about to be replaced, lookups can't be in flight anymore
+    ScopeLock lock( m_DataMutex );
+    const FunctionIndex* current = m_FunctionIndex;
+    m_FunctionIndices.erase( std::remove_if( m_FunctionIndices.begin(), m_FunctionIndices.end(), [current]( const std::unique_ptr<const FunctionIndex> & a_Index )
+    {
+        return a_Index.get() != current;
+    } ), m_FunctionIndices.end() );
 }
 
 //-----------------------------------------------------------------------------
@@ -240,29 +254,28 @@ std::shared_ptr<Module> Process::FindModule( const std::wstring & a_ModuleName )
 //-----------------------------------------------------------------------------
 Function* Process::GetFunctionFromAddress( DWORD64 a_Address, bool a_IsExact )
 {
-    DWORD64 address = (DWORD64)a_Address;
-    auto & it = m_Modules.upper_bound( address );
-    if( !m_Modules.empty() && it != m_Modules.begin() )
+    const FunctionIndex* index = GetFunctionIndex();
+    return a_IsExact ? index->FindExact( a_Address ) : index->FindProgramCounter( a_Address );
+}
+
+//-----------------------------------------------------------------------------
+const FunctionIndex* Process::GetFunctionIndex()
+{
+    if( m_FunctionIndexDirty )
     {
-        --it;
-        std::shared_ptr<Module> & module = it->second;
-        if( address < module->m_AddressEnd )
+        ScopeLock lock( m_DataMutex );
+        if( m_FunctionIndexDirty )
         {
-            if( module->m_Pdb != nullptr )
-            {
-                if( a_IsExact )
-                {
-                    return module->m_Pdb->GetFunctionFromExactAddress( a_Address );
-                }
-                else
-                {
-                    return module->m_Pdb->GetFunctionFromProgramCounter( a_Address );
-                }
-            }
+            m_FunctionIndexDirty = false;
+
+            std::unique_ptr<FunctionIndex> index = std::make_unique<FunctionIndex>();
+            index->Build( m_Modules );
+            m_FunctionIndex.store( index.get(), std::memory_order_release );
+            m_FunctionIndices.push_back( std::move( index ) );
         }
     }
 
-    return nullptr;
+    return m_FunctionIndex.load( std::memory_order_acquire );
 }
 
 //-----------------------------------------------------------------------------
@@ -349,6 +362,7 @@ void Process::AddType(Type & a_Type)
 void Process::AddModule( std::shared_ptr<Module> & a_Module )
 {
     m_Modules[a_Module->m_AddressStart] = a_Module;
+    m_FunctionIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -541,4 +555,5 @@ ORBIT_SERIALIZE( Process, 0 )
     ORBIT_NVP_VAL( 0, m_Modules );
     ORBIT_NVP_VAL( 0, m_NameToModuleMap );
     ORBIT_NVP_VAL( 0, m_ThreadIds );
+    m_FunctionIndexDirty = true;
 }
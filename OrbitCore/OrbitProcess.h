@@ -7,11 +7,13 @@
 #include "SerializationMacros.h"
 #include "Threading.h"
 #include "DiaManager.h"
+#include "FunctionIndex.h"
 
 #include <set>
 #include <unordered_set>
 #include <memory>
 #include <map>
+#include <atomic>
 
 class Function;
 class Type;
@@ -62,6 +64,7 @@ public:
     void SetIsRemote( bool val ) { m_IsRemote = val; }
 
     Function* GetFunctionFromAddress( DWORD64 a_Address, bool a_IsExact = true );
+    void InvalidateFunctionIndex() { m_FunctionIndexDirty = true; }
     std::shared_ptr<Module> GetModuleFromAddress( DWORD64 a_Address );
     std::shared_ptr<OrbitDiaSymbol> SymbolFromAddress( DWORD64 a_Address );
     bool LineInfoFromAddress( DWORD64 a_Address, struct LineInfo & o_LineInfo );
@@ -96,6 +99,7 @@ public:
 
 protected:
     void ClearTransients();
+    const FunctionIndex* GetFunctionIndex();
 
 private:
     DWORD       m_ID;
@@ -123,5 +127,12 @@ private:
     std::vector< std::shared_ptr<Variable> > m_WatchedVariables;
     
     std::unordered_set< unsigned long long > m_UniqueTypeHash;
+
+    // Address lookups, rebuilt lazily when modules or symbols change. Readers
+    // only load the published pointer, replaced indices are kept alive until
+    // ListModules as a lookup might still be using them.
+    std::atomic<bool>                                   m_FunctionIndexDirty;
+    std::atomic<const FunctionIndex*>                   m_FunctionIndex;
+    std::vector< std::unique_ptr<const FunctionIndex> > m_FunctionIndices;
 };
 
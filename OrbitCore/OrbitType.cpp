@@ -387,3 +387,13 @@ std::shared_ptr<Variable> Type::GenerateVariable( DWORD64 a_Address, const std::
 
     return var;
 }
+
+//-----------------------------------------------------------------------------
+// Only what DumpTypes gathers, the rest is lazily queried from DIA
+ORBIT_SERIALIZE( Type, 0 )
+{
+    ORBIT_NVP_VAL( 0, m_Id );
+    ORBIT_NVP_VAL( 0, m_UnmodifiedId );
+    ORBIT_NVP_VAL( 0, m_Name );
+    ORBIT_NVP_VAL( 0, m_Length );
+}
@@ -116,4 +116,6 @@ public:
     mutable std::map<ULONG, Variable> m_DataMembersFull; //offset, Variable
     mutable std::map<ULONG, Parent>   m_Hierarchy;
     std::shared_ptr<Variable>         m_TemplateVariable;
+
+    ORBIT_SERIALIZABLE;
 };
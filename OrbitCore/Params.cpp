@@ -27,6 +27,8 @@ Params::Params() : m_LoadTypeInfo( true )
                  , m_HookOutputDebugString(false)
                  , m_FindFileAndLineInfo(true)
                  , m_AutoReleasePdb(false)
+                 , m_HashReturnAddresses(false)
+                 , m_CompressRemoteCaptures(true)
                  , m_Port(1789)
                  , m_DiffArgs("%1 %2")
                  , m_NumBytesAssembly(1024)
@@ -34,7 +36,7 @@ Params::Params() : m_LoadTypeInfo( true )
     
 }
 
-ORBIT_SERIALIZE( Params, 13 )
+ORBIT_SERIALIZE( Params, 15 )
 {
     ORBIT_NVP_VAL( 0, m_LoadTypeInfo );
     ORBIT_NVP_VAL( 0, m_SendCallStacks );
@@ -58,6 +60,8 @@ ORBIT_SERIALIZE( Params, 13 )
     ORBIT_NVP_VAL( 11, m_FindFileAndLineInfo );
     ORBIT_NVP_VAL( 12, m_AutoReleasePdb );
     ORBIT_NVP_VAL( 13, m_ProcessFilter );
+    ORBIT_NVP_VAL( 14, m_HashReturnAddresses );
+    ORBIT_NVP_VAL( 15, m_CompressRemoteCaptures );
 }
 
 //-----------------------------------------------------------------------------
@@ -30,6 +30,8 @@ public:
     bool  m_HookOutputDebugString;
     bool  m_FindFileAndLineInfo;
     bool  m_AutoReleasePdb;
+    bool  m_HashReturnAddresses;
+    bool  m_CompressRemoteCaptures;
     int   m_MaxNumTimers;
     float m_FontSize;
     int   m_Port;
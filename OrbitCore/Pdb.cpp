@@ -23,17 +23,45 @@
 #include "OrbitUnreal.h"
 #include "DiaManager.h"
 #include "ObjectCount.h"
+#include "CacheFile.h"
+#include "ElfFile.h"
 
 #include "dia2dump.h"
 #include "PrintSymbol.h"
 
 std::shared_ptr<Pdb> GPdbDbg;
+static thread_local Pdb* GParsingPdb = nullptr;
+
+//-----------------------------------------------------------------------------
+// Bump SYMBOL_CACHE_VERSION whenever Function, Type or Variable serialization
+// changes, older cache files are then ignored and rewritten.
+static const char     SYMBOL_CACHE_MAGIC[4] = { 'O', 'R', 'B', 'S' };
+static const uint32_t SYMBOL_CACHE_VERSION = 2;
+
+//-----------------------------------------------------------------------------
+Pdb* GetParsingPdb()
+{
+    return GParsingPdb ? GParsingPdb : GPdbDbg.get();
+}
+
+//-----------------------------------------------------------------------------
+ScopeParsingPdb::ScopeParsingPdb( Pdb* a_Pdb ) : m_PreviousPdb( GParsingPdb )
+{
+    GParsingPdb = a_Pdb;
+}
+
+//-----------------------------------------------------------------------------
+ScopeParsingPdb::~ScopeParsingPdb()
+{
+    GParsingPdb = m_PreviousPdb;
+}
 
 //-----------------------------------------------------------------------------
 Pdb::Pdb( const wchar_t* a_PdbName ) : m_FileName( a_PdbName )
                                      , m_MainModule(0)
                                      , m_LastLoadTime(0)
                                      , m_LoadedFromCache(false)
+                                     , m_HasLineInfo(false)
                                      , m_FinishedLoading(false)
                                      , m_IsLoading(false)
                                      , m_IsPopulatingFunctionMap(false)
@@ -227,18 +255,54 @@ std::wstring Pdb::GetCachedKey()
 }
 
 //-----------------------------------------------------------------------------
-bool Pdb::Load( const std::string & a_CachedPdb )
+void Pdb::ReadSignature()
 {
-    /*ifstream is( a_CachedPdb, std::ios::binary );
-    if( !is.fail() )
+    if( m_DiaGlobalSymbol )
     {
-        cereal::BinaryInputArchive Ar( is );
-        Ar(*this);
-        m_LoadedFromCache = true;
-        return true;
-    }*/
+        m_DiaGlobalSymbol->get_guid( &m_ModuleInfo.PdbSig70 );
+        m_DiaGlobalSymbol->get_age( &m_ModuleInfo.PdbAge );
+    }
+}
 
-    return false;
+//-----------------------------------------------------------------------------
+bool Pdb::HasSignature() const
+{
+    const GUID nullGuid = { 0 };
+    return memcmp( &m_ModuleInfo.PdbSig70, &nullGuid, sizeof( GUID ) ) != 0;
+}
+
+//-----------------------------------------------------------------------------
+bool Pdb::Load( const std::wstring & a_CachedPdb )
+{
+    if( !Path::FileExists( a_CachedPdb ) )
+    {
+        return false;
+    }
+
+    SCOPE_TIMER_LOG( Format( L"Loading %s", a_CachedPdb.c_str() ) );
+
+    if( !CacheFile::Load( a_CachedPdb, SYMBOL_CACHE_MAGIC, SYMBOL_CACHE_VERSION, *this ) )
+    {
+        m_Functions.clear();
+        m_Types.clear();
+        m_Globals.clear();
+        m_HasLineInfo = false;
+        return false;
+    }
+
+    for( Function & function : m_Functions )
+    {
+        CheckOrbitFunction( function );
+    }
+
+    m_TypeMap.reserve( m_Types.size() );
+    for( const Type & type : m_Types )
+    {
+        m_TypeMap[type.m_Id] = type;
+    }
+
+    m_LoadedFromCache = true;
+    return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -250,10 +314,6 @@ void Pdb::Update()
         m_FinishedLoading = false;
         Print();
         
-        if( !m_LoadedFromCache && false )
-        {
-            Save();
-        }
     }
 
     if( m_IsLoading )
@@ -457,6 +517,29 @@ bool Pdb::LoadPdb( const wchar_t* a_PdbName )
 {
     SCOPE_TIMER_LOG( L"LOAD PDB" );
 
+    ParseSymbols( a_PdbName, true );
+    ProcessData();
+    OnSymbolsLoaded();
+
+    if( !m_LoadedFromCache )
+    {
+        Save();
+    }
+
+    m_FinishedLoading = true;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void Pdb::ParseSymbols( const wchar_t* a_PdbName, bool a_ParallelDump )
+{
+    if( m_FileName != a_PdbName )
+    {
+        m_FileName = a_PdbName;
+        m_Name = Path::GetFileName( m_FileName );
+    }
+
     m_IsLoading = true;
     m_LoadTimer->Start();
 
@@ -468,22 +551,33 @@ bool Pdb::LoadPdb( const wchar_t* a_PdbName )
     if( ToLower( Path::GetExtension( a_PdbName ) ) == L".dll" )
     {
         SCOPE_TIMER_LOG( L"LoadDll Exports" );
+        ScopeParsingPdb parsingPdb( this );
         ParseDll( nameStr.c_str() );
     }
-    else
+    else if( ToLower( Path::GetExtension( a_PdbName ) ) == L".pdb" || !LoadElf( a_ParallelDump ) )
     {
-        SCOPE_TIMER_LOG( L"LoadPdbDia" );
-        LoadPdbDia();
+        ReadSignature();
+
+        if( !HasSignature() || !Load( Path::GetCachePath() + GetCachedName() ) )
+        {
+            SCOPE_TIMER_LOG( L"LoadPdbDia" );
+            LoadPdbDia( a_ParallelDump );
+        }
     }
 
     ShowSymbolInfo( m_ModuleInfo );
-    ProcessData();
-    GParams.AddToPdbHistory( ws2s(a_PdbName).c_str() );
+    SetLoadTime( (float)m_LoadTimer->QueryMillis() );
+}
+
+//-----------------------------------------------------------------------------
+void Pdb::OnSymbolsLoaded()
+{
+    GParams.AddToPdbHistory( ws2s(m_FileName).c_str() );
 
-    m_FinishedLoading = true;
     m_IsLoading = false;
 
-    return true;
+    // Functions of this module are now visible to address lookups
+    Capture::GTargetProcess->InvalidateFunctionIndex();
 }
 
 //-----------------------------------------------------------------------------
@@ -500,16 +594,29 @@ bool Pdb::LoadDataFromPdb()
 }
 
 //-----------------------------------------------------------------------------
-bool Pdb::LoadPdbDia()
+bool Pdb::LoadPdbDia( bool a_ParallelDump )
 {
     if( m_DiaGlobalSymbol )
     {
         Reserve();
-        auto group = oqpi_tk::make_parallel_group<oqpi::task_type::waitable>( "Fork" );
-        group->addTask( oqpi_tk::make_task_item( "DumpAllFunctions"  , DumpAllFunctions  , m_DiaGlobalSymbol ) );
-        group->addTask( oqpi_tk::make_task_item( "DumpTypes"         , DumpTypes         , m_DiaGlobalSymbol ) );
-        group->addTask( oqpi_tk::make_task_item( "HookDumpAllGlobals", OrbitDumpAllGlobals, m_DiaGlobalSymbol ) );
-        oqpi_tk::schedule_task( oqpi::task_handle( group ) ).wait();
+
+        if( a_ParallelDump )
+        {
+            Pdb* pdb = this;
+            auto group = oqpi_tk::make_parallel_group<oqpi::task_type::waitable>( "Fork" );
+            group->addTask( oqpi_tk::make_task_item( "DumpAllFunctions"  , [pdb]( IDiaSymbol* a_Global ){ ScopeParsingPdb parsingPdb( pdb ); DumpAllFunctions( a_Global ); }   , m_DiaGlobalSymbol ) );
+            group->addTask( oqpi_tk::make_task_item( "DumpTypes"         , [pdb]( IDiaSymbol* a_Global ){ ScopeParsingPdb parsingPdb( pdb ); DumpTypes( a_Global ); }          , m_DiaGlobalSymbol ) );
+            group->addTask( oqpi_tk::make_task_item( "HookDumpAllGlobals", [pdb]( IDiaSymbol* a_Global ){ ScopeParsingPdb parsingPdb( pdb ); OrbitDumpAllGlobals( a_Global ); }, m_DiaGlobalSymbol ) );
+            oqpi_tk::schedule_task( oqpi::task_handle( group ) ).wait();
+        }
+        else
+        {
+            // Already running on a worker, waiting on nested tasks could starve the scheduler
+            ScopeParsingPdb parsingPdb( this );
+            DumpAllFunctions( m_DiaGlobalSymbol );
+            DumpTypes( m_DiaGlobalSymbol );
+            OrbitDumpAllGlobals( m_DiaGlobalSymbol );
+        }
 
         return true;
     }
@@ -517,6 +624,60 @@ bool Pdb::LoadPdbDia()
     return false;
 }
 
+//-----------------------------------------------------------------------------
+bool Pdb::LoadElf( bool a_ParallelDump )
+{
+    std::unique_ptr<ElfFile> elfFile = std::make_unique<ElfFile>();
+    if( !elfFile->Open( m_FileName ) )
+    {
+        if( !elfFile->GetError().empty() )
+        {
+            ORBIT_LOG( Format( L"%s: %s\n", m_FileName.c_str(), s2ws( elfFile->GetError() ).c_str() ) );
+        }
+        return false;
+    }
+
+    SCOPE_TIMER_LOG( L"LoadElf" );
+
+    elfFile->LoadSymbols();
+    bool hasLineInfo = elfFile->LoadLineTables( a_ParallelDump );
+    if( !elfFile->GetError().empty() )
+    {
+        ORBIT_LOG( Format( L"%s: %s\n", m_FileName.c_str(), s2ws( elfFile->GetError() ).c_str() ) );
+    }
+
+    ORBIT_LOG( Format( L"%s: %u symbols, %u line rows from %u units (%u failed)\n", m_FileName.c_str()
+                     , (uint32_t)elfFile->GetSymbols().size(), (uint32_t)elfFile->GetNumLineRows()
+                     , elfFile->GetNumLineUnits(), elfFile->GetNumFailedLineUnits() ) );
+
+    const std::vector<ElfSymbol> & symbols = elfFile->GetSymbols();
+    m_Functions.reserve( symbols.size() );
+
+    std::string file;
+    uint32_t line = 0;
+    for( const ElfSymbol & symbol : symbols )
+    {
+        Function function;
+        function.m_Name = s2ws( symbol.m_Name );
+        function.m_PrettyName = s2ws( symbol.m_PrettyName );
+        function.m_Address = symbol.m_Rva;
+        function.m_Size = (ULONG)symbol.m_Size;
+
+        if( hasLineInfo && elfFile->FindLine( symbol.m_Rva, file, line ) )
+        {
+            function.m_File = s2ws( file );
+            function.m_Line = line;
+        }
+
+        AddFunction( function );
+    }
+
+    // DbgHelp knows nothing about this module, don't let FindFile overwrite lines
+    m_HasLineInfo = true;
+    m_ElfFile = std::move( elfFile );
+    return true;
+}
+
 //-----------------------------------------------------------------------------
 void Pdb::LoadPdbAsync( const wchar_t* a_PdbName, std::function<void()> a_CompletionCallback )
 {
@@ -668,6 +829,21 @@ std::shared_ptr<OrbitDiaSymbol> Pdb::SymbolFromAddress( DWORD64 a_Address )
 //-----------------------------------------------------------------------------
 bool Pdb::LineInfoFromAddress( DWORD64 a_Address, LineInfo & o_LineInfo )
 {
+    if( m_ElfFile )
+    {
+        std::string file;
+        uint32_t line = 0;
+        if( !m_ElfFile->FindLine( a_Address - (DWORD64)GetHModule(), file, line ) )
+        {
+            return false;
+        }
+
+        o_LineInfo.m_Address = a_Address;
+        o_LineInfo.m_File = s2ws( file );
+        o_LineInfo.m_Line = line;
+        return true;
+    }
+
     if( !m_DiaSession )
     {
         return false;
@@ -747,13 +923,14 @@ void Pdb::ProcessData()
         GOrbitUnreal.OnFunctionAdded( &func );
     }
 
-    if( GParams.m_FindFileAndLineInfo )
+    if( GParams.m_FindFileAndLineInfo && !m_HasLineInfo )
     {
         SCOPE_TIMER_LOG(L"Find File and Line info");
         for( Function & func : m_Functions )
         {
             func.FindFile();
         }
+        m_HasLineInfo = true;
     }
 
     for( Type & type : m_Types )
@@ -782,11 +959,22 @@ void Pdb::ProcessData()
 //-----------------------------------------------------------------------------
 void Pdb::Save()
 {
+    if( !HasSignature() )
+    {
+        return;
+    }
+
     std::wstring fullName = Path::GetCachePath() + GetCachedName();
 
     SCOPE_TIMER_LOG( Format( L"Saving %s", fullName.c_str() ) );
+    CacheFile::Save( fullName, SYMBOL_CACHE_MAGIC, SYMBOL_CACHE_VERSION, *this );
+}
 
-    //ofstream os( fullName, std::ios::binary );
-    //cereal::BinaryOutputArchive Ar(os);
-    //Ar( *this );
+//-----------------------------------------------------------------------------
+ORBIT_SERIALIZE( Pdb, 0 )
+{
+    ORBIT_NVP_VAL( 0, m_Functions );
+    ORBIT_NVP_VAL( 0, m_Types );
+    ORBIT_NVP_VAL( 0, m_Globals );
+    ORBIT_NVP_VAL( 0, m_HasLineInfo );
 }
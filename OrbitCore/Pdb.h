@@ -6,6 +6,7 @@
 #include "OrbitDbgHelp.h"
 #include "OrbitType.h"
 #include "Variable.h"
+#include "SerializationMacros.h"
 
 #include <vector>
 #include <functional>
@@ -15,6 +16,7 @@
 struct IDiaSymbol;
 struct IDiaSession;
 struct IDiaDataSource;
+class ElfFile;
 
 class Pdb
 {
@@ -27,8 +29,14 @@ public:
     virtual bool LoadPdb( const wchar_t* a_PdbName );
     virtual void LoadPdbAsync( const wchar_t* a_PdbName, std::function<void()> a_CompletionCallback );
 
+    // Two halves of LoadPdb, lets ModuleManager parse modules concurrently
+    // and publish them to the process in one go.
+    void ParseSymbols( const wchar_t* a_PdbName, bool a_ParallelDump );
+    void OnSymbolsLoaded();
+
     bool LoadDataFromPdb();
-    bool LoadPdbDia();
+    bool LoadPdbDia( bool a_ParallelDump = true );
+    bool LoadElf( bool a_ParallelDump = true );
     void Update();
     void AddFunction( Function & a_Function );
     void CheckOrbitFunction( Function & a_Function );
@@ -68,30 +76,24 @@ public:
     void SetLoadTime( float a_LoadTime ) { m_LastLoadTime = a_LoadTime; }
     float GetLoadTime() { return m_LastLoadTime; }
 
+    // Symbol cache, files are keyed by pdb guid and age so that a rebuilt
+    // module never picks up stale symbols.
     std::wstring GetCachedName();
     std::wstring GetCachedKey();
-    bool Load( const std::string & a_CachedPdb );
+    bool HasSignature() const;
+    bool Load( const std::wstring & a_CachedPdb );
     void Save();
+    bool IsLoadedFromCache() const { return m_LoadedFromCache; }
 
     bool IsLoading() const { return m_IsLoading; }
 
-    template <class Archive>
-    void serialize( Archive & ar, std::uint32_t const version )
-    {
-        /*ar( CEREAL_NVP(m_Name)
-          , CEREAL_NVP(m_FileName)
-          , CEREAL_NVP(m_FileNameW)
-          , CEREAL_NVP(m_Functions)
-          , CEREAL_NVP(m_Types)
-          , CEREAL_NVP(m_Globals)
-          , CEREAL_NVP(m_ModuleInfo)
-          , CEREAL_NVP(m_TypeMap) );*/
-    }
+    ORBIT_SERIALIZABLE;
 
     std::shared_ptr<OrbitDiaSymbol> GetDiaSymbolFromId(ULONG a_Id);
     void ProcessData();
 protected:
     void SendStatusToUi();
+    void ReadSignature();
 
 protected:
     // State
@@ -104,6 +106,7 @@ protected:
     HMODULE                             m_MainModule;
     float                               m_LastLoadTime;
     bool                                m_LoadedFromCache;
+    bool                                m_HasLineInfo;
     std::vector< Variable >             m_WatchedVariables;
     std::set<std::string>               m_ArgumentRegisters;
     std::map<std::string, std::vector< std::string > >  m_RegFunctionsMap;
@@ -124,7 +127,22 @@ protected:
     IDiaSession*                        m_DiaSession;
     IDiaSymbol*                         m_DiaGlobalSymbol;
     IDiaDataSource*	                    m_DiaDataSource;
+
+    // Native backend, set when the module is an ELF file
+    std::unique_ptr<ElfFile>            m_ElfFile;
 };
 
 extern std::shared_ptr<Pdb> GPdbDbg;
 
+// Pdb receiving the symbols parsed by DIA and peparse on the calling thread,
+// GPdbDbg when no ScopeParsingPdb is active.
+Pdb* GetParsingPdb();
+
+//-----------------------------------------------------------------------------
+struct ScopeParsingPdb
+{
+    ScopeParsingPdb( Pdb* a_Pdb );
+    ~ScopeParsingPdb();
+    Pdb* m_PreviousPdb;
+};
+
@@ -0,0 +1,328 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "PerfEventSampler.h"
+
+#if defined(__linux__)
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+PerfEventSampler::PerfEventSampler() : m_PID( 0 )
+                                     , m_FrequencyHz( 0 )
+                                     , m_PageSize( 0 )
+                                     , m_DataSize( 0 )
+                                     , m_NumSamples( 0 )
+                                     , m_NumLost( 0 )
+                                     , m_NumCorruptRecords( 0 )
+                                     , m_NumFailedThreads( 0 )
+                                     , m_LastErrno( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+PerfEventSampler::~PerfEventSampler()
+{
+    Close();
+}
+
+#if defined(__linux__)
+//-----------------------------------------------------------------------------
+bool PerfEventSampler::IsSupported()
+{
+    return access( "/proc/sys/kernel/perf_event_paranoid", F_OK ) == 0;
+}
+
+//-----------------------------------------------------------------------------
+bool PerfEventSampler::Open( uint32_t a_PID, uint32_t a_FrequencyHz, uint32_t a_NumPages )
+{
+    Close();
+
+    if( a_NumPages == 0 || ( a_NumPages & ( a_NumPages - 1 ) ) != 0 )
+    {
+        m_LastErrno = EINVAL;
+        return false;
+    }
+
+    m_PID = a_PID;
+    m_FrequencyHz = a_FrequencyHz;
+    m_PageSize = (size_t)sysconf( _SC_PAGESIZE );
+    m_DataSize = m_PageSize * a_NumPages;
+    m_NumSamples = 0;
+    m_NumLost = 0;
+    m_NumCorruptRecords = 0;
+    m_NumFailedThreads = 0;
+    m_LastErrno = 0;
+
+    UpdateThreads();
+    return IsOpen();
+}
+
+//-----------------------------------------------------------------------------
+void PerfEventSampler::Close()
+{
+    for( ThreadEvent & event : m_Events )
+    {
+        CloseThread( event );
+    }
+
+    m_Events.clear();
+    m_SeenThreads.clear();
+}
+
+//-----------------------------------------------------------------------------
+void PerfEventSampler::UpdateThreads()
+{
+    std::string taskDir = "/proc/" + std::to_string( m_PID ) + "/task";
+    DIR* dir = opendir( taskDir.c_str() );
+    if( dir == nullptr )
+    {
+        return;
+    }
+
+    while( dirent* entry = readdir( dir ) )
+    {
+        if( entry->d_name[0] < '0' || entry->d_name[0] > '9' )
+        {
+            continue;
+        }
+
+        ThreadID tid = (ThreadID)strtoul( entry->d_name, nullptr, 10 );
+        if( m_SeenThreads.insert( tid ).second && !OpenThread( tid ) )
+        {
+            ++m_NumFailedThreads;
+            m_LastErrno = errno;
+        }
+    }
+
+    closedir( dir );
+}
+
+//-----------------------------------------------------------------------------
+bool PerfEventSampler::OpenThread( ThreadID a_TID )
+{
+    perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr ) );
+    attr.size = sizeof( attr );
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = m_FrequencyHz;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+    attr.use_clockid = 1;
+    attr.clockid = CLOCK_MONOTONIC;
+
+    // Wake up the reader when the buffer is a quarter full
+    attr.watermark = 1;
+    attr.wakeup_watermark = (uint32_t)( m_DataSize / 4 );
+
+    int fd = (int)syscall( __NR_perf_event_open, &attr, (pid_t)a_TID, -1, -1, PERF_FLAG_FD_CLOEXEC );
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    // Metadata page followed by the data pages
+    void* mapping = mmap( nullptr, m_PageSize + m_DataSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( mapping == MAP_FAILED )
+    {
+        close( fd );
+        return false;
+    }
+
+    ThreadEvent event;
+    event.m_TID = a_TID;
+    event.m_Fd = fd;
+    event.m_Mapping = (char*)mapping;
+    m_Events.push_back( event );
+
+    ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void PerfEventSampler::CloseThread( ThreadEvent & a_Event )
+{
+    if( a_Event.m_Fd >= 0 )
+    {
+        ioctl( a_Event.m_Fd, PERF_EVENT_IOC_DISABLE, 0 );
+        munmap( a_Event.m_Mapping, m_PageSize + m_DataSize );
+        close( a_Event.m_Fd );
+        a_Event.m_Fd = -1;
+        a_Event.m_Mapping = nullptr;
+    }
+}
+
+//-----------------------------------------------------------------------------
+size_t PerfEventSampler::Poll( const SampleCallback & a_Callback, int a_TimeoutMs )
+{
+    std::vector< pollfd > fds( m_Events.size() );
+    for( size_t i = 0; i < m_Events.size(); ++i )
+    {
+        fds[i].fd = m_Events[i].m_Fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+
+    if( a_TimeoutMs > 0 && !fds.empty() )
+    {
+        poll( fds.data(), fds.size(), a_TimeoutMs );
+    }
+
+    // Drain every buffer, low rate threads never reach the watermark
+    size_t numSamples = 0;
+    for( ThreadEvent & event : m_Events )
+    {
+        numSamples += ReadRingBuffer( event, a_Callback );
+    }
+
+    // Exited threads hang up once their buffer has been read
+    for( size_t i = m_Events.size(); i-- > 0; )
+    {
+        if( fds[i].revents & POLLHUP )
+        {
+            CloseThread( m_Events[i] );
+            m_Events[i] = m_Events.back();
+            m_Events.pop_back();
+        }
+    }
+
+    return numSamples;
+}
+
+//-----------------------------------------------------------------------------
+size_t PerfEventSampler::ReadRingBuffer( ThreadEvent & a_Event, const SampleCallback & a_Callback )
+{
+    perf_event_mmap_page* metadata = (perf_event_mmap_page*)a_Event.m_Mapping;
+    const char* data = a_Event.m_Mapping + m_PageSize;
+
+    uint64_t head = __atomic_load_n( &metadata->data_head, __ATOMIC_ACQUIRE );
+    uint64_t tail = metadata->data_tail;
+    size_t numSamples = 0;
+
+    while( tail < head )
+    {
+        // Records are 8 byte aligned so headers never wrap, payloads can
+        size_t offset = (size_t)( tail & ( m_DataSize - 1 ) );
+        const perf_event_header* header = (const perf_event_header*)( data + offset );
+        const char* record = data + offset;
+
+        // A torn or corrupt record can't be skipped, drop everything written so far
+        if( header->size < sizeof( perf_event_header ) || header->size > head - tail )
+        {
+            ++m_NumCorruptRecords;
+            tail = head;
+            break;
+        }
+
+        if( offset + header->size > m_DataSize )
+        {
+            size_t firstPart = m_DataSize - offset;
+            m_Record.resize( header->size );
+            memcpy( m_Record.data(), record, firstPart );
+            memcpy( m_Record.data() + firstPart, data, header->size - firstPart );
+            record = m_Record.data();
+        }
+
+        if( header->type == PERF_RECORD_SAMPLE )
+        {
+            // PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN
+            struct SampleRecord
+            {
+                perf_event_header m_Header;
+                uint32_t          m_PID;
+                uint32_t          m_TID;
+                uint64_t          m_Time;
+                uint64_t          m_NumFrames;
+            };
+
+            const SampleRecord* sample = (const SampleRecord*)record;
+            const uint64_t* frames = (const uint64_t*)( sample + 1 );
+            uint64_t numFrames = header->size >= sizeof( SampleRecord ) ? sample->m_NumFrames : 0;
+            numFrames = std::min<uint64_t>( numFrames, ( header->size - std::min<size_t>( header->size, sizeof( SampleRecord ) ) ) / sizeof( uint64_t ) );
+
+            // Skip context markers, the kernel part of the chain is excluded
+            m_Frames.clear();
+            for( uint64_t i = 0; i < numFrames && m_Frames.size() < ORBIT_STACK_SIZE; ++i )
+            {
+                if( frames[i] < (uint64_t)PERF_CONTEXT_MAX )
+                {
+                    m_Frames.push_back( frames[i] );
+                }
+            }
+
+            if( !m_Frames.empty() )
+            {
+                a_Callback( (ThreadID)sample->m_TID, sample->m_Time, m_Frames.data(), (uint32_t)m_Frames.size() );
+                ++numSamples;
+            }
+        }
+        else if( header->type == PERF_RECORD_LOST )
+        {
+            struct LostRecord
+            {
+                perf_event_header m_Header;
+                uint64_t          m_Id;
+                uint64_t          m_NumLost;
+            };
+
+            m_NumLost += ( (const LostRecord*)record )->m_NumLost;
+        }
+
+        tail += header->size;
+    }
+
+    __atomic_store_n( &metadata->data_tail, tail, __ATOMIC_RELEASE );
+    m_NumSamples += numSamples;
+    return numSamples;
+}
+
+#else
+//-----------------------------------------------------------------------------
+bool PerfEventSampler::IsSupported()
+{
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool PerfEventSampler::Open( uint32_t, uint32_t, uint32_t )
+{
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+void PerfEventSampler::Close()
+{
+    m_Events.clear();
+    m_SeenThreads.clear();
+}
+
+//-----------------------------------------------------------------------------
+void PerfEventSampler::UpdateThreads()
+{
+}
+
+//-----------------------------------------------------------------------------
+size_t PerfEventSampler::Poll( const SampleCallback &, int )
+{
+    return 0;
+}
+#endif
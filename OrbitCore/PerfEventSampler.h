@@ -0,0 +1,77 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "CallstackTypes.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Samples every thread of a Linux process with perf_event_open. Each thread
+// gets a cpu-clock software event whose samples, with the user callchain
+// walked by the kernel, are written to its own mmap'ed ring buffer. The
+// target threads are never suspended and the rate is only bounded by
+// kernel.perf_event_max_sample_rate. Other platforms report IsSupported()
+// false and callers fall back to their own sampling. Only depends on the
+// standard and Linux headers, see CMakeLists.txt for the Linux build.
+class PerfEventSampler
+{
+public:
+    typedef std::function< void( ThreadID a_TID, uint64_t a_TimeNs, const uint64_t* a_Frames, uint32_t a_Depth ) > SampleCallback;
+
+    PerfEventSampler();
+    ~PerfEventSampler();
+
+    static bool IsSupported();
+
+    // a_NumPages is the ring buffer size per thread and must be a power of two
+    bool Open( uint32_t a_PID, uint32_t a_FrequencyHz, uint32_t a_NumPages = 64 );
+    void Close();
+    bool IsOpen() const { return !m_Events.empty(); }
+
+    // Opens events for threads created since the last call
+    void UpdateThreads();
+
+    // Waits up to a_TimeoutMs for data, then drains all ring buffers on the
+    // calling thread. Returns the number of samples passed to a_Callback.
+    size_t Poll( const SampleCallback & a_Callback, int a_TimeoutMs );
+
+    uint32_t GetNumThreads() const  { return (uint32_t)m_Events.size(); }
+    uint64_t GetNumSamples() const  { return m_NumSamples; }
+    uint64_t GetNumLost() const     { return m_NumLost; }
+    uint64_t GetNumCorruptRecords() const { return m_NumCorruptRecords; }
+    uint32_t GetNumFailedThreads() const { return m_NumFailedThreads; }
+    int      GetLastErrno() const   { return m_LastErrno; }
+
+protected:
+    struct ThreadEvent
+    {
+        ThreadID m_TID;
+        int      m_Fd;
+        char*    m_Mapping;
+    };
+
+    bool   OpenThread( ThreadID a_TID );
+    void   CloseThread( ThreadEvent & a_Event );
+    size_t ReadRingBuffer( ThreadEvent & a_Event, const SampleCallback & a_Callback );
+
+protected:
+    uint32_t                                m_PID;
+    uint32_t                                m_FrequencyHz;
+    size_t                                  m_PageSize;
+    size_t                                  m_DataSize;
+    std::vector< ThreadEvent >              m_Events;
+    std::unordered_set< ThreadID >          m_SeenThreads;
+    std::vector< char >                     m_Record;
+    std::vector< uint64_t >                 m_Frames;
+    uint64_t                                m_NumSamples;
+    uint64_t                                m_NumLost;
+    uint64_t                                m_NumCorruptRecords;
+    uint32_t                                m_NumFailedThreads; // perf_event_open failures
+    int                                     m_LastErrno;
+};
@@ -33,3 +33,11 @@ inline TickType TicksFromMicroseconds( double a_Micros )
 {
     return (TickType)(GFrequency*a_Micros*0.000001);
 }
+
+//-----------------------------------------------------------------------------
+// Integer math so that large timestamps (e.g. CLOCK_MONOTONIC) stay exact
+inline TickType TicksFromNanoseconds( uint64_t a_Nanos )
+{
+    const uint64_t nanosPerSecond = 1000000000;
+    return ( a_Nanos / nanosPerSecond ) * GFrequency + ( a_Nanos % nanosPerSecond ) * GFrequency / nanosPerSecond;
+}
@@ -11,9 +11,13 @@
 #include "OrbitThread.h"
 #include <set>
 #include <map>
+#include <unordered_set>
 #include "dia2.h"
 #include "Serialization.h"
 #include "OrbitModule.h"
+#include "SymbolCache.h"
+#include "PerfEventSampler.h"
+#include "EventTracer.h"
 
 double GThreadUsageSamplePeriodMs = 200.0;
 
@@ -21,6 +25,7 @@ double GThreadUsageSamplePeriodMs = 200.0;
 SamplingProfiler::SamplingProfiler( const std::shared_ptr<Process> & a_Process, bool a_ETW )
     : m_Process(a_Process)
     , m_PeriodMs(1)
+    , m_PerfFrequencyHz(4000)
     , m_State(Idle)
     , m_SampleTimeSeconds(FLT_MAX)
     , m_ETW( a_ETW )
@@ -34,6 +39,7 @@ SamplingProfiler::SamplingProfiler( const std::shared_ptr<Process> & a_Process,
 SamplingProfiler::SamplingProfiler()
     : m_Process( nullptr )
     , m_PeriodMs( 1 )
+    , m_PerfFrequencyHz( 4000 )
     , m_State( Idle )
     , m_SampleTimeSeconds( FLT_MAX )
     , m_ETW( false )
@@ -55,7 +61,7 @@ void SamplingProfiler::StartCapture()
     Capture::GNumSamplingTicks = 0;
     Capture::GIsSampling = true;
 
-    if( !m_ETW )
+    if( !m_ETW && !StartPerfEventSampling() )
     {
         m_Process->EnumerateThreads();
         m_Process->SortThreadsByUsage();
@@ -112,6 +118,66 @@ void SamplingProfiler::SampleThreadsAsync()
     ProcessSamples();
 }
 
+//-----------------------------------------------------------------------------
+bool SamplingProfiler::StartPerfEventSampling()
+{
+    if( !PerfEventSampler::IsSupported() )
+    {
+        return false;
+    }
+
+    m_PerfEventSampler = std::make_unique<PerfEventSampler>();
+    if( !m_PerfEventSampler->Open( m_Process->GetID(), m_PerfFrequencyHz ) )
+    {
+        ORBIT_LOG( Format( "perf_event_open sampling unavailable for pid %u (errno %i), suspending threads instead\n"
+                         , m_Process->GetID(), m_PerfEventSampler->GetLastErrno() ) );
+        m_PerfEventSampler = nullptr;
+        return false;
+    }
+
+    m_SamplingThread = std::make_unique<std::thread>( &SamplingProfiler::SamplePerfEventsAsync, this );
+    m_SamplingThread->detach();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void SamplingProfiler::SamplePerfEventsAsync()
+{
+    // The kernel unwinds and buffers the samples, this thread only drains
+    // the ring buffers and interns the callstacks. Samples keep the kernel's
+    // CLOCK_MONOTONIC timestamp, like ETW stack walk events.
+    auto onSample = [this]( ThreadID a_TID, uint64_t a_TimeNs, const uint64_t* a_Frames, uint32_t a_Depth )
+    {
+        uint32_t index = m_CallstackTable.Intern( a_Frames, (int)a_Depth );
+        AddSample( a_TID, index );
+        GEventTracer.GetEventBuffer().AddCallstackEvent( CallstackEvent( (long long)TicksFromNanoseconds( a_TimeNs ), m_CallstackTable.GetHash( index ), a_TID ) );
+        ++Capture::GNumSamples;
+    };
+
+    while( m_State != PendingStop )
+    {
+        if( m_ThreadUsageTimer.QueryMillis() > GThreadUsageSamplePeriodMs )
+        {
+            m_PerfEventSampler->UpdateThreads();
+            m_ThreadUsageTimer.Start();
+        }
+
+        ++Capture::GNumSamplingTicks;
+        m_PerfEventSampler->Poll( onSample, 10 );
+    }
+
+    m_PerfEventSampler->Poll( onSample, 0 );
+
+    ORBIT_LOG( Format( "perf_event sampling: %llu samples, %llu lost, %llu corrupt, %u threads failed to open (last errno %i)\n"
+                     , m_PerfEventSampler->GetNumSamples(), m_PerfEventSampler->GetNumLost(), m_PerfEventSampler->GetNumCorruptRecords()
+                     , m_PerfEventSampler->GetNumFailedThreads(), m_PerfEventSampler->GetLastErrno() ) );
+
+    m_PerfEventSampler->Close();
+    m_PerfEventSampler = nullptr;
+
+    ProcessSamples();
+}
+
 //-----------------------------------------------------------------------------
 void SamplingProfiler::GetThreadsUsage()
 {
@@ -260,87 +326,158 @@ void SamplingProfiler::ProcessSamplesAsync()
 }
 
 
+//-----------------------------------------------------------------------------
+// Per worker results of ProcessAddresses.
+struct ResolvePartial
+{
+    std::unordered_map< CallstackID, std::shared_ptr<CallStack> > m_UniqueResolvedCallstacks;
+    std::vector< std::pair< CallstackID, CallstackID > >          m_RawToResolved;
+    std::unordered_map< DWORD64, std::vector< CallstackID > >     m_FunctionToCallstacks;
+};
+
 //-----------------------------------------------------------------------------
 void SamplingProfiler::ProcessSamples()
 {
-    unsigned int numAddressesTotal = 0;
+    SCOPE_TIMER_LOG( L"SamplingProfiler::ProcessSamples" );
 
     m_State = Processing;
 
-    // Unique call stacks and per thread data
-    for( CallStack & callstack : m_Callstacks )
+    // Callstack counts, one task per thread
     {
-        callstack.Hash();
-        auto it = m_UniqueCallstacks.find( callstack.m_Hash );
-        if( it == m_UniqueCallstacks.end() )
+        SCOPE_TIMER_LOG( L"Callstack counts" );
+
+        std::vector< std::pair< ThreadSampleData*, const std::vector<uint32_t>* > > threadSamples;
+        threadSamples.reserve( m_ThreadSamples.size() );
+        for( auto & pair : m_ThreadSamples )
         {
-            m_UniqueCallstacks[callstack.m_Hash] = std::make_shared<CallStack>(callstack);
+            threadSamples.push_back( std::make_pair( &m_ThreadSampleData[pair.first], &pair.second ) );
         }
 
-        ThreadSampleData & threadSampleData = m_ThreadSampleData[callstack.m_ThreadId];
-        threadSampleData.m_NumSamples++;
-        threadSampleData.m_CallstackCount[callstack.m_Hash]++;
-        numAddressesTotal += callstack.m_Depth;
+        oqpi_tk::parallel_for( "CountCallstacks", (int32_t)threadSamples.size(), [&]( int32_t a_BlockIndex, int32_t a_ElementIndex )
+        {
+            ThreadSampleData & threadSampleData = *threadSamples[a_ElementIndex].first;
+            std::vector<uint32_t> samples = *threadSamples[a_ElementIndex].second;
+            std::sort( samples.begin(), samples.end() );
+
+            for( size_t i = 0; i < samples.size(); )
+            {
+                size_t runEnd = i + 1;
+                while( runEnd < samples.size() && samples[runEnd] == samples[i] )
+                    ++runEnd;
+
+                threadSampleData.m_CallstackCount[m_CallstackTable.GetHash( samples[i] )] += (unsigned int)( runEnd - i );
+                i = runEnd;
+            }
+
+            threadSampleData.m_NumSamples += (unsigned int)samples.size();
+        } );
 
         if( m_GenerateSummary )
         {
             ThreadSampleData & threadSampleDataAll = m_ThreadSampleData[0];
-            threadSampleDataAll.m_NumSamples++;
-            threadSampleDataAll.m_CallstackCount[callstack.m_Hash]++;
+            for( auto & pair : threadSamples )
+            {
+                const ThreadSampleData & threadSampleData = *pair.first;
+                threadSampleDataAll.m_NumSamples += (unsigned int)pair.second->size();
+                for( auto & countIt : threadSampleData.m_CallstackCount )
+                {
+                    threadSampleDataAll.m_CallstackCount[countIt.first] += countIt.second;
+                }
+            }
+        }
+
+        for( uint32_t i = 0; i < m_CallstackTable.Size(); ++i )
+        {
+            std::shared_ptr<CallStack> & callstack = m_UniqueCallstacks[m_CallstackTable.GetHash( i )];
+            if( !callstack )
+            {
+                callstack = std::make_shared<CallStack>( m_CallstackTable.GetCallStack( i ) );
+            }
         }
     }
 
     ProcessAddresses();
 
-    for( auto & dataIt : m_ThreadSampleData )
+    // Inclusive and exclusive counts, one task per thread
     {
-        ThreadID threadID = dataIt.first;
-        ThreadSampleData & threadSampleData = dataIt.second;
-        
-        threadSampleData.ComputeAverageThreadUsage();
+        SCOPE_TIMER_LOG( L"Thread sample data" );
 
-        // Address count per sample per thread
-        for( auto & stackCountIt : threadSampleData.m_CallstackCount )
+        std::vector< ThreadSampleData* > threadSampleDatas;
+        threadSampleDatas.reserve( m_ThreadSampleData.size() );
+        for( auto & dataIt : m_ThreadSampleData )
         {
-            const CallstackID callstackID = stackCountIt.first;
-            const unsigned int callstackCount = stackCountIt.second;
-
-            CallstackID resolvedCallstackID = m_RawToResolvedMap[callstackID];
-            std::shared_ptr<CallStack> & callstack = m_UniqueResolvedCallstacks[resolvedCallstackID];
-
-            // exclusive stat
-            threadSampleData.m_ExclusiveCount[ callstack->m_Data[0] ] += callstackCount;
-
-            std::set<DWORD64> uniqueAddresses;
-            for( int i = 0; i < callstack->m_Depth; ++i )
-            {
-                uniqueAddresses.insert(callstack->m_Data[i]);
-            }
-
-            for( DWORD64 address : uniqueAddresses )
-            {
-                threadSampleData.m_AddressCount[address] += callstackCount;
-            }
+            threadSampleDatas.push_back( &dataIt.second );
         }
 
-        // sort thread addresses by count
-        for( auto & addressCountIt : threadSampleData.m_AddressCount )
+        oqpi_tk::parallel_for( "ProcessThreadSampleData", (int32_t)threadSampleDatas.size(), [&]( int32_t a_BlockIndex, int32_t a_ElementIndex )
         {
-            const DWORD64 address = addressCountIt.first;
-            const unsigned int count = addressCountIt.second;
-            threadSampleData.m_AddressCountSorted.insert( std::make_pair(count, address) );
-        }
+            ProcessThreadSampleData( *threadSampleDatas[a_ElementIndex] );
+        } );
     }
 
     SortByThreadUsage();
 
-    OutputStats();
+    {
+        SCOPE_TIMER_LOG( L"Sample reports" );
+        OutputStats();
+    }
+
+    m_NumSamples = 0;
+    for( auto & pair : m_ThreadSamples )
+    {
+        m_NumSamples += (int)pair.second.size();
+    }
 
-    m_NumSamples = m_Callstacks.size();
-    m_Callstacks.clear();
+    m_ThreadSamples.clear();
+    m_CallstackTable.Clear();
     m_State = DoneProcessing;
 }
 
+//-----------------------------------------------------------------------------
+void SamplingProfiler::ProcessThreadSampleData( ThreadSampleData & a_ThreadSampleData )
+{
+    a_ThreadSampleData.ComputeAverageThreadUsage();
+
+    // Address count per sample per thread
+    std::vector< DWORD64 > uniqueAddresses;
+    for( auto & stackCountIt : a_ThreadSampleData.m_CallstackCount )
+    {
+        const CallstackID callstackID = stackCountIt.first;
+        const unsigned int callstackCount = stackCountIt.second;
+
+        // Only read shared maps, this runs concurrently for all threads
+        auto resolvedIt = m_RawToResolvedMap.find( callstackID );
+        if( resolvedIt == m_RawToResolvedMap.end() )
+            continue;
+
+        auto callstackIt = m_UniqueResolvedCallstacks.find( resolvedIt->second );
+        if( callstackIt == m_UniqueResolvedCallstacks.end() )
+            continue;
+
+        const CallStack & callstack = *callstackIt->second;
+
+        // exclusive stat
+        a_ThreadSampleData.m_ExclusiveCount[ callstack.m_Data[0] ] += callstackCount;
+
+        uniqueAddresses.assign( callstack.m_Data.begin(), callstack.m_Data.begin() + callstack.m_Depth );
+        std::sort( uniqueAddresses.begin(), uniqueAddresses.end() );
+        uniqueAddresses.erase( std::unique( uniqueAddresses.begin(), uniqueAddresses.end() ), uniqueAddresses.end() );
+
+        for( DWORD64 address : uniqueAddresses )
+        {
+            a_ThreadSampleData.m_AddressCount[address] += callstackCount;
+        }
+    }
+
+    // sort thread addresses by count
+    for( auto & addressCountIt : a_ThreadSampleData.m_AddressCount )
+    {
+        const DWORD64 address = addressCountIt.first;
+        const unsigned int count = addressCountIt.second;
+        a_ThreadSampleData.m_AddressCountSorted.insert( std::make_pair(count, address) );
+    }
+}
+
 //-----------------------------------------------------------------------------
 void ThreadSampleData::ComputeAverageThreadUsage()
 {
@@ -380,37 +517,108 @@ std::multimap< int, CallstackID > ThreadSampleData::SortCallstacks( const std::s
 //-----------------------------------------------------------------------------
 void SamplingProfiler::ProcessAddresses()
 {
+    const auto prio = oqpi::task_priority::normal;
+    auto numWorkers = oqpi_tk::scheduler().workersCount( prio );
+
+    std::vector< std::pair< CallstackID, const CallStack* > > callstacks;
+    callstacks.reserve( m_UniqueCallstacks.size() );
     for( const auto & it : m_UniqueCallstacks )
     {
-        CallstackID rawCallstackId = it.first;
-        const std::shared_ptr<CallStack> callstack = it.second;
-        CallStack ResolvedCallstack = *callstack;
+        callstacks.push_back( std::make_pair( it.first, it.second.get() ) );
+    }
+
+    // Symbol lookups go through dbghelp which is not thread safe, unique
+    // addresses are gathered in parallel and resolved in one sorted batch.
+    {
+        SCOPE_TIMER_LOG( L"Symbol lookups" );
 
-        for( int i = 0; i < callstack->m_Depth; ++i )
+        std::vector< std::unordered_set< DWORD64 > > addressSets( numWorkers );
+        oqpi_tk::parallel_for( "GatherAddresses", (int32_t)callstacks.size(), [&]( int32_t a_BlockIndex, int32_t a_ElementIndex )
         {
-            DWORD64 addr = callstack->m_Data[i];
-
-            if( m_ExactAddresses.find(addr) == m_ExactAddresses.end() )
+            const CallStack* callstack = callstacks[a_ElementIndex].second;
+            for( int i = 0; i < callstack->m_Depth; ++i )
             {
-                AddAddress(addr);
+                addressSets[a_BlockIndex].insert( callstack->m_Data[i] );
             }
+        } );
 
-            auto addrIt = m_ExactAddresses.find(addr);
-            if( addrIt != m_ExactAddresses.end() )
+        std::vector< DWORD64 > addresses;
+        for( const std::unordered_set< DWORD64 > & addressSet : addressSets )
+        {
+            for( DWORD64 addr : addressSet )
             {
-                const DWORD64 & functionAddr = addrIt->second;
-                ResolvedCallstack.m_Data[i] = functionAddr;
-                m_FunctionToCallstacks[functionAddr].insert( rawCallstackId );
+                if( m_ExactAddresses.find( addr ) == m_ExactAddresses.end() )
+                {
+                    addresses.push_back( addr );
+                }
             }
         }
 
-        CallstackID resolvedCallstackId = ResolvedCallstack.Hash();
-        if( m_UniqueResolvedCallstacks.find( resolvedCallstackId ) == m_UniqueResolvedCallstacks.end() )
+        if( m_Process )
         {
-            m_UniqueResolvedCallstacks[resolvedCallstackId] = std::make_shared<CallStack>(ResolvedCallstack);
+            ScopeLock lock( m_SymbolMutex );
+
+            GSymbolCache.Resolve( *m_Process, addresses
+                , [this]( DWORD64 a_Address, DWORD64 & o_FunctionAddress, CachedSymbol & o_Symbol ) { return ResolveAddress( a_Address, o_FunctionAddress, o_Symbol ); }
+                , [this]( DWORD64 a_Address, DWORD64 a_FunctionAddress, const CachedSymbol & a_Symbol ) { AddSymbol( a_Address, a_FunctionAddress, a_Symbol ); } );
+
+            GSymbolCache.Save();
         }
+        else
+        {
+            for( DWORD64 addr : addresses )
+            {
+                AddAddress( addr );
+            }
+        }
+    }
+
+    // Resolve callstacks to function addresses
+    {
+        SCOPE_TIMER_LOG( L"Resolve callstacks" );
+
+        std::vector< ResolvePartial > partials( numWorkers );
+        oqpi_tk::parallel_for( "ResolveCallstacks", (int32_t)callstacks.size(), [&]( int32_t a_BlockIndex, int32_t a_ElementIndex )
+        {
+            ResolvePartial & partial = partials[a_BlockIndex];
+            CallstackID rawCallstackId = callstacks[a_ElementIndex].first;
+            const CallStack* callstack = callstacks[a_ElementIndex].second;
+            CallStack ResolvedCallstack = *callstack;
 
-        m_RawToResolvedMap[rawCallstackId] = resolvedCallstackId;
+            for( int i = 0; i < callstack->m_Depth; ++i )
+            {
+                auto addrIt = m_ExactAddresses.find( callstack->m_Data[i] );
+                if( addrIt != m_ExactAddresses.end() )
+                {
+                    const DWORD64 & functionAddr = addrIt->second;
+                    ResolvedCallstack.m_Data[i] = functionAddr;
+                    partial.m_FunctionToCallstacks[functionAddr].push_back( rawCallstackId );
+                }
+            }
+
+            CallstackID resolvedCallstackId = ResolvedCallstack.Hash();
+            if( partial.m_UniqueResolvedCallstacks.find( resolvedCallstackId ) == partial.m_UniqueResolvedCallstacks.end() )
+            {
+                partial.m_UniqueResolvedCallstacks[resolvedCallstackId] = std::make_shared<CallStack>( ResolvedCallstack );
+            }
+
+            partial.m_RawToResolved.push_back( std::make_pair( rawCallstackId, resolvedCallstackId ) );
+        } );
+
+        for( ResolvePartial & partial : partials )
+        {
+            m_UniqueResolvedCallstacks.insert( partial.m_UniqueResolvedCallstacks.begin(), partial.m_UniqueResolvedCallstacks.end() );
+
+            for( auto & pair : partial.m_RawToResolved )
+            {
+                m_RawToResolvedMap[pair.first] = pair.second;
+            }
+
+            for( auto & pair : partial.m_FunctionToCallstacks )
+            {
+                m_FunctionToCallstacks[pair.first].insert( pair.second.begin(), pair.second.end() );
+            }
+        }
     }
 }
 
@@ -419,6 +627,15 @@ void SamplingProfiler::AddAddress( DWORD64 a_Address )
 {
     ScopeLock lock( m_SymbolMutex );
 
+    DWORD64 functionAddress = a_Address;
+    CachedSymbol symbol;
+    ResolveAddress( a_Address, functionAddress, symbol );
+    AddSymbol( a_Address, functionAddress, symbol );
+}
+
+//-----------------------------------------------------------------------------
+bool SamplingProfiler::ResolveAddress( DWORD64 a_Address, DWORD64 & o_FunctionAddress, CachedSymbol & o_Symbol )
+{
     unsigned char buffer[1024];
     memset( buffer, 0, 1024 );
     SYMBOL_INFOW* symbol_info = (SYMBOL_INFOW*)buffer;
@@ -427,11 +644,13 @@ void SamplingProfiler::AddAddress( DWORD64 a_Address )
     DWORD64 displacement = 0;
     BOOL result = m_Process ? SymFromAddrW( m_Process->GetHandle(), (DWORD64)a_Address, &displacement, symbol_info ) : false;
 
+    bool resolved = true;
     std::wstring symName = symbol_info->Name;
     if( symName == L"" )
     {
         symName = Format( L"%I64x", a_Address );
         PRINT_VAR( GetLastErrorAsString() );
+        resolved = false;
 
         std::shared_ptr<OrbitDiaSymbol> symbol = m_Process->SymbolFromAddress( a_Address );
         if( symbol->m_Symbol )
@@ -441,21 +660,38 @@ void SamplingProfiler::AddAddress( DWORD64 a_Address )
             {
                 symName = bstrName;
                 SysFreeString( bstrName );
+                resolved = true;
             }
         }
     }
 
-    m_ExactAddresses[a_Address] = symbol_info->Address ? symbol_info->Address : a_Address;
-    m_AddressToSymbol[(DWORD64)a_Address] = symName;
-    m_AddressToSymbol[symbol_info->Address] = symName;    
+    o_FunctionAddress = symbol_info->Address ? symbol_info->Address : a_Address;
+    o_Symbol.m_Name = symName;
 
     LineInfo lineInfo;
     if( SymUtils::GetLineInfo( a_Address, lineInfo ) )
     {
-        DWORD64 hash = StringHash(lineInfo.m_File);
-        lineInfo.m_FileNameHash = hash;
-        m_FileNames[hash] = lineInfo.m_File;
-        lineInfo.m_File = L"";
+        o_Symbol.m_File = lineInfo.m_File;
+        o_Symbol.m_Line = lineInfo.m_Line;
+    }
+
+    return resolved;
+}
+
+//-----------------------------------------------------------------------------
+void SamplingProfiler::AddSymbol( DWORD64 a_Address, DWORD64 a_FunctionAddress, const CachedSymbol & a_Symbol )
+{
+    m_ExactAddresses[a_Address] = a_FunctionAddress;
+    m_AddressToSymbol[a_Address] = a_Symbol.m_Name;
+    m_AddressToSymbol[a_FunctionAddress] = a_Symbol.m_Name;
+
+    if( a_Symbol.m_File.size() > 0 )
+    {
+        LineInfo lineInfo;
+        lineInfo.m_Address = a_Address;
+        lineInfo.m_Line = a_Symbol.m_Line;
+        lineInfo.m_FileNameHash = StringHash( a_Symbol.m_File );
+        m_FileNames[lineInfo.m_FileNameHash] = a_Symbol.m_File;
         m_AddressToLineInfo[a_Address] = lineInfo;
     }
 }
@@ -501,10 +737,20 @@ void SamplingProfiler::OutputStats()
     }
 }
 
+//-----------------------------------------------------------------------------
+void SamplingProfiler::AddCallStack( CallStack & a_CallStack )
+{
+    if( m_State == Sampling )
+    {
+        AddSample( a_CallStack.m_ThreadId, m_CallstackTable.Intern( a_CallStack ) );
+    }
+}
+
 //-----------------------------------------------------------------------------
 void SamplingProfiler::GetThreadCallstack( Thread* a_Thread )
 {
     StackFrame frame( a_Thread->m_Handle );
+    DWORD64 frames[ORBIT_STACK_SIZE];
 
     unsigned int depth = 0;
     while ( StackWalk64( frame.m_ImageType
@@ -519,14 +765,12 @@ void SamplingProfiler::GetThreadCallstack( Thread* a_Thread )
             && frame.m_StackFrame.AddrPC.Offset
             && depth < ORBIT_STACK_SIZE )
     {
-        frame.m_Callstack.m_Data[depth++] = frame.m_StackFrame.AddrPC.Offset;
+        frames[depth++] = frame.m_StackFrame.AddrPC.Offset;
     }
 
     if( depth > 0 )
     {
-        frame.m_Callstack.m_Depth = depth;
-        frame.m_Callstack.m_ThreadId = a_Thread->m_TID;
-        m_Callstacks.push_back( frame.m_Callstack );
+        AddSample( a_Thread->m_TID, m_CallstackTable.Intern( frames, depth ) );
     }
 }
 
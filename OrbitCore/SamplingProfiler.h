@@ -6,11 +6,13 @@
 #include "Core.h"
 #include "Pdb.h"
 #include "Callstack.h"
-#include "BlockChain.h"
+#include "CallstackTable.h"
 #include "SerializationMacros.h"
 
 class Process;
 class Thread;
+class PerfEventSampler;
+struct CachedSymbol;
 
 //-----------------------------------------------------------------------------
 struct SampledFunction
@@ -97,7 +99,7 @@ public:
     float GetSampleTimeTotal() const { return m_SampleTimeSeconds; }
     bool  ShouldStop();
     void FireDoneProcessingCallbacks();
-    void AddCallStack( CallStack & a_CallStack ) { if( m_State == Sampling ) m_Callstacks.push_back( a_CallStack ); }
+    void AddCallStack( CallStack & a_CallStack );
     const std::shared_ptr<CallStack> GetCallStack( CallstackID a_ID ) { return m_UniqueCallstacks[a_ID]; }
     std::multimap<int, CallstackID> GetCallStacksFromAddress( DWORD64 a_Addr, ThreadID a_TID, int & o_NumCallstacks );
     std::shared_ptr< SortedCallstackReport > GetSortedCallstacksFromAddress( DWORD64 a_Addr, ThreadID a_TID );
@@ -130,19 +132,27 @@ public:
 protected:
     void ReserveThreadData();
     void SampleThreadsAsync();
+    bool StartPerfEventSampling();
+    void SamplePerfEventsAsync();
     void GetThreadCallstack( Thread * a_Thread );
+    void AddSample( ThreadID a_TID, uint32_t a_CallstackIndex ) { m_ThreadSamples[a_TID].push_back( a_CallstackIndex ); }
     void GetThreadsUsage();
     void ProcessAddresses();
+    void ProcessThreadSampleData( ThreadSampleData & a_ThreadSampleData );
+    bool ResolveAddress( DWORD64 a_Address, DWORD64 & o_FunctionAddress, CachedSymbol & o_Symbol );
+    void AddSymbol( DWORD64 a_Address, DWORD64 a_FunctionAddress, const CachedSymbol & a_Symbol );
     void OutputStats();
 
 protected:
     std::shared_ptr<Process>        m_Process;
     std::unique_ptr<std::thread>    m_SamplingThread;
+    std::unique_ptr<PerfEventSampler> m_PerfEventSampler;
     std::atomic<SamplingState>      m_State;
-    BlockChain<CallStack, 16*1024 > m_Callstacks;
+    CallstackTable                  m_CallstackTable;
     Timer                           m_SamplingTimer;
     Timer                           m_ThreadUsageTimer;
     int                             m_PeriodMs;
+    uint32_t                        m_PerfFrequencyHz;
     float                           m_SampleTimeSeconds;
     bool                            m_ETW;
     bool                            m_GenerateSummary;
@@ -150,6 +160,7 @@ protected:
     int                             m_NumSamples;
     bool                            m_LoadedFromFile;
 
+    std::unordered_map<ThreadID, std::vector<uint32_t>>         m_ThreadSamples; // Indices in m_CallstackTable
     std::unordered_map<ThreadID, ThreadSampleData>              m_ThreadSampleData;
     std::unordered_map<CallstackID, std::shared_ptr<CallStack>> m_UniqueCallstacks;
     std::unordered_map<CallstackID, std::shared_ptr<CallStack>> m_UniqueResolvedCallstacks;
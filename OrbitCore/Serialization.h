@@ -56,6 +56,18 @@ private:
 };
 extern CounterStreamBuffer GStreamCounter;
 
+//-----------------------------------------------------------------------------
+// Lets archives read from memory without copying it into a stringstream
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+    MemoryStreamBuffer( const char* a_Data, size_t a_Size )
+    {
+        char* data = const_cast<char*>( a_Data );
+        setg( data, data, data + a_Size );
+    }
+};
+
 //-----------------------------------------------------------------------------
 struct ScopeCounter
 {
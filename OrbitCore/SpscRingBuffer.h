@@ -0,0 +1,76 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+// Fixed size ring buffer with one producer thread and one consumer thread.
+// Push never blocks nor allocates, it fails when the buffer is full.
+// Head and tail live on separate cache lines so that the producer and the
+// consumer don't invalidate each other's line on every operation.
+template< class T, int BUFFER_SIZE >
+class SpscRingBuffer
+{
+    static_assert( ( BUFFER_SIZE & ( BUFFER_SIZE - 1 ) ) == 0, "BUFFER_SIZE must be a power of two" );
+    static const uint32_t MASK = BUFFER_SIZE - 1;
+
+public:
+    //-------------------------------------------------------------------------
+    SpscRingBuffer() : m_Head(0), m_CachedTail(0), m_Tail(0)
+    {
+    }
+
+    //-------------------------------------------------------------------------
+    // Producer thread only
+    inline bool TryPush( const T & a_Item )
+    {
+        uint32_t head = m_Head.load( std::memory_order_relaxed );
+        if( head - m_CachedTail == BUFFER_SIZE )
+        {
+            m_CachedTail = m_Tail.load( std::memory_order_acquire );
+            if( head - m_CachedTail == BUFFER_SIZE )
+                return false;
+        }
+
+        m_Data[head & MASK] = a_Item;
+        m_Head.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    //-------------------------------------------------------------------------
+    // Consumer thread only
+    inline size_t TryPopBulk( T* o_Items, size_t a_MaxItems )
+    {
+        uint32_t tail = m_Tail.load( std::memory_order_relaxed );
+        uint32_t head = m_Head.load( std::memory_order_acquire );
+        size_t numItems = std::min( size_t( head - tail ), a_MaxItems );
+
+        for( size_t i = 0; i < numItems; ++i )
+        {
+            o_Items[i] = m_Data[( tail + i ) & MASK];
+        }
+
+        m_Tail.store( tail + (uint32_t)numItems, std::memory_order_release );
+        return numItems;
+    }
+
+    //-------------------------------------------------------------------------
+    inline size_t Size() const
+    {
+        return size_t( m_Head.load( std::memory_order_acquire ) - m_Tail.load( std::memory_order_acquire ) );
+    }
+
+    //-------------------------------------------------------------------------
+    static int Capacity() { return BUFFER_SIZE; }
+
+protected:
+    std::atomic<uint32_t> m_Head;
+    uint32_t              m_CachedTail; // Producer's last view of m_Tail
+    char                  m_Padding0[64];
+    std::atomic<uint32_t> m_Tail;
+    char                  m_Padding1[64];
+    T                     m_Data[BUFFER_SIZE];
+};
@@ -0,0 +1,239 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "SymbolCache.h"
+#include "OrbitProcess.h"
+#include "OrbitModule.h"
+#include "OrbitFunction.h"
+#include "Pdb.h"
+#include "Path.h"
+#include "Log.h"
+#include "SamplingProfiler.h"
+#include "CacheFile.h"
+
+SymbolCache GSymbolCache;
+
+//-----------------------------------------------------------------------------
+// Bump MODULE_SYMBOLS_VERSION whenever ModuleSymbols serialization changes
+static const char     MODULE_SYMBOLS_MAGIC[4] = { 'O', 'R', 'B', 'A' };
+static const uint32_t MODULE_SYMBOLS_VERSION = 1;
+
+//-----------------------------------------------------------------------------
+static std::wstring GetModuleKey( Process & a_Process, Module & a_Module )
+{
+    IMAGEHLP_MODULEW64 moduleInfo;
+    memset( &moduleInfo, 0, sizeof( moduleInfo ) );
+    moduleInfo.SizeOfStruct = sizeof( moduleInfo );
+
+    GUID guid = { 0 };
+    DWORD age = 0;
+    if( SymGetModuleInfoW64( a_Process.GetHandle(), a_Module.m_AddressStart, &moduleInfo ) )
+    {
+        guid = moduleInfo.PdbSig70;
+        age = moduleInfo.PdbAge;
+    }
+
+    const GUID nullGuid = { 0 };
+    if( memcmp( &guid, &nullGuid, sizeof( GUID ) ) == 0 && a_Module.m_Pdb )
+    {
+        guid = a_Module.m_Pdb->GetGuid();
+    }
+
+    // Without a build id we can't tell two versions of a binary apart
+    if( memcmp( &guid, &nullGuid, sizeof( GUID ) ) == 0 )
+    {
+        return L"";
+    }
+
+    return s2ws( GuidToString( guid ) + "-" + ToHexString( age ) ) + L"_" + a_Module.m_Name;
+}
+
+//-----------------------------------------------------------------------------
+std::shared_ptr<ModuleSymbols> SymbolCache::GetModuleSymbols( Process & a_Process, Module & a_Module )
+{
+    std::wstring key = GetModuleKey( a_Process, a_Module );
+    if( key.empty() )
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<ModuleSymbols> & symbols = m_Modules[key];
+    if( !symbols )
+    {
+        symbols = std::make_shared<ModuleSymbols>();
+        symbols->m_FileName = Path::GetCachePath() + key + L".sym";
+
+        if( Path::FileExists( symbols->m_FileName ) )
+        {
+            SCOPE_TIMER_LOG( Format( L"Loading symbol cache %s", symbols->m_FileName.c_str() ) );
+
+            // Don't keep a partially read file, it gets rewritten on Save
+            ModuleSymbols loadedSymbols;
+            if( CacheFile::Load( symbols->m_FileName, MODULE_SYMBOLS_MAGIC, MODULE_SYMBOLS_VERSION, loadedSymbols ) )
+            {
+                symbols->m_Symbols.swap( loadedSymbols.m_Symbols );
+            }
+        }
+    }
+
+    return symbols;
+}
+
+//-----------------------------------------------------------------------------
+void SymbolCache::GetFunctionRanges( Module & a_Module, std::vector<FunctionRange> & o_Ranges )
+{
+    o_Ranges.clear();
+
+    if( !a_Module.m_Pdb || a_Module.m_Pdb->IsLoading() )
+    {
+        return;
+    }
+
+    std::vector<Function> & functions = a_Module.m_Pdb->GetFunctions();
+    o_Ranges.reserve( functions.size() );
+
+    for( Function & function : functions )
+    {
+        FunctionRange range;
+        range.m_Rva = function.m_Address;
+        range.m_Size = std::max( (DWORD64)function.m_Size, (DWORD64)1 );
+        range.m_Function = &function;
+        o_Ranges.push_back( range );
+    }
+
+    std::sort( o_Ranges.begin(), o_Ranges.end(), []( const FunctionRange & a, const FunctionRange & b )
+    {
+        return a.m_Rva < b.m_Rva;
+    } );
+}
+
+//-----------------------------------------------------------------------------
+void SymbolCache::Resolve( Process & a_Process, std::vector<DWORD64> & a_Addresses, ResolveCallback a_Fallback, ResultCallback a_Result )
+{
+    ScopeLock lock( m_Mutex );
+
+    std::sort( a_Addresses.begin(), a_Addresses.end() );
+    a_Addresses.erase( std::unique( a_Addresses.begin(), a_Addresses.end() ), a_Addresses.end() );
+
+    std::vector<FunctionRange> ranges;
+
+    size_t i = 0;
+    while( i < a_Addresses.size() )
+    {
+        std::shared_ptr<Module> module = a_Process.GetModuleFromAddress( a_Addresses[i] );
+        if( !module || a_Addresses[i] >= module->m_AddressEnd )
+        {
+            // Not in a known module, nothing to cache
+            DWORD64 functionAddress = a_Addresses[i];
+            CachedSymbol symbol;
+            a_Fallback( a_Addresses[i], functionAddress, symbol );
+            a_Result( a_Addresses[i], functionAddress, symbol );
+            ++i;
+            continue;
+        }
+
+        // All addresses of this module are contiguous in the sorted list
+        size_t moduleEnd = i;
+        while( moduleEnd < a_Addresses.size() && a_Addresses[moduleEnd] < module->m_AddressEnd )
+            ++moduleEnd;
+
+        std::shared_ptr<ModuleSymbols> moduleSymbols = GetModuleSymbols( a_Process, *module );
+        GetFunctionRanges( *module, ranges );
+        size_t rangeIndex = 0;
+        DWORD64 moduleBase = module->m_AddressStart;
+
+        for( ; i < moduleEnd; ++i )
+        {
+            DWORD64 address = a_Addresses[i];
+            DWORD64 rva = address - moduleBase;
+
+            if( moduleSymbols )
+            {
+                auto it = moduleSymbols->m_Symbols.find( rva );
+                if( it != moduleSymbols->m_Symbols.end() )
+                {
+                    a_Result( address, moduleBase + it->second.m_FunctionRva, it->second );
+                    continue;
+                }
+            }
+
+            // Addresses and ranges are both sorted, advance through ranges
+            while( rangeIndex + 1 < ranges.size() && ranges[rangeIndex + 1].m_Rva <= rva )
+                ++rangeIndex;
+
+            CachedSymbol symbol;
+            DWORD64 functionAddress = address;
+            bool resolved = false;
+
+            if( rangeIndex < ranges.size() && ranges[rangeIndex].m_Rva <= rva && rva < ranges[rangeIndex].m_Rva + ranges[rangeIndex].m_Size )
+            {
+                Function* function = ranges[rangeIndex].m_Function;
+                functionAddress = moduleBase + ranges[rangeIndex].m_Rva;
+                symbol.m_Name = function->PrettyName();
+
+                LineInfo lineInfo;
+                if( module->m_Pdb->LineInfoFromAddress( address, lineInfo ) )
+                {
+                    symbol.m_File = lineInfo.m_File;
+                    symbol.m_Line = lineInfo.m_Line;
+                }
+
+                resolved = true;
+            }
+            else
+            {
+                resolved = a_Fallback( address, functionAddress, symbol );
+            }
+
+            symbol.m_FunctionRva = functionAddress - moduleBase;
+            a_Result( address, functionAddress, symbol );
+
+            // Don't persist failures, symbols might be found next time
+            if( resolved && moduleSymbols && functionAddress >= moduleBase && functionAddress < module->m_AddressEnd )
+            {
+                moduleSymbols->m_Symbols[rva] = symbol;
+                moduleSymbols->m_IsDirty = true;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void SymbolCache::Save()
+{
+    ScopeLock lock( m_Mutex );
+
+    for( auto & pair : m_Modules )
+    {
+        ModuleSymbols & symbols = *pair.second;
+        if( symbols.m_IsDirty )
+        {
+            SCOPE_TIMER_LOG( Format( L"Saving symbol cache %s", symbols.m_FileName.c_str() ) );
+            CacheFile::Save( symbols.m_FileName, MODULE_SYMBOLS_MAGIC, MODULE_SYMBOLS_VERSION, symbols );
+            symbols.m_IsDirty = false;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void SymbolCache::Clear()
+{
+    ScopeLock lock( m_Mutex );
+    m_Modules.clear();
+}
+
+//-----------------------------------------------------------------------------
+ORBIT_SERIALIZE( CachedSymbol, 0 )
+{
+    ORBIT_NVP_VAL( 0, m_FunctionRva );
+    ORBIT_NVP_VAL( 0, m_Name );
+    ORBIT_NVP_VAL( 0, m_File );
+    ORBIT_NVP_VAL( 0, m_Line );
+}
+
+//-----------------------------------------------------------------------------
+ORBIT_SERIALIZE( ModuleSymbols, 0 )
+{
+    ORBIT_NVP_VAL( 0, m_Symbols );
+}
@@ -0,0 +1,72 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "Core.h"
+#include "SerializationMacros.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class Process;
+class Function;
+struct Module;
+
+//-----------------------------------------------------------------------------
+struct CachedSymbol
+{
+    CachedSymbol() : m_FunctionRva(0), m_Line(0) {}
+    DWORD64      m_FunctionRva; // Function start relative to module base
+    std::wstring m_Name;
+    std::wstring m_File;
+    DWORD        m_Line;
+
+    ORBIT_SERIALIZABLE;
+};
+
+//-----------------------------------------------------------------------------
+// Resolved addresses of one module binary, keyed by address relative to the
+// module base. Stored in the cache directory under the PDB GUID and age so
+// that repeated captures of the same binary don't hit the symbol engine.
+struct ModuleSymbols
+{
+    ModuleSymbols() : m_IsDirty(false) {}
+    std::wstring                                m_FileName;
+    std::unordered_map< DWORD64, CachedSymbol > m_Symbols;
+    bool                                        m_IsDirty;
+
+    ORBIT_SERIALIZABLE;
+};
+
+//-----------------------------------------------------------------------------
+class SymbolCache
+{
+public:
+    // Slow path for addresses not found in the cache nor in a loaded Pdb,
+    // o_FunctionAddress is absolute.
+    typedef std::function< bool( DWORD64 a_Address, DWORD64 & o_FunctionAddress, CachedSymbol & o_Symbol ) > ResolveCallback;
+    typedef std::function< void( DWORD64 a_Address, DWORD64 a_FunctionAddress, const CachedSymbol & a_Symbol ) > ResultCallback;
+
+    // Sorts a_Addresses and resolves them module by module
+    void Resolve( Process & a_Process, std::vector<DWORD64> & a_Addresses, ResolveCallback a_Fallback, ResultCallback a_Result );
+    void Save();
+    void Clear();
+
+protected:
+    struct FunctionRange
+    {
+        DWORD64   m_Rva;
+        DWORD64   m_Size;
+        Function* m_Function;
+    };
+
+    std::shared_ptr<ModuleSymbols> GetModuleSymbols( Process & a_Process, Module & a_Module );
+    static void GetFunctionRanges( Module & a_Module, std::vector<FunctionRange> & o_Ranges );
+
+protected:
+    Mutex                                                             m_Mutex;
+    std::unordered_map< std::wstring, std::shared_ptr<ModuleSymbols> > m_Modules;
+};
+
+extern SymbolCache GSymbolCache;
@@ -7,6 +7,9 @@
 #include "TcpServer.h"
 #include "Capture.h"
 #include "PrintVar.h"
+#include "Log.h"
+#include "Profiling.h"
+#include "BlockCompressor.h"
 
 #include "websocketpp/frame.hpp"
 #include "websocketpp/base64/base64.hpp"
@@ -84,16 +87,21 @@ TcpConnection::~TcpConnection()
 }
 
 //-----------------------------------------------------------------------------
-void TcpConnection::ReadMessage()
+void TcpConnection::ReadChunk()
 {
-    asio::async_read( m_Socket, asio::buffer( &m_Message, sizeof(Message) ), 
-        
-    [this]( asio::error_code ec, std::size_t /*length*/ )
+    TcpSlab & chunk = m_ReceiveChunks[m_ReceiveChunk];
+    char* writePtr = chunk.m_Data.get() + m_ReceiveEnd;
+
+    m_Socket.async_read_some( asio::buffer( writePtr, chunk.m_Capacity - m_ReceiveEnd ),
+
+    [this]( asio::error_code ec, std::size_t bytes_transferred )
     {
-        if(!ec)
+        if( !ec )
         {
-            m_NumBytesReceived += sizeof(Message);
-            ReadPayload();
+            m_NumBytesReceived += bytes_transferred;
+            m_ReceiveEnd += bytes_transferred;
+            ++m_NumReads;
+            DecodeChunk();
         }
         else
         {
@@ -101,7 +109,7 @@ void TcpConnection::ReadMessage()
             m_Socket.close();
         }
     }
-    
+
     );
 }
 
@@ -193,12 +201,20 @@ void TcpConnection::DecodeWebsocketPayload()
 void TcpConnection::ResetStats()
 {
     m_NumBytesReceived = 0;
+    m_NumReads = 0;
+    m_NumDecodedMessages = 0;
+    m_NumCarriedBytes = 0;
+    m_CompressionStats = TcpCompressionStats();
 }
 
 //-----------------------------------------------------------------------------
 std::vector<std::string> TcpConnection::GetStats()
 {
-    return std::vector<std::string>();
+    std::vector<std::string> stats;
+    stats.push_back( VAR_TO_ANSI( m_NumReads ) );
+    stats.push_back( VAR_TO_ANSI( m_NumDecodedMessages ) );
+    stats.push_back( VAR_TO_ANSI( m_NumCarriedBytes ) );
+    return stats;
 }
 
 //-----------------------------------------------------------------------------
@@ -285,52 +301,138 @@ void TcpConnection::ReadWebsocketHandshake()
 }
 
 //-----------------------------------------------------------------------------
-void TcpConnection::ReadPayload()
+void TcpConnection::DecodeChunk()
+{
+    char* data = m_ReceiveChunks[m_ReceiveChunk].m_Data.get();
+    size_t requiredSize = sizeof( Message );
+
+    while( m_ReceiveEnd - m_ReceiveBegin >= sizeof( Message ) )
+    {
+        const char* messageData = data + m_ReceiveBegin;
+        memcpy( &m_Message, messageData, sizeof( Message ) );
+
+        if( IsWebSocketHandshakeMessage( m_Message ) )
+        {
+            // Hand everything received so far to the line based handshake reader
+            size_t numBytes = m_ReceiveEnd - m_ReceiveBegin;
+            memcpy( asio::buffer_cast<char*>( m_StreamBuf.prepare( numBytes ) ), messageData, numBytes );
+            m_StreamBuf.commit( numBytes );
+            m_ReceiveBegin = m_ReceiveEnd = 0;
+
+            ReadWebsocketHandshake();
+            DecodeMessage( Message( Msg_WebSocketHandshake ) );
+            return;
+        }
+
+        requiredSize = sizeof( Message ) + m_Message.m_Size + 4;
+        if( m_ReceiveEnd - m_ReceiveBegin < requiredSize )
+        {
+            break;
+        }
+
+        unsigned int footer = 0;
+        memcpy( &footer, messageData + sizeof( Message ) + m_Message.m_Size, 4 );
+        assert( footer == MAGIC_FOOT_MSG );
+
+        m_Message.m_Data = m_Message.m_Size ? const_cast<char*>( messageData ) + sizeof( Message ) : nullptr;
+        m_ReceiveBegin += requiredSize;
+
+        if( m_Message.GetType() == Msg_CompressedBatch )
+        {
+            DecodeCompressedBatch( m_Message );
+        }
+        else
+        {
+            ++m_NumDecodedMessages;
+            DecodeMessage( m_Message );
+        }
+
+        requiredSize = sizeof( Message );
+    }
+
+    CarryPendingBytes( requiredSize );
+    ReadChunk();
+}
+
+//-----------------------------------------------------------------------------
+void TcpConnection::DecodeCompressedBatch( const Message & a_Message )
 {
-    if( IsWebSocketHandshakeMessage( m_Message ) )
+    // Senders cap batches at a few MB, anything bigger is corrupt
+    const size_t maxBatchSize = 256 * 1024 * 1024;
+    const CompressionHeader & header = a_Message.GetHeader().m_CompressionHeader;
+    size_t batchSize = header.m_UncompressedSize;
+    if( batchSize > maxBatchSize )
     {
-        ReadWebsocketHandshake();
-        DecodeMessage(Message(Msg_WebSocketHandshake));
+        ORBIT_ERROR;
         return;
     }
 
-    if( m_Message.m_Size == 0 )
+    TickType startTicks = OrbitTicks();
+    m_DecompressedBatch.Resize( batchSize );
+    char* data = m_DecompressedBatch.m_Data.get();
+    if( !BlockCompressor::Decompress( a_Message.GetData(), a_Message.m_Size, data, batchSize ) )
     {
-        m_Message.m_Data = nullptr;
-        ReadFooter();
+        ORBIT_LOG( "Received malformed compressed batch" );
+        return;
     }
-    else
+
+    ++m_CompressionStats.m_NumBatches;
+    m_CompressionStats.m_NumCompressedBytes += sizeof( Message ) + a_Message.m_Size + 4;
+    m_CompressionStats.m_NumUncompressedBytes += batchSize;
+    m_CompressionStats.m_CompressMicros += header.m_CompressMicros;
+    m_CompressionStats.m_DecompressMicros += (ULONG64)MicroSecondsFromTicks( startTicks, OrbitTicks() );
+
+    // Batches only hold complete messages
+    size_t offset = 0;
+    while( batchSize - offset >= sizeof( Message ) )
     {
-        m_Payload.resize(m_Message.m_Size);
-        asio::async_read( m_Socket, asio::buffer( m_Payload.data(), m_Message.m_Size ),
+        Message message;
+        memcpy( &message, data + offset, sizeof( Message ) );
 
-        [this](asio::error_code ec, std::size_t bytes_transferred)
+        size_t messageSize = sizeof( Message ) + message.m_Size + 4;
+        if( message.m_Size < 0 || batchSize - offset < messageSize )
         {
-            if (!ec)
-            {
-                m_NumBytesReceived += bytes_transferred;
-                m_Message.m_Data = m_Payload.data();
-				ReadFooter();
-            }
-            else
-            {
-                PRINT_VAR( ec.message() );
-                m_Socket.close();
-            }
+            break;
         }
-        );
+
+        message.m_Data = message.m_Size ? data + offset + sizeof( Message ) : nullptr;
+        offset += messageSize;
+        ++m_NumDecodedMessages;
+        DecodeMessage( message );
     }
+
+    assert( offset == batchSize );
 }
 
 //-----------------------------------------------------------------------------
-void TcpConnection::ReadFooter()
+void TcpConnection::CarryPendingBytes( size_t a_RequiredSize )
 {
-	unsigned int footer = 0;
-	asio::read(m_Socket, asio::buffer(&footer, 4));
-	assert(footer == MAGIC_FOOT_MSG);
-    m_NumBytesReceived += 4;
-	DecodeMessage(m_Message);
-	ReadMessage();
+    size_t numPending = m_ReceiveEnd - m_ReceiveBegin;
+    if( numPending == 0 )
+    {
+        m_ReceiveBegin = m_ReceiveEnd = 0;
+        return;
+    }
+
+    // Keep reading into the current chunk while the pending message fits
+    // and reads stay large, otherwise move on to the next one in the ring.
+    TcpSlab & chunk = m_ReceiveChunks[m_ReceiveChunk];
+    size_t freeSpace = chunk.m_Capacity - m_ReceiveEnd;
+    bool fits = m_ReceiveBegin + a_RequiredSize <= chunk.m_Capacity;
+    if( fits && ( m_ReceiveBegin == 0 || freeSpace >= RECEIVE_CHUNK_SIZE / 4 ) )
+    {
+        return;
+    }
+
+    int nextChunkIndex = ( m_ReceiveChunk + 1 ) % NUM_RECEIVE_CHUNKS;
+    TcpSlab & nextChunk = m_ReceiveChunks[nextChunkIndex];
+    nextChunk.Resize( a_RequiredSize > RECEIVE_CHUNK_SIZE ? a_RequiredSize : RECEIVE_CHUNK_SIZE );
+    memcpy( nextChunk.m_Data.get(), chunk.m_Data.get() + m_ReceiveBegin, numPending );
+
+    m_ReceiveChunk = nextChunkIndex;
+    m_ReceiveBegin = 0;
+    m_ReceiveEnd = numPending;
+    m_NumCarriedBytes += numPending;
 }
 
 //-----------------------------------------------------------------------------
@@ -19,6 +19,18 @@
 
 using asio::ip::tcp;
 
+//-----------------------------------------------------------------------------
+// Totals over the Msg_CompressedBatch blocks received on a connection
+struct TcpCompressionStats
+{
+    TcpCompressionStats() { memset( this, 0, sizeof( *this ) ); }
+    ULONG64 m_NumBatches;
+    ULONG64 m_NumCompressedBytes;
+    ULONG64 m_NumUncompressedBytes;
+    ULONG64 m_CompressMicros;     // Reported by the sender
+    ULONG64 m_DecompressMicros;
+};
+
 //-----------------------------------------------------------------------------
 class TcpConnection : public std::enable_shared_from_this < TcpConnection >
 {
@@ -39,13 +51,15 @@ public:
 
     void start()
     {
-        ReadMessage();
+        ReadChunk();
     }
 
-    void ReadMessage();
-    void ReadPayload();
-	void ReadFooter();
+    // Messages are received in large chunks and decoded in place, payloads
+    // handed to DecodeMessage are only valid for the duration of the call.
+    void ReadChunk();
+    void DecodeChunk();
     void DecodeMessage( Message & a_Message );
+    void DecodeCompressedBatch( const Message & a_Message );
 
     bool IsWebsocket() { return m_WebSocketKey != ""; }
     void ReadWebsocketHandshake();
@@ -54,6 +68,7 @@ public:
     void ReadWebsocketPayload();
     void DecodeWebsocketPayload();
     ULONG64 GetNumBytesReceived(){ return m_NumBytesReceived; }
+    const TcpCompressionStats & GetCompressionStats() const { return m_CompressionStats; }
 
     void ResetStats();
     std::vector<std::string> GetStats();
@@ -62,8 +77,15 @@ private:
     TcpConnection( asio::io_service& io_service )
         : m_Socket( io_service )
         , m_WrappedSocket( &m_Socket )
+        , m_ReceiveChunk( 0 )
+        , m_ReceiveBegin( 0 )
+        , m_ReceiveEnd( 0 )
     {
         m_NumBytesReceived = 0;
+        m_NumReads = 0;
+        m_NumDecodedMessages = 0;
+        m_NumCarriedBytes = 0;
+        m_ReceiveChunks[0].Resize( RECEIVE_CHUNK_SIZE );
     }
     // handle_write() is responsible for any further actions 
     // for this client connection.
@@ -74,6 +96,10 @@ private:
 
     void handle_request_line( asio::error_code ec, std::size_t bytes_transferred );
     void SendWebsocketResponse();
+    void CarryPendingBytes( size_t a_RequiredSize );
+
+    static const size_t RECEIVE_CHUNK_SIZE = 1024 * 1024;
+    static const int    NUM_RECEIVE_CHUNKS = 2;
 
     tcp::socket         m_Socket;
     TcpSocket           m_WrappedSocket;
@@ -85,6 +111,20 @@ private:
     unsigned int        m_WebSocketPayloadLength;
     unsigned int        m_WebSocketMask;
     ULONG64             m_NumBytesReceived;
+
+    // Receive ring, bytes in [m_ReceiveBegin, m_ReceiveEnd) of the current
+    // chunk are not decoded yet. A partial message is carried over to the
+    // next chunk when the current one runs out of space.
+    TcpSlab             m_ReceiveChunks[NUM_RECEIVE_CHUNKS];
+    int                 m_ReceiveChunk;
+    size_t              m_ReceiveBegin;
+    size_t              m_ReceiveEnd;
+    ULONG64             m_NumReads;
+    ULONG64             m_NumDecodedMessages;
+    ULONG64             m_NumCarriedBytes;
+
+    TcpSlab             m_DecompressedBatch;
+    TcpCompressionStats m_CompressionStats;
 };
 
 //-----------------------------------------------------------------------------
@@ -100,6 +140,8 @@ public:
     void RegisterConnection( std::shared_ptr<TcpConnection> a_Connection );
     ULONG64 GetNumBytesReceived(){ return m_Connection ? m_Connection->GetNumBytesReceived() : 0; }
     void ResetStats(){ if( m_Connection ) m_Connection->ResetStats(); }
+    std::vector<std::string> GetStats(){ return m_Connection ? m_Connection->GetStats() : std::vector<std::string>(); }
+    TcpCompressionStats GetCompressionStats(){ return m_Connection ? m_Connection->GetCompressionStats() : TcpCompressionStats(); }
 
 private:
     void start_accept();
@@ -134,12 +176,6 @@ public:
         buffer_ = asio::buffer(*data_);
     }
 
-    explicit shared_const_buffer( TcpPacket & a_Packet )
-    {
-        data_ = a_Packet.Data();
-        buffer_ = asio::buffer( *data_ );
-    }
-
     // Implement the ConstBufferSequence requirements.
     typedef asio::const_buffer value_type;
     typedef const asio::const_buffer* const_iterator;
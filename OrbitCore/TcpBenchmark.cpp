@@ -0,0 +1,497 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "Core.h"
+#include "TcpBenchmark.h"
+#include "Tcp.h"
+#include "TcpServer.h"
+#include "TimerCodec.h"
+#include "TimerManager.h"
+#include "Callstack.h"
+#include "Profiling.h"
+#include "PrintVar.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+//-----------------------------------------------------------------------------
+// Send-only client, the benchmark never reads anything back from the server
+class TcpBenchmarkClient : public TcpEntity
+{
+public:
+    //-----------------------------------------------------------------------------
+    bool Connect( unsigned short a_Port )
+    {
+        m_TcpSocket->m_Socket = new tcp::socket( *m_TcpService->m_IoService );
+        asio::error_code error;
+        m_TcpSocket->m_Socket->connect( tcp::endpoint( asio::ip::address_v4::loopback(), a_Port ), error );
+        if( error )
+        {
+            PRINT_VAR( error.message().c_str() );
+            return false;
+        }
+
+        // Latency numbers should not include Nagle delays
+        m_TcpSocket->m_Socket->set_option( tcp::no_delay( true ) );
+        return true;
+    }
+
+    int GetNumQueuedEntries() const { return m_NumQueuedEntries; }
+
+protected:
+    TcpSocket* GetSocket() override final { return m_TcpSocket; }
+};
+
+//-----------------------------------------------------------------------------
+// Serialized payloads are built once per producer and sent over and over
+struct TcpBenchmarkTraffic
+{
+    explicit TcpBenchmarkTraffic( const TcpBenchmarkConfig & a_Config, uint32_t a_ProducerIndex );
+
+    MessageType       m_Types[TcpBenchmarkResult::NUM_TRAFFIC_TYPES];
+    std::vector<char> m_Payloads[TcpBenchmarkResult::NUM_TRAFFIC_TYPES];
+};
+
+//-----------------------------------------------------------------------------
+TcpBenchmarkTraffic::TcpBenchmarkTraffic( const TcpBenchmarkConfig & a_Config, uint32_t a_ProducerIndex )
+{
+    m_Types[TcpBenchmarkResult::TIMER] = Msg_Timer;
+    m_Types[TcpBenchmarkResult::CALLSTACK] = Msg_Callstack;
+    m_Types[TcpBenchmarkResult::LOG] = Msg_OrbitLog;
+
+    // Timers spread over a few threads and functions, like a hooked target
+    std::vector<Timer> timers( a_Config.m_TimersPerMessage );
+    TickType start = OrbitTicks();
+    for( uint32_t i = 0; i < a_Config.m_TimersPerMessage; ++i )
+    {
+        Timer & timer = timers[i];
+        timer.m_TID = 1000 + a_ProducerIndex * 8 + i % 8;
+        timer.m_Depth = int8_t( i % 4 );
+        timer.m_SessionID = int8_t( Message::GSessionID );
+        timer.m_FunctionAddress = 0x140001000ull + ( i % 64 ) * 0x40;
+        timer.m_Start = start + i * 100;
+        timer.m_End = timer.m_Start + 50 + i % 7;
+    }
+
+    std::vector<uint8_t> encodedTimers;
+    TimerEncoder encoder;
+    encoder.Encode( timers.data(), timers.size(), encodedTimers );
+    m_Payloads[TcpBenchmarkResult::TIMER].assign( encodedTimers.begin(), encodedTimers.end() );
+
+    CallStackPOD callstack;
+    callstack.m_ThreadId = 1000 + a_ProducerIndex;
+    callstack.m_Depth = (int)std::min( a_Config.m_CallstackDepth, (uint32_t)ORBIT_STACK_SIZE );
+    for( int i = 0; i < callstack.m_Depth; ++i )
+    {
+        callstack.m_Data[i] = 0x140001000ull + i * 0x1000 + a_ProducerIndex;
+    }
+    callstack.Hash();
+    const char* callstackData = (const char*)&callstack;
+    m_Payloads[TcpBenchmarkResult::CALLSTACK].assign( callstackData, callstackData + callstack.GetSizeInBytes() );
+
+    // Same layout as TcpEntity::Send( OrbitLogEntry& )
+    OrbitLogEntry entry;
+    entry.m_ThreadId = 1000 + a_ProducerIndex;
+    entry.m_Text.assign( a_Config.m_LogLength, 'x' );
+    std::vector<char> & log = m_Payloads[TcpBenchmarkResult::LOG];
+    log.resize( entry.GetBufferSize() );
+    memcpy( log.data(), &entry, OrbitLogEntry::GetSizeWithoutString() );
+    memcpy( log.data() + OrbitLogEntry::GetSizeWithoutString(), entry.m_Text.c_str(), entry.GetStringSize() );
+}
+
+//-----------------------------------------------------------------------------
+static void ProduceTraffic( TcpBenchmarkClient & a_Client
+                          , const TcpBenchmarkConfig & a_Config
+                          , uint32_t a_ProducerIndex
+                          , std::atomic<bool> & a_ExitRequested
+                          , std::atomic<uint64_t>* o_NumSent )
+{
+    SetThreadName( GetCurrentThreadId(), "TcpBenchmarkProducer" );
+
+    TcpBenchmarkTraffic traffic( a_Config, a_ProducerIndex );
+    const uint32_t weights[] = { a_Config.m_TimerWeight, a_Config.m_CallstackWeight, a_Config.m_LogWeight };
+    const uint32_t totalWeight = weights[0] + weights[1] + weights[2];
+    if( totalWeight == 0 )
+    {
+        return;
+    }
+
+    double messagesPerSecond = double( a_Config.m_MessagesPerSecond ) / a_Config.m_NumProducers;
+    TickType startTicks = OrbitTicks();
+    uint64_t numSent = 0;
+
+    while( !a_ExitRequested )
+    {
+        // Weighted round robin, deterministic so runs are comparable
+        uint32_t slot = uint32_t( numSent % totalWeight );
+        int type = 0;
+        while( slot >= weights[type] )
+        {
+            slot -= weights[type++];
+        }
+
+        std::vector<char> & payload = traffic.m_Payloads[type];
+        Message msg( traffic.m_Types[type], (int)payload.size() );
+        msg.m_Header.m_GenericHeader.m_Address = (ULONG64)OrbitTicks();
+        a_Client.Send( msg, (void*)payload.data() );
+        ++o_NumSent[type];
+        ++numSent;
+
+        if( messagesPerSecond > 0 )
+        {
+            double sendTimeUs = numSent * 1000000.0 / messagesPerSecond;
+            while( !a_ExitRequested && MicroSecondsFromTicks( startTicks, OrbitTicks() ) < sendTimeUs )
+            {
+                std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+            }
+        }
+
+        while( !a_ExitRequested && a_Client.GetNumQueuedEntries() > a_Config.m_MaxQueuedEntries )
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+static int GetTrafficType( MessageType a_Type )
+{
+    switch( a_Type )
+    {
+    case Msg_Timer:     return TcpBenchmarkResult::TIMER;
+    case Msg_Callstack: return TcpBenchmarkResult::CALLSTACK;
+    case Msg_OrbitLog:  return TcpBenchmarkResult::LOG;
+    default:            return -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Fixed size latency histogram the io thread can fill without locking or
+// allocating, so soak runs of any length cost the same. Buckets are log
+// linear in nanoseconds: values below 8 get a bucket each, above that every
+// power of two is split in 8 buckets, so a percentile is within 12.5%.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 3;
+    static const int NUM_SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int NUM_BUCKETS = ( 64 - SUB_BUCKET_BITS + 1 ) * NUM_SUB_BUCKETS;
+
+    //-----------------------------------------------------------------------------
+    LatencyHistogram() : m_Max( 0 )
+    {
+        for( std::atomic<uint64_t> & count : m_Counts )
+        {
+            count = 0;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    void Add( uint64_t a_Nanos )
+    {
+        m_Counts[GetBucket( a_Nanos )].fetch_add( 1, std::memory_order_relaxed );
+
+        uint64_t max = m_Max.load( std::memory_order_relaxed );
+        while( a_Nanos > max && !m_Max.compare_exchange_weak( max, a_Nanos, std::memory_order_relaxed ) ) {}
+    }
+
+    //-----------------------------------------------------------------------------
+    // Upper bound of the bucket holding the percentile, never above the max
+    double GetPercentileUs( double a_Percentile ) const
+    {
+        uint64_t numValues = 0;
+        for( const std::atomic<uint64_t> & count : m_Counts )
+        {
+            numValues += count.load( std::memory_order_relaxed );
+        }
+
+        if( numValues == 0 )
+        {
+            return 0.0;
+        }
+
+        uint64_t index = std::min( uint64_t( a_Percentile * numValues ), numValues - 1 );
+        uint64_t numBelow = 0;
+        for( int i = 0; i < NUM_BUCKETS; ++i )
+        {
+            numBelow += m_Counts[i].load( std::memory_order_relaxed );
+            if( numBelow > index )
+            {
+                return std::min( GetBucketUpperBound( i ), GetMax() ) / 1000.0;
+            }
+        }
+
+        return GetMaxUs();
+    }
+
+    double GetMaxUs() const { return GetMax() / 1000.0; }
+
+protected:
+    //-----------------------------------------------------------------------------
+    static int GetBucket( uint64_t a_Nanos )
+    {
+        if( a_Nanos < NUM_SUB_BUCKETS )
+        {
+            return (int)a_Nanos;
+        }
+
+        int msb = 0;
+        for( uint64_t value = a_Nanos >> 1; value; value >>= 1 )
+        {
+            ++msb;
+        }
+
+        int shift = msb - SUB_BUCKET_BITS;
+        int subBucket = (int)( ( a_Nanos >> shift ) & ( NUM_SUB_BUCKETS - 1 ) );
+        return ( shift + 1 ) * NUM_SUB_BUCKETS + subBucket;
+    }
+
+    //-----------------------------------------------------------------------------
+    static uint64_t GetBucketUpperBound( int a_Bucket )
+    {
+        if( a_Bucket < NUM_SUB_BUCKETS )
+        {
+            return (uint64_t)a_Bucket;
+        }
+
+        int shift = a_Bucket / NUM_SUB_BUCKETS - 1;
+        uint64_t lower = uint64_t( NUM_SUB_BUCKETS + a_Bucket % NUM_SUB_BUCKETS ) << shift;
+        return lower + ( ( uint64_t(1) << shift ) - 1 );
+    }
+
+    uint64_t GetMax() const { return m_Max.load( std::memory_order_relaxed ); }
+
+protected:
+    std::atomic<uint64_t> m_Counts[NUM_BUCKETS];
+    std::atomic<uint64_t> m_Max;
+};
+
+//-----------------------------------------------------------------------------
+TcpBenchmarkResult TcpBenchmark::Run( const TcpBenchmarkConfig & a_Config )
+{
+    TcpBenchmarkResult result;
+
+    if( GTcpServer == nullptr || GTcpServer->HasConnection() )
+    {
+        ORBIT_LOG( "TcpBenchmark needs a TcpServer without connection\n" );
+        return result;
+    }
+
+    // Receiving side, runs on the server's io thread
+    std::unique_ptr<LatencyHistogram> latencies( new LatencyHistogram() );
+    std::atomic<uint64_t> numReceived[TcpBenchmarkResult::NUM_TRAFFIC_TYPES];
+    std::atomic<uint64_t> numReceivedBytes( 0 );
+    std::atomic<uint64_t> numReceivedTotal( 0 );
+    for( std::atomic<uint64_t> & counter : numReceived )
+    {
+        counter = 0;
+    }
+
+    GTcpServer->SetReceiveHook( [&]( const Message & a_Message )
+    {
+        int type = GetTrafficType( a_Message.GetType() );
+        if( type < 0 )
+        {
+            return false;
+        }
+
+        TickType sendTicks = (TickType)a_Message.GetHeader().m_GenericHeader.m_Address;
+        double latencyUs = std::max( MicroSecondsFromTicks( sendTicks, OrbitTicks() ), 0.0 );
+        latencies->Add( uint64_t( latencyUs * 1000.0 ) );
+        numReceivedBytes += sizeof( Message ) + a_Message.m_Size + 4;
+        ++numReceived[type];
+        ++numReceivedTotal;
+        return !a_Config.m_Dispatch;
+    } );
+
+    TcpBenchmarkClient client;
+    client.SetFlushPolicy( a_Config.m_FlushPolicy );
+    if( !client.Connect( a_Config.m_Port ) )
+    {
+        GTcpServer->SetReceiveHook( nullptr );
+        return result;
+    }
+
+    client.Start();
+
+    // Sending side
+    std::atomic<bool>     exitRequested( false );
+    std::atomic<uint64_t> numSent[TcpBenchmarkResult::NUM_TRAFFIC_TYPES];
+    for( std::atomic<uint64_t> & counter : numSent )
+    {
+        counter = 0;
+    }
+
+    uint32_t numProducers = std::max( a_Config.m_NumProducers, 1u );
+    TcpBenchmarkConfig config = a_Config;
+    config.m_NumProducers = numProducers;
+
+    Timer timer;
+    timer.Start();
+
+    std::vector< std::thread > producers;
+    for( uint32_t i = 0; i < numProducers; ++i )
+    {
+        producers.push_back( std::thread( [&, i](){ ProduceTraffic( client, config, i, exitRequested, numSent ); } ) );
+    }
+
+    // Sample queue depths while traffic flows
+    uint64_t numSamples = 0;
+    double sumClientQueuedEntries = 0;
+    while( timer.QueryMillis() < a_Config.m_DurationMs )
+    {
+        int clientQueuedEntries = client.GetNumQueuedEntries();
+        int serverQueuedEntries = GTimerManager ? (int)GTimerManager->m_NumQueuedEntries : 0;
+        result.m_MaxClientQueuedEntries = std::max( result.m_MaxClientQueuedEntries, clientQueuedEntries );
+        result.m_MaxServerQueuedEntries = std::max( result.m_MaxServerQueuedEntries, serverQueuedEntries );
+        sumClientQueuedEntries += clientQueuedEntries;
+        ++numSamples;
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+
+    exitRequested = true;
+    for( std::thread & producer : producers )
+    {
+        producer.join();
+    }
+
+    // Let the transport drain before taking the time
+    uint64_t numSentTotal = numSent[0] + numSent[1] + numSent[2];
+    Timer drainTimer;
+    drainTimer.Start();
+    while( numReceivedTotal < numSentTotal && drainTimer.QueryMillis() < 10000.0 )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+
+    result.m_Seconds = timer.QuerySeconds();
+    result.m_NumSentBatches = client.GetNumSentBatches();
+    result.m_NumSentPackets = client.GetNumSentPackets();
+    result.m_NumSentBytes = client.GetNumSentBytes();
+
+    client.Stop();
+    GTcpServer->SetReceiveHook( nullptr );
+    GTcpServer->ResetConnection();
+
+    uint64_t numReceivedMessages = 0;
+    for( int i = 0; i < TcpBenchmarkResult::NUM_TRAFFIC_TYPES; ++i )
+    {
+        result.m_NumSent[i] = numSent[i];
+        result.m_NumReceived[i] = numReceived[i];
+        numReceivedMessages += numReceived[i];
+    }
+
+    result.m_Valid = true;
+    result.m_NumReceivedBytes = numReceivedBytes;
+    result.m_NumReceivedTimers = numReceived[TcpBenchmarkResult::TIMER] * a_Config.m_TimersPerMessage;
+    result.m_MessagesPerSecond = numReceivedMessages / result.m_Seconds;
+    result.m_BytesPerSecond = numReceivedBytes / result.m_Seconds;
+    result.m_TimersPerSecond = result.m_NumReceivedTimers / result.m_Seconds;
+    result.m_AvgClientQueuedEntries = numSamples ? sumClientQueuedEntries / numSamples : 0.0;
+
+    result.m_LatencyP50Us = latencies->GetPercentileUs( 0.50 );
+    result.m_LatencyP90Us = latencies->GetPercentileUs( 0.90 );
+    result.m_LatencyP99Us = latencies->GetPercentileUs( 0.99 );
+    result.m_LatencyMaxUs = latencies->GetMaxUs();
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+TcpBenchmarkConfig TcpBenchmarkConfig::Parse( const std::string & a_Argument )
+{
+    TcpBenchmarkConfig config;
+
+    std::vector< std::string > tokens = Tokenize( a_Argument, ":" );
+    if( tokens.size() < 2 )
+    {
+        return config;
+    }
+
+    for( const std::string & option : Tokenize( tokens[1], "," ) )
+    {
+        std::vector< std::string > keyValue = Tokenize( option, "=" );
+        if( keyValue.size() != 2 )
+        {
+            continue;
+        }
+
+        const std::string & key = keyValue[0];
+        uint32_t value = (uint32_t)atoi( keyValue[1].c_str() );
+
+        if( key == "duration" )          config.m_DurationMs = value * 1000;
+        else if( key == "rate" )         config.m_MessagesPerSecond = value;
+        else if( key == "producers" )    config.m_NumProducers = value;
+        else if( key == "queue" )        config.m_MaxQueuedEntries = (int)value;
+        else if( key == "timers" )       config.m_TimerWeight = value;
+        else if( key == "callstacks" )   config.m_CallstackWeight = value;
+        else if( key == "logs" )         config.m_LogWeight = value;
+        else if( key == "batch" )        config.m_TimersPerMessage = value;
+        else if( key == "depth" )        config.m_CallstackDepth = value;
+        else if( key == "length" )       config.m_LogLength = value;
+        else if( key == "dispatch" )     config.m_Dispatch = value != 0;
+        else if( key == "batchbytes" )   config.m_FlushPolicy.m_MaxBatchBytes = value;
+        else if( key == "batchpackets" ) config.m_FlushPolicy.m_MaxBatchPackets = value;
+        else if( key == "coalesce" )     config.m_FlushPolicy.m_CoalesceBytes = value;
+        else if( key == "latency" )      config.m_FlushPolicy.m_MaxLatencyUs = value;
+        else ORBIT_LOG( Format( "Unknown benchmark option: %s\n", key.c_str() ) );
+    }
+
+    return config;
+}
+
+//-----------------------------------------------------------------------------
+TcpBenchmarkResult::TcpBenchmarkResult() : m_Valid( false )
+                                         , m_Seconds( 0 )
+                                         , m_NumReceivedBytes( 0 )
+                                         , m_NumReceivedTimers( 0 )
+                                         , m_NumSentBatches( 0 )
+                                         , m_NumSentPackets( 0 )
+                                         , m_NumSentBytes( 0 )
+                                         , m_MessagesPerSecond( 0 )
+                                         , m_BytesPerSecond( 0 )
+                                         , m_TimersPerSecond( 0 )
+                                         , m_LatencyP50Us( 0 )
+                                         , m_LatencyP90Us( 0 )
+                                         , m_LatencyP99Us( 0 )
+                                         , m_LatencyMaxUs( 0 )
+                                         , m_MaxClientQueuedEntries( 0 )
+                                         , m_AvgClientQueuedEntries( 0 )
+                                         , m_MaxServerQueuedEntries( 0 )
+{
+    for( int i = 0; i < NUM_TRAFFIC_TYPES; ++i )
+    {
+        m_NumSent[i] = 0;
+        m_NumReceived[i] = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+std::vector< std::string > TcpBenchmarkResult::GetReport() const
+{
+    std::vector< std::string > report;
+    if( !m_Valid )
+    {
+        report.push_back( "TcpBenchmark failed to run\n" );
+        return report;
+    }
+
+    report.push_back( Format( "TcpBenchmark: %.2f s\n", m_Seconds ) );
+    report.push_back( Format( "  timers:     sent %llu received %llu messages\n", m_NumSent[TIMER], m_NumReceived[TIMER] ) );
+    report.push_back( Format( "  callstacks: sent %llu received %llu messages\n", m_NumSent[CALLSTACK], m_NumReceived[CALLSTACK] ) );
+    report.push_back( Format( "  logs:       sent %llu received %llu messages\n", m_NumSent[LOG], m_NumReceived[LOG] ) );
+    double packetsPerBatch = m_NumSentBatches ? double( m_NumSentPackets ) / double( m_NumSentBatches ) : 0.0;
+    report.push_back( Format( "  sent batches: %llu, %.1f packets/batch, %llu bytes\n", m_NumSentBatches, packetsPerBatch, m_NumSentBytes ) );
+    report.push_back( Format( "  messages/s: %.0f\n", m_MessagesPerSecond ) );
+    report.push_back( Format( "  timers/s:   %.0f\n", m_TimersPerSecond ) );
+    report.push_back( "  bytes/s:    " + ws2s( GetPrettySize( (ULONG64)m_BytesPerSecond ) ) + " ( " + GetPrettyBitRate( (ULONG64)m_BytesPerSecond ) + " )\n" );
+    report.push_back( Format( "  latency us: p50 %.1f p90 %.1f p99 %.1f max %.1f\n", m_LatencyP50Us, m_LatencyP90Us, m_LatencyP99Us, m_LatencyMaxUs ) );
+    report.push_back( Format( "  client queue: max %i avg %.1f\n", m_MaxClientQueuedEntries, m_AvgClientQueuedEntries ) );
+    report.push_back( Format( "  server timer queue: max %i\n", m_MaxServerQueuedEntries ) );
+    return report;
+}
@@ -0,0 +1,102 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "Core.h"
+#include "Message.h"
+#include "TcpEntity.h"
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Traffic replayed by TcpBenchmark. Each producer thread sends messages in a
+// weighted round robin of the three types, a weight of 0 disables a type.
+// m_MessagesPerSecond is the total rate over all producers, 0 sends as fast
+// as the transport drains, producers back off above m_MaxQueuedEntries.
+struct TcpBenchmarkConfig
+{
+    TcpBenchmarkConfig() : m_Port( 1789 )
+                         , m_DurationMs( 5000 )
+                         , m_NumProducers( 2 )
+                         , m_MessagesPerSecond( 0 )
+                         , m_MaxQueuedEntries( 100000 )
+                         , m_TimerWeight( 8 )
+                         , m_CallstackWeight( 1 )
+                         , m_LogWeight( 1 )
+                         , m_TimersPerMessage( 1024 )
+                         , m_CallstackDepth( 32 )
+                         , m_LogLength( 64 )
+                         , m_Dispatch( false ) {}
+
+    // "benchmark:duration=10,rate=20000,producers=4,timers=8,callstacks=1,logs=1,batch=1024,depth=32,length=64,dispatch=1"
+    // and the client's flush policy: "batchbytes=1048576,batchpackets=4096,coalesce=4096,latency=0".
+    // durations are in seconds, latency in microseconds, omitted keys keep their default
+    static TcpBenchmarkConfig Parse( const std::string & a_Argument );
+
+    unsigned short m_Port;
+    uint32_t       m_DurationMs;
+    uint32_t       m_NumProducers;
+    uint32_t       m_MessagesPerSecond;
+    int            m_MaxQueuedEntries;
+    uint32_t       m_TimerWeight;
+    uint32_t       m_CallstackWeight;
+    uint32_t       m_LogWeight;
+    uint32_t       m_TimersPerMessage;
+    uint32_t       m_CallstackDepth;
+    uint32_t       m_LogLength;
+
+    // Let benchmark messages through to the regular TcpServer handlers
+    // instead of dropping them once measured, includes the decoding cost.
+    bool           m_Dispatch;
+
+    TcpFlushPolicy m_FlushPolicy;
+};
+
+//-----------------------------------------------------------------------------
+struct TcpBenchmarkResult
+{
+    enum Traffic { TIMER, CALLSTACK, LOG, NUM_TRAFFIC_TYPES };
+
+    TcpBenchmarkResult();
+    std::vector< std::string > GetReport() const;
+
+    bool     m_Valid;
+    double   m_Seconds;
+    uint64_t m_NumSent[NUM_TRAFFIC_TYPES];
+    uint64_t m_NumReceived[NUM_TRAFFIC_TYPES];
+    uint64_t m_NumReceivedBytes;
+    uint64_t m_NumReceivedTimers;
+    uint64_t m_NumSentBatches;
+    uint64_t m_NumSentPackets;
+    uint64_t m_NumSentBytes;
+    double   m_MessagesPerSecond;
+    double   m_BytesPerSecond;
+    double   m_TimersPerSecond;
+
+    // End-to-end latency from TcpEntity::Send to TcpServer::Receive
+    double   m_LatencyP50Us;
+    double   m_LatencyP90Us;
+    double   m_LatencyP99Us;
+    double   m_LatencyMaxUs;
+
+    // Client send queue and, when dispatching, the server timer queue
+    int      m_MaxClientQueuedEntries;
+    double   m_AvgClientQueuedEntries;
+    int      m_MaxServerQueuedEntries;
+};
+
+//-----------------------------------------------------------------------------
+// Loopback throughput and soak test of the TcpEntity -> TcpServer path. A
+// send-only client connects to GTcpServer on 127.0.0.1 and replays synthetic
+// Msg_Timer, Msg_Callstack and Msg_OrbitLog traffic, no target process is
+// involved. Blocks for the duration of the run, GTcpServer must not have a
+// connection and must not be capturing.
+// Runs inside Orbit with the "benchmark:..." argument, so Windows only like
+// the rest of the Tcp code. The Linux build doesn't include the transport.
+class TcpBenchmark
+{
+public:
+    static TcpBenchmarkResult Run( const TcpBenchmarkConfig & a_Config );
+};
@@ -157,6 +157,13 @@ void TcpClient::DecodeMessage( Message & a_Message )
 {
     Message::Header MessageHeader = a_Message.GetHeader();
 
+    // Argument tracking comes as one Msg_ArgTracking per function, the
+    // resulting map is published once the batch is over
+    if( a_Message.GetType() != Msg_ArgTracking )
+    {
+        Hijacking::PublishFunctionArguments();
+    }
+
     switch( a_Message.GetType() )
     {
     case Msg_String:
@@ -351,6 +358,17 @@ void TcpClient::DecodeMessage( Message & a_Message )
     case Msg_ThawMainThread:
         Hijacking::ThawMainThread( (OrbitWaitLoop*)a_Message.GetData() );
         break;
+    case Msg_HashReturnAddresses:
+        Hijacking::SetHashReturnAddresses( *( (int*)a_Message.GetData() ) != 0 );
+        break;
+    case Msg_SetCompression:
+    {
+        // Acknowledge so the server knows batches may arrive compressed
+        int enabled = *( (int*)a_Message.GetData() );
+        SetCompression( enabled != 0 );
+        Send( Msg_SetCompression, enabled );
+        break;
+    }
     case Msg_ClearArgTracking:
     {
         Hijacking::ClearFunctionArguments();
@@ -375,7 +393,6 @@ void TcpClient::DecodeMessage( Message & a_Message )
         
         Argument* argPtr = (Argument*)a_Message.GetData();
         FunctionArgInfo argInfo;
-        argInfo.m_NumStackBytes = 1; // used so that epilog knows we need to send argInfo
         for( int i = 0; i < header.m_NumArgs; ++i )
         {
             // TODO: x86: Check if arg is actually on stack or in register
@@ -7,9 +7,22 @@
 #include "Tcp.h"
 #include "Log.h"
 #include "OrbitAsio.h"
+#include "Profiling.h"
+#include <chrono>
 
 //-----------------------------------------------------------------------------
-TcpEntity::TcpEntity() : m_NumQueuedEntries(0)
+// Slabs larger than this go back to the heap instead of the pool, and the pool
+// never holds more than MAX_POOLED_BYTES of the profiled process' memory
+static const size_t MAX_POOLED_SLAB_SIZE = 64 * 1024;
+static const size_t MAX_POOLED_BYTES = 16 * 1024 * 1024;
+
+//-----------------------------------------------------------------------------
+TcpEntity::TcpEntity() : m_NumFreeSlabBytes(0)
+                       , m_NumQueuedEntries(0)
+                       , m_CompressionEnabled(false)
+                       , m_NumSentBatches(0)
+                       , m_NumSentPackets(0)
+                       , m_NumSentBytes(0)
 {
     PRINT_FUNC;
     m_TcpSocket = new TcpSocket();
@@ -19,6 +32,17 @@ TcpEntity::TcpEntity() : m_NumQueuedEntries(0)
 //-----------------------------------------------------------------------------
 TcpEntity::~TcpEntity()
 {
+    TcpPacket packet;
+    while( m_SendQueue.try_dequeue( packet ) )
+    {
+        delete packet.Slab();
+    }
+
+    TcpSlab* slab = nullptr;
+    while( m_FreeSlabs.try_dequeue( slab ) )
+    {
+        delete slab;
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -53,11 +77,43 @@ void TcpEntity::Stop()
     }
 }
 
+//-----------------------------------------------------------------------------
+TcpSlab* TcpEntity::AcquireSlab()
+{
+    TcpSlab* slab = nullptr;
+    if( m_FreeSlabs.try_dequeue( slab ) )
+    {
+        m_NumFreeSlabBytes -= slab->m_Capacity;
+        return slab;
+    }
+
+    return new TcpSlab();
+}
+
+//-----------------------------------------------------------------------------
+void TcpEntity::ReleaseSlab( TcpSlab* a_Slab )
+{
+    size_t capacity = a_Slab->m_Capacity;
+    if( capacity <= MAX_POOLED_SLAB_SIZE )
+    {
+        // Reserve the bytes first so that concurrent releases can't overshoot
+        if( m_NumFreeSlabBytes.fetch_add( capacity ) + capacity <= MAX_POOLED_BYTES )
+        {
+            m_FreeSlabs.enqueue( a_Slab );
+            return;
+        }
+
+        m_NumFreeSlabBytes -= capacity;
+    }
+
+    delete a_Slab;
+}
+
 //-----------------------------------------------------------------------------
 void TcpEntity::SendMsg( Message & a_Message, const void* a_Payload )
 {
-    TcpPacket buffer( a_Message, a_Payload );
-    m_SendQueue.enqueue( buffer );
+    TcpPacket packet( AcquireSlab(), a_Message, a_Payload );
+    m_SendQueue.enqueue( packet );
     ++m_NumQueuedEntries;
     m_ConditionVariable.signal();
 }
@@ -68,16 +124,21 @@ void TcpEntity::FlushSendQueue()
     m_FlushRequested = true;
 
     const size_t numItems = 4096;
-    TcpPacket Timers[numItems];
+    std::vector< TcpPacket > packets( numItems );
     m_NumFlushedItems = 0;
 
     while( !m_ExitRequested )
     {
-        size_t numDequeued = m_SendQueue.try_dequeue_bulk( Timers, numItems );
+        size_t numDequeued = m_SendQueue.try_dequeue_bulk( packets.data(), numItems );
 
         if( numDequeued == 0 )
             break;
 
+        for( size_t i = 0; i < numDequeued; ++i )
+        {
+            ReleaseSlab( packets[i].Slab() );
+        }
+
         m_NumQueuedEntries -= (int)numDequeued;
         m_NumFlushedItems += (int)numDequeued;
     }
@@ -91,29 +152,172 @@ void TcpEntity::SendData()
 {
     SetThreadName( GetCurrentThreadId(), "TcpSender" );
 
+    const TcpFlushPolicy policy = m_FlushPolicy;
+    std::vector< TcpPacket > packets( std::max( policy.m_MaxBatchPackets, 1u ) );
+
     while( !m_ExitRequested )
     {
-        // Wait for non-empty queue
-        while( m_NumQueuedEntries <= 0 && !m_ExitRequested )
+        // Wait for non-empty queue, FlushSendQueue signals once it is done
+        while( ( m_NumQueuedEntries <= 0 || m_FlushRequested ) && !m_ExitRequested )
         {
             m_ConditionVariable.wait();
         }
 
-        // Send messages
-        TcpPacket buffer;
-        while( !m_ExitRequested && !m_FlushRequested && m_SendQueue.try_dequeue( buffer ) )
+        // Gather a batch
+        size_t numPackets = 0;
+        size_t numBytes = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds( policy.m_MaxLatencyUs );
+
+        while( !m_ExitRequested && !m_FlushRequested && numPackets < packets.size() && numBytes < policy.m_MaxBatchBytes )
         {
-            --m_NumQueuedEntries;
-            Message* msg = (Message*)buffer.Data()->data();
-            TcpSocket* socket = GetSocket();
-            if( socket && socket->m_Socket && socket->m_Socket->is_open() )
+            size_t numDequeued = m_SendQueue.try_dequeue_bulk( packets.data() + numPackets, packets.size() - numPackets );
+            for( size_t i = numPackets; i < numPackets + numDequeued; ++i )
             {
-                asio::write( *socket->m_Socket, shared_const_buffer( buffer ) );
+                numBytes += packets[i].Size();
             }
-            else
+
+            numPackets += numDequeued;
+
+            if( numDequeued == 0 )
             {
-                ORBIT_ERROR;
+                if( numPackets == 0 || std::chrono::steady_clock::now() >= deadline )
+                    break;
+
+                std::this_thread::yield();
             }
         }
+
+        if( numPackets == 0 )
+        {
+            continue;
+        }
+
+        m_NumQueuedEntries -= (int)numPackets;
+        WriteBatch( packets.data(), numPackets, policy );
+
+        for( size_t i = 0; i < numPackets; ++i )
+        {
+            ReleaseSlab( packets[i].Slab() );
+        }
     }
 }
+
+//-----------------------------------------------------------------------------
+void TcpEntity::WriteBatch( const TcpPacket* a_Packets, size_t a_NumPackets, const TcpFlushPolicy & a_Policy )
+{
+    TcpSocket* socket = GetSocket();
+    if( !socket || !socket->m_Socket || !socket->m_Socket->is_open() )
+    {
+        ORBIT_ERROR;
+        return;
+    }
+
+    std::vector< asio::const_buffer > buffers;
+    size_t numBytes = m_CompressionEnabled ? GatherCompressed( a_Packets, a_NumPackets, buffers )
+                                           : GatherCoalesced( a_Packets, a_NumPackets, a_Policy.m_CoalesceBytes, buffers );
+
+    asio::error_code error;
+    asio::write( *socket->m_Socket, buffers, error );
+    if( error )
+    {
+        ORBIT_LOG( Format( "TcpEntity::WriteBatch failed: %s\n", error.message().c_str() ) );
+        return;
+    }
+
+    ++m_NumSentBatches;
+    m_NumSentPackets += a_NumPackets;
+    m_NumSentBytes += numBytes;
+}
+
+//-----------------------------------------------------------------------------
+size_t TcpEntity::GatherCoalesced( const TcpPacket* a_Packets, size_t a_NumPackets, size_t a_CoalesceBytes, std::vector< asio::const_buffer > & o_Buffers )
+{
+    // Size the coalescing slab first, buffers point into it
+    size_t coalescedSize = 0;
+    for( size_t i = 0; i < a_NumPackets; ++i )
+    {
+        if( a_Packets[i].Size() <= a_CoalesceBytes )
+        {
+            coalescedSize += a_Packets[i].Size();
+        }
+    }
+
+    m_CoalesceSlab.Resize( coalescedSize );
+
+    char* coalesced = m_CoalesceSlab.m_Data.get();
+    char* runBegin = coalesced;
+    size_t numBytes = 0;
+
+    for( size_t i = 0; i < a_NumPackets; ++i )
+    {
+        const TcpPacket & packet = a_Packets[i];
+        numBytes += packet.Size();
+
+        if( packet.Size() <= a_CoalesceBytes )
+        {
+            memcpy( coalesced, packet.Data(), packet.Size() );
+            coalesced += packet.Size();
+            continue;
+        }
+
+        // Large packets are written straight from their slab, in order
+        if( coalesced != runBegin )
+        {
+            o_Buffers.push_back( asio::buffer( runBegin, coalesced - runBegin ) );
+            runBegin = coalesced;
+        }
+
+        o_Buffers.push_back( asio::buffer( packet.Data(), packet.Size() ) );
+    }
+
+    if( coalesced != runBegin )
+    {
+        o_Buffers.push_back( asio::buffer( runBegin, coalesced - runBegin ) );
+    }
+
+    return numBytes;
+}
+
+//-----------------------------------------------------------------------------
+size_t TcpEntity::GatherCompressed( const TcpPacket* a_Packets, size_t a_NumPackets, std::vector< asio::const_buffer > & o_Buffers )
+{
+    TickType startTicks = OrbitTicks();
+
+    size_t uncompressedSize = 0;
+    for( size_t i = 0; i < a_NumPackets; ++i )
+    {
+        uncompressedSize += a_Packets[i].Size();
+    }
+
+    m_CoalesceSlab.Resize( uncompressedSize );
+    char* uncompressed = m_CoalesceSlab.m_Data.get();
+    for( size_t i = 0; i < a_NumPackets; ++i )
+    {
+        memcpy( uncompressed, a_Packets[i].Data(), a_Packets[i].Size() );
+        uncompressed += a_Packets[i].Size();
+    }
+
+    size_t maxCompressedSize = BlockCompressor::GetMaxCompressedSize( uncompressedSize );
+    m_CompressedSlab.Resize( sizeof( Message ) + maxCompressedSize + 4 );
+    char* data = m_CompressedSlab.m_Data.get();
+    size_t compressedSize = m_Compressor.Compress( m_CoalesceSlab.m_Data.get(), uncompressedSize, data + sizeof( Message ), maxCompressedSize );
+
+    // Incompressible, send the coalesced messages as they are
+    if( compressedSize == 0 || compressedSize >= uncompressedSize )
+    {
+        o_Buffers.push_back( asio::buffer( m_CoalesceSlab.m_Data.get(), uncompressedSize ) );
+        return uncompressedSize;
+    }
+
+    Message msg( Msg_CompressedBatch, (int)compressedSize );
+    msg.m_Header.m_CompressionHeader.m_UncompressedSize = (unsigned int)uncompressedSize;
+    msg.m_Header.m_CompressionHeader.m_CompressMicros = (unsigned int)MicroSecondsFromTicks( startTicks, OrbitTicks() );
+    memcpy( data, &msg, sizeof( Message ) );
+
+    const unsigned int footer = MAGIC_FOOT_MSG;
+    memcpy( data + sizeof( Message ) + compressedSize, &footer, 4 );
+
+    size_t numBytes = sizeof( Message ) + compressedSize + 4;
+    o_Buffers.push_back( asio::buffer( data, numBytes ) );
+    return numBytes;
+}
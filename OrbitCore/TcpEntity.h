@@ -6,38 +6,86 @@
 #include "Message.h"
 #include "TcpForward.h"
 #include "Threading.h"
+#include "BlockCompressor.h"
 #include "../OrbitPlugin/OrbitUserData.h"
 
 #include <type_traits>
 #include <vector>
 #include <atomic>
+#include <memory>
 
 //-----------------------------------------------------------------------------
+// Reusable byte buffer, storage only grows
+struct TcpSlab
+{
+    TcpSlab() : m_Capacity(0), m_Size(0) {}
+
+    void Resize( size_t a_Size )
+    {
+        if( a_Size > m_Capacity )
+        {
+            m_Data.reset( new char[a_Size] );
+            m_Capacity = a_Size;
+        }
+
+        m_Size = a_Size;
+    }
+
+    std::unique_ptr<char[]> m_Data;
+    size_t                  m_Capacity;
+    size_t                  m_Size;
+};
+
+//-----------------------------------------------------------------------------
+// Serialized message (header, payload and footer) in a pooled slab
 class TcpPacket
 {
 public:
-    TcpPacket(){}
-    explicit TcpPacket( const Message & a_Message
+    TcpPacket() : m_Slab( nullptr ){}
+    explicit TcpPacket( TcpSlab* a_Slab
+                      , const Message & a_Message
                       , const void* a_Payload )
-                      : m_Data( new std::vector<char>() )
+                      : m_Slab( a_Slab )
     {
-        m_Data->resize( sizeof( Message ) + a_Message.m_Size + 4 );
-        memcpy( m_Data->data(), &a_Message, sizeof( Message ) );
+        m_Slab->Resize( sizeof( Message ) + a_Message.m_Size + 4 );
+        char* data = m_Slab->m_Data.get();
+        memcpy( data, &a_Message, sizeof( Message ) );
 
         if( a_Payload )
         {
-            memcpy( m_Data->data() + sizeof( Message ), a_Payload, a_Message.m_Size );
+            memcpy( data + sizeof( Message ), a_Payload, a_Message.m_Size );
         }
 
         // Footer
         const unsigned int footer = MAGIC_FOOT_MSG;
-        memcpy( m_Data->data() + sizeof( Message ) + a_Message.m_Size, &footer, 4 );
+        memcpy( data + sizeof( Message ) + a_Message.m_Size, &footer, 4 );
     }
 
-    std::shared_ptr< std::vector<char> > Data() { return m_Data; };
+    const char* Data() const { return m_Slab->m_Data.get(); }
+    size_t      Size() const { return m_Slab->m_Size; }
+    TcpSlab*    Slab() const { return m_Slab; }
 
 private:
-    std::shared_ptr< std::vector<char> > m_Data;
+    TcpSlab* m_Slab;
+};
+
+//-----------------------------------------------------------------------------
+// The sender thread writes queued packets in batches, one vectored write per
+// batch. Packets up to m_CoalesceBytes are copied back to back so a batch of
+// small messages is a single contiguous buffer. An under-filled batch waits
+// at most m_MaxLatencyUs for more packets, 0 writes as soon as the queue is
+// drained.
+struct TcpFlushPolicy
+{
+    TcpFlushPolicy() : m_MaxBatchBytes( 1024 * 1024 )
+                     , m_MaxBatchPackets( 4096 )
+                     , m_CoalesceBytes( 4096 )
+                     , m_MaxLatencyUs( 0 ) {}
+
+    size_t   m_MaxBatchBytes;
+    uint32_t m_MaxBatchPackets;
+    size_t   m_CoalesceBytes;
+    uint32_t m_MaxLatencyUs;
 };
 
 //-----------------------------------------------------------------------------
@@ -51,6 +99,19 @@ public:
     void Stop();
     void FlushSendQueue();
 
+    // Must be set before Start
+    void SetFlushPolicy( const TcpFlushPolicy & a_Policy ) { m_FlushPolicy = a_Policy; }
+    const TcpFlushPolicy & GetFlushPolicy() const { return m_FlushPolicy; }
+    uint64_t GetNumSentBatches() const { return m_NumSentBatches; }
+    uint64_t GetNumSentPackets() const { return m_NumSentPackets; }
+    uint64_t GetNumSentBytes() const { return m_NumSentBytes; }
+
+    // While enabled, each batch is sent as one Msg_CompressedBatch, which
+    // TcpConnection expands back into the original messages. Batches that
+    // don't shrink are sent as they are. Can be toggled at any time.
+    void SetCompression( bool a_Enabled ) { m_CompressionEnabled = a_Enabled; }
+    bool GetCompression() const { return m_CompressionEnabled; }
+
     // Note: All Send methods can be called concurrently from multiple threads
     inline void Send(MessageType a_Type) { Message msg(a_Type); SendMsg(msg, nullptr); }
     inline void Send(Message & a_Message, void* a_Data);
@@ -69,6 +130,12 @@ protected:
     void SendMsg( Message & a_Message, const void* a_Payload );
     virtual TcpSocket* GetSocket() = 0;
     void SendData();
+    void WriteBatch( const TcpPacket* a_Packets, size_t a_NumPackets, const TcpFlushPolicy & a_Policy );
+    size_t GatherCoalesced( const TcpPacket* a_Packets, size_t a_NumPackets, size_t a_CoalesceBytes, std::vector< asio::const_buffer > & o_Buffers );
+    size_t GatherCompressed( const TcpPacket* a_Packets, size_t a_NumPackets, std::vector< asio::const_buffer > & o_Buffers );
+
+    TcpSlab* AcquireSlab();
+    void     ReleaseSlab( TcpSlab* a_Slab );
 
 protected:
     TcpService*                m_TcpService;
@@ -76,7 +143,17 @@ protected:
     std::thread*               m_SenderThread;
     AutoResetEvent             m_ConditionVariable;
     LockFreeQueue< TcpPacket > m_SendQueue;
+    LockFreeQueue< TcpSlab* >  m_FreeSlabs;
+    std::atomic<size_t>        m_NumFreeSlabBytes;
     std::atomic<int>           m_NumQueuedEntries;
+    TcpFlushPolicy             m_FlushPolicy;
+    TcpSlab                    m_CoalesceSlab;
+    TcpSlab                    m_CompressedSlab;
+    BlockCompressor            m_Compressor;
+    std::atomic<bool>          m_CompressionEnabled;
+    std::atomic<uint64_t>      m_NumSentBatches;
+    std::atomic<uint64_t>      m_NumSentPackets;
+    std::atomic<uint64_t>      m_NumSentBytes;
     std::atomic<bool>          m_ExitRequested = false;
     std::atomic<bool>          m_FlushRequested = false;
     std::atomic<int>           m_NumFlushedItems = 0;
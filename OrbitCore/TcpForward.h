@@ -12,6 +12,7 @@ class TcpService;
 namespace asio
 {
 	class io_context;
+	class const_buffer;
 }
 
 #define MAX_WS_HEADER_LENGTH    14
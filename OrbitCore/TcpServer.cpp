@@ -16,6 +16,7 @@
 #include "OrbitUnreal.h"
 
 #include <thread>
+#include <future>
 
 TcpServer* GTcpServer;
 
@@ -33,6 +34,13 @@ TcpServer::TcpServer() : m_TcpServer(nullptr)
     m_NumTargetFlushedEntries = 0;
     m_NumTargetFlushedTcpPackets = 0;
     m_NumMessagesFromPreviousSession = 0;
+    m_NumReceivedTimers = 0;
+    m_NumReceivedTimerBytes = 0;
+    m_CompressionEnabled = false;
+    m_CompressionCpuPercent = 0;
+    m_DecompressionCpuPercent = 0;
+    m_LastCompressMicros = 0;
+    m_LastDecompressMicros = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -62,6 +70,10 @@ void TcpServer::Start( unsigned short a_Port )
 void TcpServer::ResetStats()
 {
     m_NumReceivedMessages = 0;
+    m_NumReceivedTimers = 0;
+    m_NumReceivedTimerBytes = 0;
+    m_LastCompressMicros = 0;
+    m_LastDecompressMicros = 0;
     m_TcpServer->ResetStats();
 }
 
@@ -80,6 +92,28 @@ std::vector<std::string> TcpServer::GetStats()
             + " ( " + GetPrettyBitRate( (ULONG64)m_BytesPerSecond ) + " )\n";
     
     stats.push_back( bitRate );
+
+    TcpCompressionStats compression = m_TcpServer->GetCompressionStats();
+    if( m_CompressionEnabled || compression.m_NumBatches > 0 )
+    {
+        double compressionRatio = compression.m_NumCompressedBytes ? double( compression.m_NumUncompressedBytes ) / double( compression.m_NumCompressedBytes ) : 0.0;
+        stats.push_back( VAR_TO_ANSI( m_CompressionEnabled ) );
+        stats.push_back( VAR_TO_ANSI( compressionRatio ) );
+        stats.push_back( VAR_TO_ANSI( m_CompressionCpuPercent ) );
+        stats.push_back( VAR_TO_ANSI( m_DecompressionCpuPercent ) );
+    }
+
+    double bytesPerTimer = m_NumReceivedTimers ? double( m_NumReceivedTimerBytes ) / double( m_NumReceivedTimers ) : 0.0;
+    stats.push_back( VAR_TO_ANSI( bytesPerTimer ) );
+
+    // Host to target traffic
+    uint64_t numSentPackets = GetNumSentPackets();
+    double packetsPerBatch = GetNumSentBatches() ? double( numSentPackets ) / double( GetNumSentBatches() ) : 0.0;
+    stats.push_back( VAR_TO_ANSI( numSentPackets ) );
+    stats.push_back( VAR_TO_ANSI( packetsPerBatch ) );
+
+    std::vector<std::string> connectionStats = m_TcpServer->GetStats();
+    stats.insert( stats.end(), connectionStats.begin(), connectionStats.end() );
     return stats;
 }
 
@@ -102,6 +136,11 @@ void TcpServer::Receive( const Message & a_Message )
         return;
     }
 
+    if( m_ReceiveHook && m_ReceiveHook( a_Message ) )
+    {
+        return;
+    }
+
     switch (a_Message.GetType())
     {
     case Msg_String:
@@ -113,12 +152,19 @@ void TcpServer::Receive( const Message & a_Message )
     }
     case Msg_Timer:
     {
-        int numTimers = a_Message.m_Size/sizeof(Timer);
-        Timer* timers = (Timer*)a_Message.GetData();
-        for (int i = 0; i < numTimers; ++i)
+        // Decode straight into a pooled block, handed over to the consumer as a whole
+        TimerManager::TimerBlock* timers = GTimerManager->AcquireTimerBlock();
+        if( !m_TimerDecoder.Decode( a_Message.GetData(), a_Message.m_Size, *timers ) )
         {
-            GTimerManager->Add(timers[i]);
+            GTimerManager->ReleaseTimerBlock( timers );
+            ORBIT_LOG( "Received malformed timer batch" );
+            break;
         }
+
+        int numTimers = (int)timers->size();
+        GTimerManager->AddTimerBlock( timers );
+        m_NumReceivedTimers += numTimers;
+        m_NumReceivedTimerBytes += a_Message.m_Size;
         
         if( numTimers > m_MaxTimersAtOnce )
         {
@@ -137,6 +183,9 @@ void TcpServer::Receive( const Message & a_Message )
     case Msg_NumFlushedItems:
         m_NumTargetFlushedTcpPackets = *( (int*)a_Message.GetData() );
         break;
+    case Msg_SetCompression:
+        m_CompressionEnabled = *( (int*)a_Message.GetData() ) != 0;
+        break;
     case Msg_NumInstalledHooks:
         Capture::GNumInstalledHooks = *((int*)a_Message.GetData());
         break;
@@ -219,6 +268,19 @@ void TcpServer::MainThreadTick()
         ULONG64 numBytesReceived = m_TcpServer ? m_TcpServer->GetNumBytesReceived() : 0;
         m_BytesPerSecond = (double( numBytesReceived - m_LastNumBytes))/(elapsedTime*0.001);
         m_LastNumBytes = numBytesReceived;
+
+        // Counters restart with each connection
+        TcpCompressionStats compression = m_TcpServer ? m_TcpServer->GetCompressionStats() : TcpCompressionStats();
+        if( compression.m_CompressMicros < m_LastCompressMicros || compression.m_DecompressMicros < m_LastDecompressMicros )
+        {
+            m_LastCompressMicros = 0;
+            m_LastDecompressMicros = 0;
+        }
+
+        m_CompressionCpuPercent = 0.1 * double( compression.m_CompressMicros - m_LastCompressMicros ) / elapsedTime;
+        m_DecompressionCpuPercent = 0.1 * double( compression.m_DecompressMicros - m_LastDecompressMicros ) / elapsedTime;
+        m_LastCompressMicros = compression.m_CompressMicros;
+        m_LastDecompressMicros = compression.m_DecompressMicros;
         m_StatTimer.Reset();
     }
 
@@ -261,6 +323,18 @@ bool TcpServer::HasConnection()
     return m_TcpServer->HasConnection();
 }
 
+//-----------------------------------------------------------------------------
+void TcpServer::ResetConnection()
+{
+    std::promise<void> done;
+    asio::post( *m_TcpService->m_IoService, [&]()
+    {
+        m_TcpServer->RegisterConnection( nullptr );
+        done.set_value();
+    } );
+    done.get_future().wait();
+}
+
 //-----------------------------------------------------------------------------
 void TcpServer::ServerThread()
 {
@@ -5,6 +5,7 @@
 
 #include "Core.h"
 #include "TcpEntity.h"
+#include "TimerCodec.h"
 #include <functional>
 #include <unordered_map>
 
@@ -28,10 +29,19 @@ public:
 
     void SetCallback( MessageType a_MsgType, MsgCallback a_Callback ) { m_Callbacks[a_MsgType] = a_Callback; }
     void SetUiCallback( StrCallback a_Callback ){ m_UiCallback = a_Callback; }
+
+    // Sees every message of the current session before it is dispatched,
+    // returning true consumes it. Only change it while nothing is connected.
+    typedef std::function< bool( const Message & ) > ReceiveHook;
+    void SetReceiveHook( ReceiveHook a_Hook ){ m_ReceiveHook = a_Hook; }
     void MainThreadTick();
 
     void Disconnect();
     bool HasConnection();
+
+    // Forgets the connection without notifying the target. Runs on the io
+    // thread, which might still be reading from it, and waits for it.
+    void ResetConnection();
     
     bool IsLocalConnection();
 
@@ -48,6 +58,7 @@ private:
     class tcp_server*                         m_TcpServer;
     std::unordered_map< int, MsgCallback >    m_Callbacks;
     StrCallback                               m_UiCallback;
+    ReceiveHook                               m_ReceiveHook;
     moodycamel::ConcurrentQueue<std::wstring> m_UiLockFreeQueue;
     
     Timer   m_StatTimer;
@@ -62,6 +73,17 @@ private:
     int     m_NumTargetFlushedEntries;
     int     m_NumTargetFlushedTcpPackets;
     ULONG64 m_NumMessagesFromPreviousSession;
+    ULONG64 m_NumReceivedTimers;
+    ULONG64 m_NumReceivedTimerBytes;
+
+    // Negotiated with Msg_SetCompression, cpu costs are in percent of a core
+    bool    m_CompressionEnabled;
+    double  m_CompressionCpuPercent;
+    double  m_DecompressionCpuPercent;
+    ULONG64 m_LastCompressMicros;
+    ULONG64 m_LastDecompressMicros;
+
+    TimerDecoder       m_TimerDecoder;
 };
 
 extern TcpServer* GTcpServer;
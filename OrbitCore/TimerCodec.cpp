@@ -0,0 +1,203 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "TimerCodec.h"
+
+//-----------------------------------------------------------------------------
+static inline uint8_t* WriteVarint( uint8_t* a_Dest, uint64_t a_Value )
+{
+    while( a_Value >= 0x80 )
+    {
+        *a_Dest++ = uint8_t( a_Value | 0x80 );
+        a_Value >>= 7;
+    }
+    *a_Dest++ = uint8_t( a_Value );
+    return a_Dest;
+}
+
+//-----------------------------------------------------------------------------
+static inline bool ReadVarint( const uint8_t* & a_Src, const uint8_t* a_End, uint64_t & o_Value )
+{
+    o_Value = 0;
+    for( int shift = 0; shift < 64; shift += 7 )
+    {
+        if( a_Src == a_End )
+            return false;
+
+        uint8_t byte = *a_Src++;
+        o_Value |= uint64_t( byte & 0x7F ) << shift;
+        if( ( byte & 0x80 ) == 0 )
+            return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+static inline uint64_t ZigZag( int64_t a_Value )
+{
+    return ( uint64_t( a_Value ) << 1 ) ^ uint64_t( a_Value >> 63 );
+}
+
+//-----------------------------------------------------------------------------
+static inline int64_t UnZigZag( uint64_t a_Value )
+{
+    return int64_t( a_Value >> 1 ) ^ -int64_t( a_Value & 1 );
+}
+
+//-----------------------------------------------------------------------------
+uint32_t TimerEncoder::GetIndex( std::unordered_map< uint64_t, uint32_t > & a_Dictionary, uint64_t a_Value, bool & o_IsNew )
+{
+    auto result = a_Dictionary.emplace( a_Value, (uint32_t)a_Dictionary.size() );
+    o_IsNew = result.second;
+    return result.first->second;
+}
+
+//-----------------------------------------------------------------------------
+void TimerEncoder::Encode( const Timer* a_Timers, size_t a_NumTimers, std::vector<uint8_t> & o_Buffer )
+{
+    m_Threads.clear();
+    m_Functions.clear();
+    m_Callstacks.clear();
+    m_LastStart.clear();
+
+    o_Buffer.resize( TimerCodec::GetMaxEncodedSize( a_NumTimers ) );
+    uint8_t* dest = o_Buffer.data();
+
+    int8_t sessionId = a_NumTimers > 0 ? a_Timers[0].m_SessionID : -1;
+    *dest++ = TimerCodec::VERSION;
+    *dest++ = uint8_t( sessionId );
+    dest = WriteVarint( dest, a_NumTimers );
+
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        const Timer & timer = a_Timers[i];
+
+        uint8_t flags = uint8_t( timer.m_Type ) & TimerCodec::TYPE_MASK;
+        if( timer.m_UserData[0] )             flags |= TimerCodec::HAS_USER_DATA0;
+        if( timer.m_UserData[1] )             flags |= TimerCodec::HAS_USER_DATA1;
+        if( timer.m_SessionID != sessionId )  flags |= TimerCodec::HAS_SESSION;
+        if( timer.m_Processor != -1 )         flags |= TimerCodec::HAS_PROCESSOR;
+        *dest++ = flags;
+
+        bool isNew;
+        uint32_t threadIndex = GetIndex( m_Threads, (uint32_t)timer.m_TID, isNew );
+        dest = WriteVarint( dest, threadIndex );
+        if( isNew )
+        {
+            dest = WriteVarint( dest, (uint32_t)timer.m_TID );
+            m_LastStart.push_back( 0 );
+        }
+
+        *dest++ = uint8_t( timer.m_Depth );
+        if( flags & TimerCodec::HAS_PROCESSOR ) *dest++ = uint8_t( timer.m_Processor );
+        if( flags & TimerCodec::HAS_SESSION )   *dest++ = uint8_t( timer.m_SessionID );
+
+        uint32_t functionIndex = GetIndex( m_Functions, timer.m_FunctionAddress, isNew );
+        dest = WriteVarint( dest, functionIndex );
+        if( isNew ) dest = WriteVarint( dest, timer.m_FunctionAddress );
+
+        uint32_t callstackIndex = GetIndex( m_Callstacks, timer.m_CallstackHash, isNew );
+        dest = WriteVarint( dest, callstackIndex );
+        if( isNew ) dest = WriteVarint( dest, timer.m_CallstackHash );
+
+        TickType & lastStart = m_LastStart[threadIndex];
+        dest = WriteVarint( dest, ZigZag( int64_t( timer.m_Start - lastStart ) ) );
+        dest = WriteVarint( dest, ZigZag( int64_t( timer.m_End - timer.m_Start ) ) );
+        lastStart = timer.m_Start;
+
+        if( flags & TimerCodec::HAS_USER_DATA0 ) dest = WriteVarint( dest, timer.m_UserData[0] );
+        if( flags & TimerCodec::HAS_USER_DATA1 ) dest = WriteVarint( dest, timer.m_UserData[1] );
+    }
+
+    o_Buffer.resize( dest - o_Buffer.data() );
+}
+
+//-----------------------------------------------------------------------------
+bool TimerDecoder::Decode( const char* a_Data, size_t a_Size, std::vector<Timer> & o_Timers )
+{
+    m_Threads.clear();
+    m_Functions.clear();
+    m_Callstacks.clear();
+    m_LastStart.clear();
+    o_Timers.clear();
+
+    const uint8_t* src = (const uint8_t*)a_Data;
+    const uint8_t* end = src + a_Size;
+    uint64_t value = 0;
+
+    if( a_Size < 2 || *src++ != TimerCodec::VERSION )
+        return false;
+
+    int8_t sessionId = int8_t( *src++ );
+    if( !ReadVarint( src, end, value ) || value > a_Size )
+        return false;
+
+    o_Timers.resize( (size_t)value );
+
+    for( Timer & timer : o_Timers )
+    {
+        if( end - src < 2 )
+            return false;
+
+        uint8_t flags = *src++;
+        timer.m_Type = Timer::Type( flags & TimerCodec::TYPE_MASK );
+        timer.m_SessionID = sessionId;
+
+        if( !ReadVarint( src, end, value ) || value > m_Threads.size() )
+            return false;
+        size_t threadIndex = (size_t)value;
+        if( threadIndex == m_Threads.size() )
+        {
+            if( !ReadVarint( src, end, value ) )
+                return false;
+            m_Threads.push_back( (int)value );
+            m_LastStart.push_back( 0 );
+        }
+        timer.m_TID = m_Threads[threadIndex];
+
+        int numBytes = 1 + ( ( flags & TimerCodec::HAS_PROCESSOR ) ? 1 : 0 ) + ( ( flags & TimerCodec::HAS_SESSION ) ? 1 : 0 );
+        if( end - src < numBytes )
+            return false;
+        timer.m_Depth = int8_t( *src++ );
+        if( flags & TimerCodec::HAS_PROCESSOR ) timer.m_Processor = int8_t( *src++ );
+        if( flags & TimerCodec::HAS_SESSION )   timer.m_SessionID = int8_t( *src++ );
+
+        if( !ReadVarint( src, end, value ) || value > m_Functions.size() )
+            return false;
+        if( value == m_Functions.size() )
+        {
+            DWORD64 address;
+            if( !ReadVarint( src, end, address ) )
+                return false;
+            m_Functions.push_back( address );
+        }
+        timer.m_FunctionAddress = m_Functions[(size_t)value];
+
+        if( !ReadVarint( src, end, value ) || value > m_Callstacks.size() )
+            return false;
+        if( value == m_Callstacks.size() )
+        {
+            DWORD64 hash;
+            if( !ReadVarint( src, end, hash ) )
+                return false;
+            m_Callstacks.push_back( hash );
+        }
+        timer.m_CallstackHash = m_Callstacks[(size_t)value];
+
+        uint64_t startDelta, duration;
+        if( !ReadVarint( src, end, startDelta ) || !ReadVarint( src, end, duration ) )
+            return false;
+        TickType & lastStart = m_LastStart[threadIndex];
+        timer.m_Start = lastStart + UnZigZag( startDelta );
+        timer.m_End = timer.m_Start + UnZigZag( duration );
+        lastStart = timer.m_Start;
+
+        if( ( flags & TimerCodec::HAS_USER_DATA0 ) && !ReadVarint( src, end, timer.m_UserData[0] ) )
+            return false;
+        if( ( flags & TimerCodec::HAS_USER_DATA1 ) && !ReadVarint( src, end, timer.m_UserData[1] ) )
+            return false;
+    }
+
+    return src == end;
+}
@@ -0,0 +1,64 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "ScopeTimer.h"
+#include <vector>
+#include <unordered_map>
+
+//-----------------------------------------------------------------------------
+// Compact wire format for batches of timers (Msg_Timer payload).
+//
+// Header: version byte, session byte, varint timer count.
+// Each timer: flags byte (type, optional fields), then thread, function and
+// callstack as varint indices into per-batch dictionaries. An index equal to
+// the current dictionary size introduces a new entry whose value follows.
+// Start is a zigzag varint delta from the previous start of the same thread,
+// end is sent as a duration. A typical hooked timer takes ~10 bytes instead
+// of sizeof(Timer).
+namespace TimerCodec
+{
+    static const uint8_t VERSION = 1;
+
+    enum Flags : uint8_t
+    {
+        TYPE_MASK      = 0x0F,
+        HAS_USER_DATA0 = 0x10,
+        HAS_USER_DATA1 = 0x20,
+        HAS_SESSION    = 0x40,
+        HAS_PROCESSOR  = 0x80
+    };
+
+    // Worst case encoded size, used to reserve output space
+    inline size_t GetMaxEncodedSize( size_t a_NumTimers ) { return 16 + a_NumTimers * 96; }
+}
+
+//-----------------------------------------------------------------------------
+class TimerEncoder
+{
+public:
+    void Encode( const Timer* a_Timers, size_t a_NumTimers, std::vector<uint8_t> & o_Buffer );
+
+protected:
+    uint32_t GetIndex( std::unordered_map< uint64_t, uint32_t > & a_Dictionary, uint64_t a_Value, bool & o_IsNew );
+
+protected:
+    std::unordered_map< uint64_t, uint32_t > m_Threads;
+    std::unordered_map< uint64_t, uint32_t > m_Functions;
+    std::unordered_map< uint64_t, uint32_t > m_Callstacks;
+    std::vector< TickType >                  m_LastStart;
+};
+
+//-----------------------------------------------------------------------------
+class TimerDecoder
+{
+public:
+    bool Decode( const char* a_Data, size_t a_Size, std::vector<Timer> & o_Timers );
+
+protected:
+    std::vector< int >      m_Threads;
+    std::vector< DWORD64 >  m_Functions;
+    std::vector< DWORD64 >  m_Callstacks;
+    std::vector< TickType > m_LastStart;
+};
@@ -9,28 +9,33 @@
 #include "TcpClient.h"
 #include "Params.h"
 #include "OrbitLib.h"
+#include "Hijacking.h"
 #include <direct.h>
+#include <chrono>
 
 TimerManager* GTimerManager;
 
 //-----------------------------------------------------------------------------
 TimerManager::TimerManager( bool a_IsClient )
-    : m_TimerIndex(0)
-    , m_ThreadCounter(0)
-    , m_IsFull(false)
+    : m_IsFull(false)
     , m_IsRecording(false)
     , m_ExitRequested(false)
     , m_FlushRequested(false)
-    , m_LockFreeQueue(65534)
-    , m_ConsumerThread(nullptr)
     , m_NumQueuedEntries(0)
-    , m_NumQueuedMessages(0)
     , m_NumQueuedTimers(0)
+    , m_NumQueuedMessages(0)
+    , m_TimerIndex(0)
     , m_NumTimersFromPreviousSession(0)
     , m_NumFlushedTimers(0)
+    , m_ThreadCounter(0)
+    , m_LockFreeQueue(65534)
+    , m_NumFreeTimerBlocks(0)
+    , m_ConsumerThread(nullptr)
     , m_IsClient(a_IsClient)
+    , m_ThreadBufferIndex(0)
 {
     InitProfiling();
+    m_LastReclaimTicks = OrbitTicks();
 
     if( m_IsClient )
     {
@@ -70,6 +75,7 @@ void TimerManager::StopRecording()
 void TimerManager::StartClient()
 {
     m_IsRecording = true;
+    m_ConditionVariable.signal();
 }
 
 //-----------------------------------------------------------------------------
@@ -81,6 +87,9 @@ void TimerManager::StopClient()
     if( GTcpClient )
     {
         GTcpClient->FlushSendQueue();
+
+        // After the send queue was dropped, so that the records still go out
+        Hijacking::FlushAllArgRecords();
     }
 }
 
@@ -96,12 +105,21 @@ void TimerManager::FlushQueue()
     while (!m_ExitRequested)
     {
         size_t numDequeued = m_LockFreeQueue.try_dequeue_bulk(Timers, numTimers);
+        size_t numThreadTimers = numDequeued == 0 ? DequeueThreadTimers(Timers, numTimers) : 0;
+
+        size_t numBlockTimers = 0;
+        TimerBlock* block = nullptr;
+        if( numDequeued == 0 && numThreadTimers == 0 && m_TimerBlockQueue.try_dequeue( block ) )
+        {
+            numBlockTimers = block->size();
+            ReleaseTimerBlock( block );
+        }
 
-        if (numDequeued == 0)
+        if (numDequeued == 0 && numThreadTimers == 0 && numBlockTimers == 0)
             break;
 
-        m_NumQueuedEntries -= (int)numDequeued;
-        m_NumFlushedTimers += (int)numDequeued;
+        m_NumQueuedEntries -= (int)( numDequeued + numBlockTimers );
+        m_NumFlushedTimers += (int)( numDequeued + numThreadTimers + numBlockTimers );
 
         if( m_IsClient )
         {
@@ -133,28 +151,61 @@ void TimerManager::ConsumeTimers()
     SetThreadName( GetCurrentThreadId(), "OrbitConsumeTimers" );
     SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL );
 
-    Timer Timer;
+    std::vector<Timer> Timers( NUM_TIMERS_PER_BATCH );
+    moodycamel::ConsumerToken Token( m_LockFreeQueue );
 
     while( !m_ExitRequested )
     {
         m_ConditionVariable.wait();
 
-        while( !m_ExitRequested && !m_FlushRequested && m_LockFreeQueue.try_dequeue( Timer ) )
+        while( !m_ExitRequested && !m_FlushRequested )
         {
-            --m_NumQueuedEntries;
-            --m_NumQueuedTimers;
-            
-            if( Timer.m_SessionID == Message::GSessionID )
+            size_t numDequeued = m_LockFreeQueue.try_dequeue_bulk( Token, Timers.data(), NUM_TIMERS_PER_BATCH );
+            if( numDequeued > 0 )
             {
-                for (TimerAddedCallback & Callback : m_TimerAddedCallbacks)
-                {
-                    Callback(Timer);
-                }
+                m_NumQueuedEntries -= (int)numDequeued;
+                m_NumQueuedTimers  -= (int)numDequeued;
+                ProcessTimers( Timers.data(), numDequeued );
             }
-            else
+
+            // Blocks received from the target are processed where they were decoded
+            TimerBlock* block = nullptr;
+            bool hasBlock = m_TimerBlockQueue.try_dequeue( block );
+            if( hasBlock )
             {
-                ++m_NumTimersFromPreviousSession;
+                int numBlockTimers = (int)block->size();
+                m_NumQueuedEntries -= numBlockTimers;
+                m_NumQueuedTimers  -= numBlockTimers;
+                ProcessTimers( block->data(), block->size() );
+                ReleaseTimerBlock( block );
             }
+
+            if( numDequeued == 0 && !hasBlock )
+                break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerManager::ProcessTimers( Timer* a_Timers, size_t a_NumTimers )
+{
+    // Compact timers of current session in place
+    size_t numTimers = 0;
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        if( a_Timers[i].m_SessionID == Message::GSessionID )
+        {
+            a_Timers[numTimers++] = a_Timers[i];
+        }
+    }
+
+    m_NumTimersFromPreviousSession += (int)( a_NumTimers - numTimers );
+
+    if( numTimers > 0 )
+    {
+        for( TimersAddedCallback & Callback : m_TimersAddedCallbacks )
+        {
+            Callback( a_Timers, numTimers );
         }
     }
 }
@@ -164,38 +215,165 @@ void TimerManager::SendTimers()
 {
     SetThreadName( GetCurrentThreadId(), "OrbitSendTimers" );
 
-    const size_t numTimers = 4096;
+    const size_t numTimers = NUM_TIMERS_PER_BATCH;
     Timer Timers[numTimers];
 
     while( !m_ExitRequested )
     {
-        Message Msg(Msg_Timer);
+        Message Msg;
+        size_t numSent = 0;
 
-        // Wait for non-empty queue
-        while( m_NumQueuedEntries <= 0 && !m_ExitRequested )
+        // Thread buffers
+        while( !m_ExitRequested && !m_FlushRequested )
         {
-            m_ConditionVariable.wait();
+            size_t numDequeued = DequeueThreadTimers( Timers, numTimers );
+            if( numDequeued == 0 )
+                break;
+
+            SendTimerBatch( Timers, numDequeued );
+            numSent += numDequeued;
         }
 
+        // Shared queue, used by threads without buffer and on buffer overflow
         size_t numDequeued = m_LockFreeQueue.try_dequeue_bulk(Timers, numTimers);
-        m_NumQueuedEntries -= (int)numDequeued;
-        m_NumQueuedTimers  -= (int)numDequeued;
-        Msg.m_Size = (int)numDequeued*sizeof(Timer);
-
-		GTcpClient->Send(Msg, (void*)Timers);
+        if( numDequeued > 0 )
+        {
+            m_NumQueuedEntries -= (int)numDequeued;
+            m_NumQueuedTimers  -= (int)numDequeued;
+            SendTimerBatch( Timers, numDequeued );
+            numSent += numDequeued;
+        }
 
-        int numEntries = m_NumQueuedEntries;
-        GTcpClient->Send( Msg_NumQueuedEntries, numEntries );
+        if( numSent > 0 )
+        {
+            int numEntries = m_NumQueuedEntries + (int)GetNumThreadTimers();
+            GTcpClient->Send( Msg_NumQueuedEntries, numEntries );
+        }
 
+        bool sentMessages = false;
         while (m_LockFreeMessageQueue.try_dequeue(Msg) && !m_ExitRequested)
         {
             --m_NumQueuedEntries;
             --m_NumQueuedMessages;
             GTcpClient->Send(Msg);
+            sentMessages = true;
+        }
+
+        // Producers don't signal us per timer, poll while capturing.
+        // Otherwise sleep until StartClient or a message wakes us up.
+        if( numSent == 0 && !sentMessages )
+        {
+            if( m_IsRecording )
+            {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+            else
+            {
+                m_ConditionVariable.wait();
+            }
         }
     }
 }
 
+//-----------------------------------------------------------------------------
+void TimerManager::SendTimerBatch( const Timer* a_Timers, size_t a_NumTimers )
+{
+    m_TimerEncoder.Encode( a_Timers, a_NumTimers, m_EncodedTimers );
+
+    Message Msg(Msg_Timer);
+    Msg.m_Size = (int)m_EncodedTimers.size();
+    GTcpClient->Send(Msg, (void*)m_EncodedTimers.data());
+}
+
+//-----------------------------------------------------------------------------
+TimerManager::TimerBuffer* TimerManager::CreateThreadBuffer()
+{
+    ThreadBuffer threadBuffer;
+    threadBuffer.m_Buffer = std::make_unique<TimerBuffer>();
+    threadBuffer.m_Thread = OpenThread( SYNCHRONIZE, FALSE, GetCurrentThreadId() );
+
+    ScopeLock lock( m_ThreadBuffersMutex );
+    m_ThreadBuffers.push_back( std::move( threadBuffer ) );
+    return m_ThreadBuffers.back().m_Buffer.get();
+}
+
+//-----------------------------------------------------------------------------
+size_t TimerManager::GetNumThreadBuffers()
+{
+    ScopeLock lock( m_ThreadBuffersMutex );
+    return m_ThreadBuffers.size();
+}
+
+//-----------------------------------------------------------------------------
+size_t TimerManager::GetNumThreadTimers()
+{
+    ScopeLock lock( m_ThreadBuffersMutex );
+
+    size_t numTimers = 0;
+    for( ThreadBuffer & threadBuffer : m_ThreadBuffers )
+    {
+        numTimers += threadBuffer.m_Buffer->Size();
+    }
+
+    return numTimers;
+}
+
+//-----------------------------------------------------------------------------
+size_t TimerManager::DequeueThreadTimers( Timer* o_Timers, size_t a_MaxTimers )
+{
+    // The lock makes the sender thread and FlushQueue a single consumer
+    ScopeLock lock( m_ThreadBuffersMutex );
+
+    size_t numDequeued = 0;
+    size_t numBuffers = m_ThreadBuffers.size();
+
+    // Round robin so that a busy thread can't starve the others
+    for( size_t i = 0; i < numBuffers && numDequeued < a_MaxTimers; ++i )
+    {
+        m_ThreadBufferIndex = ( m_ThreadBufferIndex + 1 ) % numBuffers;
+        TimerBuffer* buffer = m_ThreadBuffers[m_ThreadBufferIndex].m_Buffer.get();
+        numDequeued += buffer->TryPopBulk( o_Timers + numDequeued, a_MaxTimers - numDequeued );
+    }
+
+    // Checking threads costs a syscall each, don't do it on every poll
+    if( numDequeued < a_MaxTimers && MicroSecondsFromTicks( m_LastReclaimTicks, OrbitTicks() ) > 100000.0 )
+    {
+        ReclaimThreadBuffers();
+    }
+
+    return numDequeued;
+}
+
+//-----------------------------------------------------------------------------
+void TimerManager::ReclaimThreadBuffers()
+{
+    // Called with m_ThreadBuffersMutex held
+    m_LastReclaimTicks = OrbitTicks();
+
+    for( size_t i = 0; i < m_ThreadBuffers.size(); )
+    {
+        ThreadBuffer & threadBuffer = m_ThreadBuffers[i];
+
+        // An exited thread can't push anymore, once drained its buffer is free
+        if( threadBuffer.m_Thread &&
+            WaitForSingleObject( threadBuffer.m_Thread, 0 ) == WAIT_OBJECT_0 &&
+            threadBuffer.m_Buffer->Size() == 0 )
+        {
+            CloseHandle( threadBuffer.m_Thread );
+            threadBuffer = std::move( m_ThreadBuffers.back() );
+            m_ThreadBuffers.pop_back();
+            continue;
+        }
+
+        ++i;
+    }
+
+    if( m_ThreadBufferIndex >= m_ThreadBuffers.size() )
+    {
+        m_ThreadBufferIndex = 0;
+    }
+}
+
 //-----------------------------------------------------------------------------
 void TimerManager::Add( const Timer& a_Timer )
 {
@@ -208,6 +386,63 @@ void TimerManager::Add( const Timer& a_Timer )
     }
 }
 
+//-----------------------------------------------------------------------------
+void TimerManager::Add( const Timer* a_Timers, size_t a_NumTimers )
+{
+    if( m_IsRecording && a_NumTimers > 0 )
+    {
+        m_LockFreeQueue.enqueue_bulk( a_Timers, a_NumTimers );
+        m_NumQueuedEntries += (int)a_NumTimers;
+        m_NumQueuedTimers  += (int)a_NumTimers;
+        m_ConditionVariable.signal();
+    }
+}
+
+//-----------------------------------------------------------------------------
+TimerManager::TimerBlock* TimerManager::AcquireTimerBlock()
+{
+    TimerBlock* block = nullptr;
+    if( m_FreeTimerBlocks.try_dequeue( block ) )
+    {
+        --m_NumFreeTimerBlocks;
+        return block;
+    }
+
+    return new TimerBlock();
+}
+
+//-----------------------------------------------------------------------------
+void TimerManager::AddTimerBlock( TimerBlock* a_Block )
+{
+    if( !m_IsRecording || a_Block->empty() )
+    {
+        ReleaseTimerBlock( a_Block );
+        return;
+    }
+
+    int numTimers = (int)a_Block->size();
+    m_TimerBlockQueue.enqueue( a_Block );
+    m_NumQueuedEntries += numTimers;
+    m_NumQueuedTimers  += numTimers;
+    m_ConditionVariable.signal();
+}
+
+//-----------------------------------------------------------------------------
+void TimerManager::ReleaseTimerBlock( TimerBlock* a_Block )
+{
+    // Blocks keep their capacity, a few are enough to cover the consumer lag
+    const int maxFreeBlocks = 256;
+    if( m_NumFreeTimerBlocks < maxFreeBlocks )
+    {
+        ++m_NumFreeTimerBlocks;
+        m_FreeTimerBlocks.enqueue( a_Block );
+    }
+    else
+    {
+        delete a_Block;
+    }
+}
+
 //-----------------------------------------------------------------------------
 void TimerManager::Add( const Message& a_Message )
 {
@@ -12,6 +12,8 @@
 #include "Threading.h"
 #include "Profiling.h"
 #include "Message.h"
+#include "SpscRingBuffer.h"
+#include "TimerCodec.h"
 
 class TcpClient;
 class Message;
@@ -21,6 +23,10 @@ struct ContextSwitch;
 class TimerManager
 {
 public:
+    static const int TIMER_BUFFER_SIZE = 4096;
+    typedef SpscRingBuffer< Timer, TIMER_BUFFER_SIZE > TimerBuffer;
+    typedef std::vector< Timer > TimerBlock;
+
     TimerManager( bool a_IsClient = false );
     ~TimerManager();
 
@@ -32,14 +38,38 @@ public:
 	void StopClient();
 
     void Add( const Timer & a_Timer );
+    void Add( const Timer* a_Timers, size_t a_NumTimers );
     void Add( const Message & a_Message );
     void Add( const ContextSwitch & a_CS );
+    inline void Add( TimerBuffer* a_Buffer, const Timer & a_Timer );
+
+    // Whole batches of timers are handed over without copying, the consumer
+    // thread returns blocks to the pool once the callbacks have run.
+    TimerBlock* AcquireTimerBlock();
+    void        AddTimerBlock( TimerBlock* a_Block );
+    void        ReleaseTimerBlock( TimerBlock* a_Block );
+
+    // Called by the producer thread, the buffer is freed once that thread
+    // exited and the collector drained it.
+    TimerBuffer* CreateThreadBuffer();
+    size_t GetNumThreadBuffers();
+
+    // Timers waiting in thread buffers, not part of m_NumQueuedEntries
+    size_t GetNumThreadTimers();
+
+    // Collector side, a single thread at a time
+    size_t DequeueThreadTimers( Timer* o_Timers, size_t a_MaxTimers );
 
     void ConsumeTimers();
     void SendTimers();
     bool HasQueuedEntries() const { return m_NumQueuedEntries > 0; }
 	void FlushQueue();
 
+protected:
+    void ReclaimThreadBuffers();
+    void SendTimerBatch( const Timer* a_Timers, size_t a_NumTimers );
+    void ProcessTimers( Timer* a_Timers, size_t a_NumTimers );
+
 public:
     AutoResetEvent          m_ConditionVariable;
 
@@ -59,11 +89,32 @@ public:
     int                     m_ThreadCounter;
     LockFreeQueue<Timer>    m_LockFreeQueue;
     LockFreeQueue<Message>  m_LockFreeMessageQueue;
+    LockFreeQueue<TimerBlock*> m_TimerBlockQueue;
+    LockFreeQueue<TimerBlock*> m_FreeTimerBlocks;
+    std::atomic<int>        m_NumFreeTimerBlocks;
     std::thread*            m_ConsumerThread;
     bool                    m_IsClient;
 
-    typedef std::function<void(Timer&)> TimerAddedCallback;
-    std::vector< TimerAddedCallback > m_TimerAddedCallbacks;
+    // Per-thread timer buffers of the injected client. Producer threads can
+    // exit at any time without notifying us, a handle to the thread tells
+    // when its buffer can't be refilled anymore.
+    struct ThreadBuffer
+    {
+        std::unique_ptr<TimerBuffer> m_Buffer;
+        HANDLE                       m_Thread;
+    };
+
+    Mutex                                       m_ThreadBuffersMutex;
+    std::vector< ThreadBuffer >                 m_ThreadBuffers;
+    size_t                                      m_ThreadBufferIndex;
+    TickType                                    m_LastReclaimTicks;
+
+    TimerEncoder            m_TimerEncoder;
+    std::vector<uint8_t>    m_EncodedTimers;
+
+    static const size_t NUM_TIMERS_PER_BATCH = 4096;
+    typedef std::function<void(Timer*, size_t)> TimersAddedCallback;
+    std::vector< TimersAddedCallback > m_TimersAddedCallbacks;
 
     typedef std::function<void(const struct ContextSwitch&)> ContextSwitchAddedCallback;
     ContextSwitchAddedCallback m_ContextSwitchAddedCallback;
@@ -72,6 +123,17 @@ public:
 //-----------------------------------------------------------------------------
 extern TimerManager* GTimerManager;
 
+//-----------------------------------------------------------------------------
+inline void TimerManager::Add( TimerBuffer* a_Buffer, const Timer & a_Timer )
+{
+    // The collector thread polls thread buffers, no signal is needed.
+    // Fall back on the shared queue when there is no buffer or it is full.
+    if( m_IsRecording && ( !a_Buffer || !a_Buffer->TryPush( a_Timer ) ) )
+    {
+        Add( a_Timer );
+    }
+}
+
 //-----------------------------------------------------------------------------
 struct ScopeStartRecording
 {
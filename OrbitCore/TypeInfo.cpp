@@ -54,7 +54,7 @@ bool CTypeInfoText::GetTypeName( ULONG Index, const TCHAR* pVarName, TString & p
             ptrType.m_Name = Format("Pointer to %lu", UndTypeIndex);
             ptrType.m_Length = Info.Info.sPointerTypeInfo.Length;
             ptrType.m_TypeInfo = Info;
-            GPdbDbg->AddType(ptrType);
+            GetParsingPdb()->AddType(ptrType);
 
             // Save the index of the type the pointer points to 
             Index = UndTypeIndex;
@@ -74,7 +74,7 @@ bool CTypeInfoText::GetTypeName( ULONG Index, const TCHAR* pVarName, TString & p
             baseType.m_Name = ws2s( baseTypeName );
             baseType.m_Length = Info.Info.sBaseTypeInfo.Length;
             baseType.m_TypeInfo = Info;
-            GPdbDbg->AddType( baseType );
+            GetParsingPdb()->AddType( baseType );
             break; 
         }
         case SymTagTypedef: 
@@ -179,7 +179,7 @@ bool CTypeInfoText::GetTypeName( ULONG Index, const TCHAR* pVarName, TString & p
                 arrayType.m_Name = ws2s(ArrayTypeName);
                 arrayType.m_Length = Info.Info.sArrayTypeInfo.Length;
                 arrayType.m_TypeInfo = Info;
-                GPdbDbg->AddType(arrayType);
+                GetParsingPdb()->AddType(arrayType);
 
                 /*TypeName += _T(" ");
                 TypeName += VarName;*/
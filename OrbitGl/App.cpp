@@ -35,6 +35,8 @@
 #include "OrbitCore\Pdb.h"
 #include "OrbitCore\ModuleManager.h"
 #include "OrbitCore\TcpServer.h"
+#include "OrbitCore\TcpBenchmark.h"
+#include "OrbitCore\MicroBenchmarks.h"
 #include "OrbitCore\TimerManager.h"
 #include "OrbitCore\Injection.h"
 #include "OrbitCore\Utils.h"
@@ -80,6 +82,7 @@ OrbitApp::OrbitApp() : m_ProcessesDataView(nullptr)
 //-----------------------------------------------------------------------------
 OrbitApp::~OrbitApp()
 {
+    CaptureSerializer::CancelLoading();
     oqpi_tk::stop_scheduler();
     delete m_Debugger;
     GOrbitApp = nullptr;
@@ -132,6 +135,10 @@ void OrbitApp::SetCommandLineArguments(const std::vector< std::string > & a_Args
             }
             inject = true;
         }
+        else if( StartsWith( arg, "benchmark" ) )
+        {
+            m_TcpBenchmarkArgument = arg;
+        }
     }
 }
 
@@ -171,6 +178,7 @@ bool OrbitApp::Init()
     GModuleManager.Init();
     Capture::Init();
     Capture::GSamplingDoneCallback = &OrbitApp::AddSamplingReport;
+    Capture::GCancelCaptureLoadingFunc = &CaptureSerializer::CancelLoading;
     Capture::SetLoadPdbAsyncFunc( GLoadPdbAsync );
     oqpi_tk::start_default_scheduler();
     GPluginManager.Initialize();
@@ -512,6 +520,33 @@ void OrbitApp::MainTick()
         exit(0);
     }
 
+    if( GOrbitApp->m_TcpBenchmarkArgument != "" )
+    {
+        std::vector< std::string > report;
+        bool valid = false;
+
+        if( MicroBenchmarks::Handles( GOrbitApp->m_TcpBenchmarkArgument ) )
+        {
+            report = MicroBenchmarks::Run( GOrbitApp->m_TcpBenchmarkArgument );
+            valid = !report.empty();
+        }
+        else
+        {
+            TcpBenchmarkConfig config = TcpBenchmarkConfig::Parse( GOrbitApp->m_TcpBenchmarkArgument );
+            config.m_Port = Capture::GCapturePort;
+            TcpBenchmarkResult result = TcpBenchmark::Run( config );
+            report = result.GetReport();
+            valid = result.m_Valid;
+        }
+
+        for( const std::string & line : report )
+        {
+            std::cout << line;
+            ORBIT_LOG( line );
+        }
+        exit( valid ? 0 : 1 );
+    }
+
     GOrbitApp->m_Debugger->MainTick();
     GOrbitApp->CheckForUpdate();
 
@@ -807,12 +842,6 @@ void OrbitApp::OnLoadCapture( const std::wstring a_FileName )
     DoZoom = true; //TODO: remove global, review logic
 }
 
-//-----------------------------------------------------------------------------
-void GLoadPdbAsync( const std::shared_ptr<Module> & a_Module )
-{
-    GModuleManager.LoadPdbAsync( a_Module, [](){ GOrbitApp->OnPdbLoaded(); } );
-}
-
 //-----------------------------------------------------------------------------
 void OrbitApp::OnOpenCapture( const std::wstring a_FileName )
 {
@@ -981,16 +1010,21 @@ void OrbitApp::LoadModules()
 {
     if( m_ModulesToLoad.size() > 0 )
     {
-        std::shared_ptr< Module > module = m_ModulesToLoad.front();
-        m_ModulesToLoad.pop();
-        GLoadPdbAsync( module );
+        std::vector< std::shared_ptr<Module> > modules;
+        while( !m_ModulesToLoad.empty() )
+        {
+            modules.push_back( m_ModulesToLoad.front() );
+            m_ModulesToLoad.pop();
+        }
+
+        GModuleManager.LoadPdbAsync( modules, [](){ GOrbitApp->OnPdbLoaded(); } );
     }
 }
 
 //-----------------------------------------------------------------------------
 bool OrbitApp::IsLoading()
 {
-    return GPdbDbg->IsLoading();
+    return GModuleManager.IsLoading() || ( GPdbDbg && GPdbDbg->IsLoading() );
 }
 
 //-----------------------------------------------------------------------------
@@ -172,6 +172,7 @@ private:
     bool                    m_HasPromptedForUpdate;
     bool                    m_NeedsThawing;
     bool                    m_UnrealEnabled;
+    std::string             m_TcpBenchmarkArgument;
 
     std::vector< std::shared_ptr< class SamplingReport> > m_SamplingReports;
     std::map< std::wstring, std::wstring > m_FileMapping;
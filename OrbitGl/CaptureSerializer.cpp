@@ -13,14 +13,20 @@
 #include "App.h"
 #include "OrbitProcess.h"
 #include "OrbitModule.h"
+#include "TimerManager.h"
+#include "CaptureFile.h"
 
 #include <fstream>
+#include <map>
 #include <memory>
+#include <limits>
+#include <thread>
+#include <atomic>
 
 //-----------------------------------------------------------------------------
 CaptureSerializer::CaptureSerializer()
 {
-    m_Version = 2;
+    m_Version = 3;
     m_TimerVersion = Timer::Version;
     m_SizeOfTimer = sizeof(Timer);
 }
@@ -30,145 +36,258 @@ void CaptureSerializer::Save( const std::wstring a_FileName )
 {
     Capture::PreSave();
 
-    std::basic_ostream<char> Stream( &GStreamCounter );
-    cereal::BinaryOutputArchive CountingArchive( Stream );
-    GStreamCounter.Reset();
-    Save( CountingArchive );
-    PRINT_VAR( GStreamCounter.Size() );
-    GStreamCounter.Reset();
-
-    // Binary
     m_CaptureName = ws2s(a_FileName);
-    std::ofstream myfile( a_FileName, std::ios::binary );
-    if( !myfile.fail() )
+
+    CaptureFileWriter writer;
+    if( writer.Open( a_FileName ) )
     {
         SCOPE_TIMER_LOG( Format( L"Saving capture in %s", a_FileName.c_str() ) );
-        cereal::BinaryOutputArchive archive( myfile );
-        Save( archive );
-        myfile.close();
+
+        m_TimeGraph->m_TimerIndex.ForEachTimer( [&]( const Timer & a_Timer )
+        {
+            writer.AddTimer( a_Timer );
+        } );
+
+        writer.Close( [&]( std::ostream & a_Stream )
+        {
+            m_NumTimers = (int)writer.GetNumTimers();
+            cereal::BinaryOutputArchive archive( a_Stream );
+            SaveMetadata( archive );
+        } );
     }
 }
 
 //-----------------------------------------------------------------------------
-template <class T> void CaptureSerializer::Save( T & a_Archive )
+template <class T> void CaptureSerializer::SaveMetadata( T & a_Archive )
 {
-    m_NumTimers = m_TimeGraph->m_TextBoxes.size();
-
     // Header
     a_Archive( cereal::make_nvp( "Capture", *this ) );
 
     // Functions
+    std::vector<Function> functions;
+    for( auto & pair : Capture::GSelectedFunctionsMap )
     {
-        ORBIT_SIZE_SCOPE( "Functions" );
-        std::vector<Function> functions;
-        for( auto & pair : Capture::GSelectedFunctionsMap )
+        Function * func = pair.second;
+        if( func )
         {
-            Function * func = pair.second;
-            if( func )
-            {
-                functions.push_back(*func);
-                functions.back().m_Address = func->GetVirtualAddress();
-            }
+            functions.push_back(*func);
+            functions.back().m_Address = func->GetVirtualAddress();
         }
-
-        a_Archive(functions);
     }
 
+    a_Archive(functions);
+
     // Function Count
     a_Archive( Capture::GFunctionCountMap );
 
     // Process
+    a_Archive( Capture::GTargetProcess );
+
+    // Callstacks
+    a_Archive( Capture::GCallstacks );
+
+    // Sampling profiler
+    a_Archive( Capture::GSamplingProfiler );
+
+    // Event buffer
+    a_Archive( GEventTracer.GetEventBuffer() );
+}
+
+//-----------------------------------------------------------------------------
+// Timer chunks of the last loaded capture are decoded on this thread
+static std::unique_ptr<std::thread> GCaptureLoadingThread;
+static std::atomic<bool>            GCancelCaptureLoading( false );
+
+//-----------------------------------------------------------------------------
+void CaptureSerializer::Load( const std::wstring a_FileName )
+{
+    SCOPE_TIMER_LOG( Format( L"Loading capture %s", a_FileName.c_str() ) );
+
+    CancelLoading();
+
+    std::shared_ptr<CaptureFileReader> reader = std::make_shared<CaptureFileReader>();
+    if( !reader->Open( a_FileName ) )
     {
-        ORBIT_SIZE_SCOPE( "Capture::GTargetProcess" );
-        a_Archive( Capture::GTargetProcess );
+        if( !reader->IsCaptureFile() )
+        {
+            LoadLegacy( a_FileName );
+        }
+        return;
     }
 
-    // Callstacks
     {
-        ORBIT_SIZE_SCOPE( "Capture::GCallstacks" );
-        a_Archive( Capture::GCallstacks );
+        cereal::BinaryInputArchive archive( reader->GetMetadataStream() );
+        LoadMetadata( archive, a_FileName );
     }
 
-    // Sampling profiler
+    // Decode one chunk per worker right away so that there is something to
+    // zoom on, the rest is decoded in the background.
+    std::vector<uint32_t> order = GetChunkLoadingOrder( reader->GetChunks() );
+    size_t batchSize = std::max( (size_t)oqpi_tk::scheduler().workersCount( oqpi::task_priority::normal ), (size_t)1 );
+    size_t numLoaded = std::min( batchSize, order.size() );
+    LoadChunks( *reader, order, 0, numLoaded );
+
+    if( numLoaded < order.size() )
     {
-        ORBIT_SIZE_SCOPE( "SamplingProfiler" );
-        a_Archive( Capture::GSamplingProfiler );
+        TimeGraph* timeGraph = m_TimeGraph;
+        GCaptureLoadingThread = std::make_unique<std::thread>( [reader, order, numLoaded, batchSize, timeGraph]()
+        {
+            SCOPE_TIMER_LOG( L"Loading capture chunks" );
+
+            CaptureSerializer loader;
+            loader.m_TimeGraph = timeGraph;
+
+            for( size_t i = numLoaded; i < order.size() && !GCancelCaptureLoading; i += batchSize )
+            {
+                loader.LoadChunks( *reader, order, i, std::min( i + batchSize, order.size() ) );
+                timeGraph->NeedsUpdate();
+            }
+        } );
     }
 
-    // Event buffer
+    GOrbitApp->FireRefreshCallbacks();
+}
+
+//-----------------------------------------------------------------------------
+void CaptureSerializer::CancelLoading()
+{
+    if( GCaptureLoadingThread )
     {
-        ORBIT_SIZE_SCOPE( "Event Buffer" );
-        a_Archive( GEventTracer.GetEventBuffer() );
+        GCancelCaptureLoading = true;
+        GCaptureLoadingThread->join();
+        GCaptureLoadingThread = nullptr;
+        GCancelCaptureLoading = false;
     }
+}
 
-    // Timers
-    int numWrites = 0;
-    for( TextBox & box : m_TimeGraph->m_TextBoxes )
+//-----------------------------------------------------------------------------
+std::vector<uint32_t> CaptureSerializer::GetChunkLoadingOrder( const std::vector<CaptureChunk> & a_Chunks )
+{
+    std::vector<uint32_t> order( a_Chunks.size() );
+    for( uint32_t i = 0; i < (uint32_t)order.size(); ++i )
     {
-        a_Archive( cereal::binary_data( (char*)&box.GetTimer(), sizeof( Timer ) ) );
+        order[i] = i;
+    }
 
-        if( ++numWrites > m_NumTimers )
+    // ZoomAll shows the end of the session, load most recent chunks first
+    std::sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b )
+    {
+        return a_Chunks[a].m_MaxEnd > a_Chunks[b].m_MaxEnd;
+    } );
+
+    // The chunk holding the session start goes first so the time origin doesn't move
+    auto first = std::min_element( order.begin(), order.end(), [&]( uint32_t a, uint32_t b )
+    {
+        return a_Chunks[a].m_MinStart < a_Chunks[b].m_MinStart;
+    } );
+
+    if( first != order.end() )
+    {
+        std::rotate( order.begin(), first, first + 1 );
+    }
+
+    return order;
+}
+
+//-----------------------------------------------------------------------------
+void CaptureSerializer::LoadChunks( const CaptureFileReader & a_Reader, const std::vector<uint32_t> & a_Order, size_t a_Begin, size_t a_End )
+{
+    const std::vector<CaptureChunk> & chunks = a_Reader.GetChunks();
+    std::vector< std::vector<Timer> > timers( a_End - a_Begin );
+    std::vector< TimerDecoder > decoders( oqpi_tk::scheduler().workersCount( oqpi::task_priority::normal ) + 1 );
+
+    oqpi_tk::parallel_for( "DecodeCaptureChunks", (int32_t)timers.size(), [&]( int32_t a_BlockIndex, int32_t a_ElementIndex )
+    {
+        const CaptureChunk & chunk = chunks[a_Order[a_Begin + a_ElementIndex]];
+        if( !a_Reader.DecodeChunk( chunk, decoders[a_BlockIndex], timers[a_ElementIndex] ) )
         {
-            break;
+            timers[a_ElementIndex].clear();
         }
+    } );
+
+    // Function stats and memory tracking are not thread safe, feed timers in order
+    for( std::vector<Timer> & chunkTimers : timers )
+    {
+        ProcessTimers( chunkTimers.data(), chunkTimers.size() );
     }
 }
 
 //-----------------------------------------------------------------------------
-void CaptureSerializer::Load( const std::wstring a_FileName )
+void CaptureSerializer::LoadLegacy( const std::wstring & a_FileName )
 {
-    SCOPE_TIMER_LOG( Format( L"Loading capture %s", a_FileName.c_str() ) );
-
-    // Binary
+    // Single archive followed by raw timers, written before chunked captures
     std::ifstream file( a_FileName, std::ios::binary );
     if( !file.fail() )
     {
-        // header
-        cereal::BinaryInputArchive archive( file );
-        archive( *this );
-
-        // functions
-        std::shared_ptr<Module> module = std::make_shared<Module>();
-        Capture::GTargetProcess->AddModule(module);
-        module->m_Pdb = std::make_shared<Pdb>( a_FileName.c_str() );
-        archive( module->m_Pdb->GetFunctions() );
-        module->m_Pdb->ProcessData();
-        GPdbDbg = module->m_Pdb;
-        Capture::GSelectedFunctionsMap.clear();
-        for( Function & func : module->m_Pdb->GetFunctions() )
         {
-            Capture::GSelectedFunctionsMap[func.m_Address] = &func;
+            cereal::BinaryInputArchive archive( file );
+            LoadMetadata( archive, a_FileName );
         }
-        Capture::GVisibleFunctionsMap = Capture::GSelectedFunctionsMap;
 
-        // Function count
-        archive( Capture::GFunctionCountMap );
+        // Timers
+        std::vector<Timer> timers( TimerManager::NUM_TIMERS_PER_BATCH );
+        while( file.read( (char*)timers.data(), timers.size()*sizeof(Timer) ) || file.gcount() > 0 )
+        {
+            size_t numTimers = (size_t)file.gcount() / sizeof(Timer);
+            ProcessTimers( timers.data(), numTimers );
+        }
 
-        // Process
-        archive( Capture::GTargetProcess );
+        GOrbitApp->FireRefreshCallbacks();
+    }
+}
 
-        // Callstacks
-        archive( Capture::GCallstacks );
+//-----------------------------------------------------------------------------
+template <class T> void CaptureSerializer::LoadMetadata( T & a_Archive, const std::wstring & a_FileName )
+{
+    // header
+    a_Archive( *this );
 
-        // Sampling profiler
-        archive( Capture::GSamplingProfiler );
-        Capture::GSamplingProfiler->SortByThreadUsage();
-        GOrbitApp->AddSamplingReport( Capture::GSamplingProfiler );
-        Capture::GSamplingProfiler->SetLoadedFromFile( true );
+    // functions
+    std::shared_ptr<Module> module = std::make_shared<Module>();
+    Capture::GTargetProcess->AddModule(module);
+    module->m_Pdb = std::make_shared<Pdb>( a_FileName.c_str() );
+    a_Archive( module->m_Pdb->GetFunctions() );
+    module->m_Pdb->ProcessData();
+    GPdbDbg = module->m_Pdb;
+    Capture::GSelectedFunctionsMap.clear();
+    for( Function & func : module->m_Pdb->GetFunctions() )
+    {
+        Capture::GSelectedFunctionsMap[func.m_Address] = &func;
+    }
+    Capture::GVisibleFunctionsMap = Capture::GSelectedFunctionsMap;
 
-        // Event buffer
-        archive( GEventTracer.GetEventBuffer() );
+    // Function count
+    a_Archive( Capture::GFunctionCountMap );
 
-        // Timers
-        Timer timer;
-        while( file.read( (char*)&timer, sizeof(Timer) ) )
-        {
-            m_TimeGraph->ProcessTimer( timer );
-            m_TimeGraph->UpdateThreadDepth( timer.m_TID, timer.m_Depth );
-        }
+    // Process
+    a_Archive( Capture::GTargetProcess );
 
-        GOrbitApp->FireRefreshCallbacks();
+    // Callstacks
+    a_Archive( Capture::GCallstacks );
+
+    // Sampling profiler
+    a_Archive( Capture::GSamplingProfiler );
+    Capture::GSamplingProfiler->SortByThreadUsage();
+    GOrbitApp->AddSamplingReport( Capture::GSamplingProfiler );
+    Capture::GSamplingProfiler->SetLoadedFromFile( true );
+
+    // Event buffer
+    a_Archive( GEventTracer.GetEventBuffer() );
+}
+
+//-----------------------------------------------------------------------------
+void CaptureSerializer::ProcessTimers( Timer* a_Timers, size_t a_NumTimers )
+{
+    // Can run on the capture loading thread, depths are merged by the main thread
+    std::map< ThreadID, int > threadDepths;
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        int & depth = threadDepths[a_Timers[i].m_TID];
+        depth = std::max( depth, (int)a_Timers[i].m_Depth );
     }
+
+    m_TimeGraph->AddPendingThreadDepths( threadDepths );
+    m_TimeGraph->ProcessTimers( a_Timers, a_NumTimers );
 }
 
 //-----------------------------------------------------------------------------
@@ -5,9 +5,14 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "OrbitType.h"
 #include "SerializationMacros.h"
 
+class Timer;
+class CaptureFileReader;
+struct CaptureChunk;
+
 //-----------------------------------------------------------------------------
 class CaptureSerializer
 {
@@ -16,8 +21,18 @@ public:
     void Save( const std::wstring a_FileName );
     void Load( const std::wstring a_FileName );
 
-    template <class T> void Save( T & a_Archive );
+    // Stops decoding timers of a previously loaded capture
+    static void CancelLoading();
+
+protected:
+    template <class T> void SaveMetadata( T & a_Archive );
+    template <class T> void LoadMetadata( T & a_Archive, const std::wstring & a_FileName );
+    void LoadLegacy( const std::wstring & a_FileName );
+    void ProcessTimers( Timer* a_Timers, size_t a_NumTimers );
+    void LoadChunks( const CaptureFileReader & a_Reader, const std::vector<uint32_t> & a_Order, size_t a_Begin, size_t a_End );
+    static std::vector<uint32_t> GetChunkLoadingOrder( const std::vector<CaptureChunk> & a_Chunks );
 
+public:
     class  TimeGraph*        m_TimeGraph;
     class  SamplingProfiler* m_SamplingProfiler;
 
@@ -33,7 +33,7 @@ CaptureWindow::CaptureWindow()
     m_WorldMaxY = 0;
     m_ProcessX = 0;
 
-    GTimerManager->m_TimerAddedCallbacks.push_back( [=]( Timer & a_Timer ){ this->OnTimerAdded( a_Timer ); } );
+    GTimerManager->m_TimersAddedCallbacks.push_back( [=]( Timer* a_Timers, size_t a_NumTimers ){ this->OnTimersAdded( a_Timers, a_NumTimers ); } );
     GTimerManager->m_ContextSwitchAddedCallback = [=]( const ContextSwitch & a_CS ){ this->OnContextSwitchAdded( a_CS ); };
 
     m_HoverDelayMs = 300;
@@ -746,8 +746,8 @@ void CaptureWindow::RenderUI()
         m_StatsWindow.AddLine( VAR_TO_ANSI( Capture::GNumProfileEvents ) );
         m_StatsWindow.AddLine( VAR_TO_ANSI( Capture::GNumInstalledHooks ) );
         m_StatsWindow.AddLine( VAR_TO_ANSI( m_TimeGraph.GetNumDrawnTextBoxes() ) );
-        m_StatsWindow.AddLine( VAR_TO_ANSI( m_TimeGraph.m_TextBoxes.m_NumItems ) );
-        m_StatsWindow.AddLine( VAR_TO_ANSI( m_TimeGraph.m_TextBoxes.m_NumBlocks ) );
+        m_StatsWindow.AddLine( VAR_TO_ANSI( m_TimeGraph.m_TimerIndex.GetNumTimers() ) );
+        m_StatsWindow.AddLine( VAR_TO_ANSI( m_TimeGraph.m_TimerIndex.GetNumTracks() ) );
 
         for( std::string & line : GTcpServer->GetStats() )
         {
@@ -887,6 +887,21 @@ void CaptureWindow::RenderMemTracker()
         ImGui::Text( VAR_TO_ANSI( memTracker.NumAllocatedBytes() ) );
         ImGui::Text( VAR_TO_ANSI( memTracker.NumFreedBytes() ) );
         ImGui::Text( VAR_TO_ANSI( memTracker.NumLiveBytes() ) );
+        ImGui::Text( VAR_TO_ANSI( memTracker.NumLiveAllocs() ) );
+
+        // Live memory over time
+        std::vector< MemorySnapshot > snapshots;
+        memTracker.GetSnapshots( snapshots );
+        if( !snapshots.empty() )
+        {
+            std::vector< float > liveBytes( snapshots.size() );
+            for( size_t i = 0; i < snapshots.size(); ++i )
+            {
+                liveBytes[i] = (float)snapshots[i].m_LiveBytes;
+            }
+
+            ImGui::PlotLines( "", liveBytes.data(), (int)liveBytes.size(), 0, "Live bytes", 0.f, FLT_MAX, ImVec2( 200, 60 ) );
+        }
     }
 
     ImGui::End();
@@ -1027,9 +1042,9 @@ void CaptureWindow::RenderTimeBar()
 }
 
 //-----------------------------------------------------------------------------
-void CaptureWindow::OnTimerAdded( Timer & a_Timer )
+void CaptureWindow::OnTimersAdded( Timer* a_Timers, size_t a_NumTimers )
 {
-    m_TimeGraph.ProcessTimer( a_Timer );
+    m_TimeGraph.ProcessTimers( a_Timers, a_NumTimers );
 }
 
 //-----------------------------------------------------------------------------
@@ -45,7 +45,7 @@ public:
     void RenderMemTracker();
     void RenderBar();
     void RenderTimeBar();
-    void OnTimerAdded( Timer & a_Timer );
+    void OnTimersAdded( Timer* a_Timers, size_t a_NumTimers );
     void OnContextSwitchAdded( const ContextSwitch & a_CS );
     void ResetHoverTimer();
     void SelectTextBox( class TextBox* a_TextBox );
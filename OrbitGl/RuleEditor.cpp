@@ -568,7 +568,7 @@ RuleEditor::RuleEditor()
     : GlCanvas()
 {
     GOrbitApp->RegisterRuleEditor(this);
-    GTcpServer->SetCallback( Msg_SavedContext, [=]( const Message & a_Msg ){ this->OnReceiveMessage(a_Msg); } );
+    GTcpServer->SetCallback( Msg_ArgRecords, [=]( const Message & a_Msg ){ this->OnReceiveMessage(a_Msg); } );
     m_Opened = true;
 }
 
@@ -643,39 +643,42 @@ bool GRedrawBlackBoard = false;
 //-----------------------------------------------------------------------------
 void RuleEditor::OnReceiveMessage( const Message & a_Message )
 {
-    if( a_Message.GetType() == Msg_SavedContext )
-    {
-        GRedrawBlackBoard = true;
+    if( a_Message.GetType() != Msg_ArgRecords )
+        return;
 
-        int ContextSize = Capture::GTargetProcess->GetIs64Bit() ? sizeof(SavedContext64) : sizeof(SavedContext32);
-        void* argData = (void*)(a_Message.GetData() + ContextSize);
-        int argDataSize = a_Message.m_Size - ContextSize;
+    const char* data = a_Message.GetData();
+    const char* end = data + a_Message.m_Size;
+    int numRecords = a_Message.m_Header.m_ArgRecordsHeader.m_NumRecords;
 
-        //DemoPosition( context, argData, argDataSize );
-        RuleEditor* ruleEditor = GOrbitApp->GetRuleEditor();
-        m_NeedsRedraw = true;
+    for( int i = 0; i < numRecords && size_t( end - data ) >= sizeof( ArgRecord ); ++i )
+    {
+        ArgRecord record;
+        memcpy( &record, data, sizeof( record ) );
+        data += sizeof( record );
 
-        DWORD64 address = a_Message.m_Header.m_GenericHeader.m_Address;
+        if( record.m_DataSize > size_t( end - data ) )
+            break;
 
-        std::shared_ptr<Rule> rule = m_Rules[address];
-        int offset = 0;
-        const char* maxAddress = a_Message.GetData() + a_Message.m_Size;
-        for( const std::shared_ptr<Variable > var : rule->m_TrackedVariables )
+        // Records of rules removed since the capture started are skipped
+        auto it = m_Rules.find( record.m_Function );
+        if( it != m_Rules.end() && it->second )
         {
-            Argument arg;
-            var->m_Address;
-            var->m_Size;
-
-            char* data = (char*)argData + offset;
-            if( data + var->m_Size > maxAddress )
+            DWORD offset = 0;
+            for( const std::shared_ptr<Variable> & var : it->second->m_TrackedVariables )
             {
-                break;
-            }
+                if( offset + var->m_Size > record.m_DataSize )
+                    break;
 
-            ProcessVariable(var, data);
-            offset += var->m_Size;
+                ProcessVariable( var, const_cast<char*>( data ) + offset );
+                offset += var->m_Size;
+            }
         }
+
+        data += record.m_DataSize;
     }
+
+    GRedrawBlackBoard = true;
+    m_NeedsRedraw = true;
 }
 
 //-----------------------------------------------------------------------------
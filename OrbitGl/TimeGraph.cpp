@@ -58,13 +58,20 @@ void TimeGraph::SetCanvas( GlCanvas* a_Canvas )
 void TimeGraph::Clear()
 {
     m_Batcher.Reset();
-    m_TextBoxes.clear();
+    m_TimerIndex.Clear();
+    m_VisibleTextBoxes.clear();
     m_SessionMinCounter = _I64_MAX;
     m_SessionMaxCounter = _I64_MIN;
     m_ThreadDepths.clear();
+    {
+        ScopeLock lock( m_Mutex );
+        m_PendingThreadDepths.clear();
+    }
     m_ThreadCountMap.clear();
     GEventTracer.GetEventBuffer().Reset();
     m_MemTracker.Clear();
+    m_ThreadContextSwitches.clear();
+    m_CoreContextSwitches.clear();
     m_Layout.Reset();
 }
 
@@ -76,9 +83,9 @@ bool TimeGraph::UpdateSessionMinMaxCounter()
 {
     m_SessionMinCounter = LLONG_MAX;
 
-    if( m_TextBoxes.size() )
+    if( m_TimerIndex.GetNumTimers() )
     {
-        m_SessionMinCounter = m_TextBoxes.m_Root->m_Data[0].GetTimer().m_Start;
+        m_SessionMinCounter = m_TimerIndex.GetMinTime();
     }
 
     if( GEventTracer.GetEventBuffer().HasEvent() )
@@ -205,6 +212,31 @@ double TimeGraph::GetTimeIntervalMicro( double a_Ratio )
 
 //-----------------------------------------------------------------------------
 void TimeGraph::ProcessTimer( Timer & a_Timer )
+{
+    if( PreProcessTimer( a_Timer ) )
+    {
+        m_TimerIndex.Add( a_Timer );
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimeGraph::ProcessTimers( Timer* a_Timers, size_t a_NumTimers )
+{
+    // Compact timers that end up in the timeline and add them in one go
+    size_t numTimelineTimers = 0;
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        if( PreProcessTimer( a_Timers[i] ) )
+        {
+            a_Timers[numTimelineTimers++] = a_Timers[i];
+        }
+    }
+
+    m_TimerIndex.Add( a_Timers, numTimelineTimers );
+}
+
+//-----------------------------------------------------------------------------
+bool TimeGraph::PreProcessTimer( const Timer & a_Timer )
 {
     TickType start = a_Timer.m_Start;
     TickType end   = a_Timer.m_End;
@@ -218,10 +250,10 @@ void TimeGraph::ProcessTimer( Timer & a_Timer )
     {
     case Timer::ALLOC:
         m_MemTracker.ProcessAlloc( a_Timer );
-        return;
+        return false;
     case Timer::FREE:
         m_MemTracker.ProcessFree( a_Timer );
-        return;
+        return false;
     case Timer::CORE_ACTIVITY:
         Capture::GHasContextSwitches = true;
         break;
@@ -245,21 +277,21 @@ void TimeGraph::ProcessTimer( Timer & a_Timer )
         ++m_ThreadCountMap[a_Timer.m_TID];
     }
 
-    TextBox textBox( Vec2(0, 0), Vec2(0, 0), "", m_TextRenderer, Color( 255, 0, 0, 255) );
-    textBox.SetTimer( a_Timer );
-    AddTextBox( textBox );
-}
-
-//-----------------------------------------------------------------------------
-void TimeGraph::AddTextBox(const TextBox& a_TextBox)
-{
-    m_TextBoxes.push_back( a_TextBox );
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 void TimeGraph::AddContextSwitch( const ContextSwitch & a_CS )
 {
-    auto pair = std::make_pair(a_CS.m_Time, a_CS);
+    if( a_CS.m_ProcessorIndex >= m_CoreContextSwitches.size() )
+    {
+        m_CoreContextSwitches.resize( a_CS.m_ProcessorIndex + 1 );
+    }
+
+    ContextSwitch lastCoreCS;
+    ContextSwitch lastThreadCS;
+    bool hasLastCoreCS = m_CoreContextSwitches[a_CS.m_ProcessorIndex].Add( a_CS, lastCoreCS );
+    bool hasLastThreadCS = m_ThreadContextSwitches[a_CS.m_ThreadId].Add( a_CS, lastThreadCS );
 
     if( a_CS.m_Type == ContextSwitch::Out )
     {
@@ -267,15 +299,12 @@ void TimeGraph::AddContextSwitch( const ContextSwitch & a_CS )
         if( true )
         {
             // Processor time line
-            std::map< long long, ContextSwitch > & csMap = m_CoreUtilizationMap[a_CS.m_ProcessorIndex];
-
-            if( csMap.rbegin() != csMap.rend() )
+            if( hasLastCoreCS )
             {
-                ContextSwitch & lastCS = csMap.rbegin()->second;
-                if( lastCS.m_Type == ContextSwitch::In )
+                if( lastCoreCS.m_Type == ContextSwitch::In )
                 {
                     Timer timer;
-                    timer.m_Start = lastCS.m_Time;
+                    timer.m_Start = lastCoreCS.m_Time;
                     timer.m_End = a_CS.m_Time;
                     timer.m_TID = a_CS.m_ThreadId;
                     timer.m_Processor = (int8_t)a_CS.m_ProcessorIndex;
@@ -290,15 +319,12 @@ void TimeGraph::AddContextSwitch( const ContextSwitch & a_CS )
         if( false )
         {
             // Thread time line
-            std::map< long long, ContextSwitch > & csMap = m_ContextSwitchesMap[a_CS.m_ThreadId];
-
-            if( csMap.rbegin() != csMap.rend() )
+            if( hasLastThreadCS )
             {
-                ContextSwitch & lastCS = csMap.rbegin()->second;
-                if( lastCS.m_Type == ContextSwitch::In )
+                if( lastThreadCS.m_Type == ContextSwitch::In )
                 {
                     Timer timer;
-                    timer.m_Start = lastCS.m_Time;
+                    timer.m_Start = lastThreadCS.m_Time;
                     timer.m_End = a_CS.m_Time;
                     timer.m_TID = a_CS.m_ThreadId;
                     timer.m_SessionID = Message::GSessionID;
@@ -309,11 +335,6 @@ void TimeGraph::AddContextSwitch( const ContextSwitch & a_CS )
             }
         }
     }
-
-    // TODO: if events are already sorted by timestamp, then
-    //       we don't need to use maps. To investigate...
-    m_ContextSwitchesMap[a_CS.m_ThreadId].insert( pair );
-    m_CoreUtilizationMap[a_CS.m_ProcessorIndex].insert( pair );
 }
 
 //-----------------------------------------------------------------------------
@@ -334,6 +355,19 @@ void TimeGraph::UpdateThreadDepth( int a_ThreadId, int a_Depth )
     }
 }
 
+//-----------------------------------------------------------------------------
+// m_ThreadDepths belongs to the main thread, depths found by other threads
+// are merged in UpdatePrimitives.
+void TimeGraph::AddPendingThreadDepths( const std::map< ThreadID, int > & a_Depths )
+{
+    ScopeLock lock( m_Mutex );
+    for( auto & pair : a_Depths )
+    {
+        int & depth = m_PendingThreadDepths[pair.first];
+        depth = std::max( depth, pair.second );
+    }
+}
+
 //-----------------------------------------------------------------------------
 int TimeGraph::GetThreadDepth( int a_ThreadId ) const
 {
@@ -448,17 +482,32 @@ inline std::string GetExtraInfo( const Timer & a_Timer )
     return info;
 }
 
+//-----------------------------------------------------------------------------
+inline bool IsSameTimer( const Timer & a_A, const Timer & a_B )
+{
+    return a_A.m_Start == a_B.m_Start && a_A.m_End == a_B.m_End && a_A.m_TID == a_B.m_TID &&
+           a_A.m_Depth == a_B.m_Depth && a_A.m_Type == a_B.m_Type;
+}
+
 //-----------------------------------------------------------------------------
 void TimeGraph::UpdatePrimitives( bool a_Picking )
 {
+    // Visible text boxes are rebuilt below, keep our own copy of the selection
+    if( Capture::GSelectedTextBox && Capture::GSelectedTextBox != &m_SelectedTextBox )
+    {
+        m_SelectedTextBox = *Capture::GSelectedTextBox;
+        Capture::GSelectedTextBox = &m_SelectedTextBox;
+    }
+
     m_Batcher.Reset();
-    m_VisibleTextBoxes.clear();
+    m_VisibleTimers.clear();
+    m_VisibleTextBoxes.Reset();
     m_TextRendererStatic.Clear();
     m_TextRendererStatic.Init();
 
     UpdateMaxTimeStamp( GEventTracer.GetEventBuffer().GetMaxTime() );
 
-    int numTextBoxes = m_TextBoxes.size();
+    int numTextBoxes = m_TimerIndex.GetNumTimers();
     m_SceneBox = m_Canvas->GetSceneBox();
     float minX = m_SceneBox.GetPosX();
     m_NumDrawnTextBoxes = 0;
@@ -472,6 +521,11 @@ void TimeGraph::UpdatePrimitives( bool a_Picking )
 
     {
         ScopeLock lock(m_Mutex);
+        for( auto & pair : m_PendingThreadDepths )
+        {
+            UpdateThreadDepth( pair.first, pair.second );
+        }
+        m_PendingThreadDepths.clear();
         m_Layout.m_ThreadDepths = m_ThreadDepths;
     }
 
@@ -480,146 +534,146 @@ void TimeGraph::UpdatePrimitives( bool a_Picking )
     TickType rawStart = GetRawTimeStampFromUs( m_MinEpochTimeUs );
     TickType rawStop  = GetRawTimeStampFromUs( m_MaxEpochTimeUs );
 
-    unsigned int TextBoxID = 0;
-    for( TextBox & textBox : m_TextBoxes )
+    // Sub-pixel timers are collapsed to at most one per bucket of a pixel's width
+    TickType pixelTicks = ( rawStop - rawStart ) / std::max( m_Canvas->getWidth(), 1 );
+    m_TimerIndex.GetTimersInRange( rawStart, rawStop, pixelTicks, m_VisibleTimers );
+
+    for( const Timer & visibleTimer : m_VisibleTimers )
     {
+        // Text boxes only exist for visible timers and are rebuilt every update
+        TextBox & textBox = *m_VisibleTextBoxes.push_back( TextBox( Vec2( 0, 0 ), Vec2( 0, 0 ), "", m_TextRenderer, Color( 255, 0, 0, 255 ) ) );
+        textBox.SetTimer( visibleTimer );
         const Timer & timer = textBox.GetTimer();
 
-        if( !( rawStart > timer.m_End || rawStop < timer.m_Start ) )
-        {          
-            double start = MicroSecondsFromTicks( m_SessionMinCounter, timer.m_Start ) - m_MinEpochTimeUs;
-            double end = MicroSecondsFromTicks( m_SessionMinCounter, timer.m_End ) - m_MinEpochTimeUs;
-            double elapsed = end - start;
+        double start = MicroSecondsFromTicks( m_SessionMinCounter, timer.m_Start ) - m_MinEpochTimeUs;
+        double end = MicroSecondsFromTicks( m_SessionMinCounter, timer.m_End ) - m_MinEpochTimeUs;
+        double elapsed = end - start;
 
-            double NormalizedStart  = start   * invTimeWindow;
-            double NormalizedEnd    = end     * invTimeWindow;
-            double NormalizedLength = elapsed * invTimeWindow;
+        double NormalizedStart  = start   * invTimeWindow;
+        double NormalizedEnd    = end     * invTimeWindow;
+        double NormalizedLength = elapsed * invTimeWindow;
 
-            bool isCore = timer.IsType( Timer::CORE_ACTIVITY );
+        bool isCore = timer.IsType( Timer::CORE_ACTIVITY );
 
-            float threadOffset = !isCore ? m_Layout.GetThreadOffset( timer.m_TID, timer.m_Depth )
-                : m_Layout.GetCoreOffset( timer.m_Processor );
+        float threadOffset = !isCore ? m_Layout.GetThreadOffset( timer.m_TID, timer.m_Depth )
+            : m_Layout.GetCoreOffset( timer.m_Processor );
 
-            float boxHeight = !isCore ? m_Layout.m_TextBoxHeight : m_Layout.m_CoresHeight;
+        float boxHeight = !isCore ? m_Layout.m_TextBoxHeight : m_Layout.m_CoresHeight;
 
-            float WorldTimerStartX = float( m_WorldStartX + NormalizedStart*m_WorldWidth );
-            float WorldTimerWidth = float( NormalizedLength * m_WorldWidth );
+        float WorldTimerStartX = float( m_WorldStartX + NormalizedStart*m_WorldWidth );
+        float WorldTimerWidth = float( NormalizedLength * m_WorldWidth );
 
-            Vec2 pos( WorldTimerStartX, threadOffset );
-            Vec2 size( WorldTimerWidth, boxHeight );
+        Vec2 pos( WorldTimerStartX, threadOffset );
+        Vec2 size( WorldTimerWidth, boxHeight );
 
-            textBox.SetPos( pos );
-            textBox.SetSize( size );
+        textBox.SetPos( pos );
+        textBox.SetSize( size );
 
-            if( !timer.IsType( Timer::CORE_ACTIVITY ) )
-            {
-                UpdateThreadDepth( timer.m_TID, timer.m_Depth + 1 );
-            }
+        if( !timer.IsType( Timer::CORE_ACTIVITY ) )
+        {
+            UpdateThreadDepth( timer.m_TID, timer.m_Depth + 1 );
+        }
 
-            bool isContextSwitch = timer.IsType( Timer::THREAD_ACTIVITY );
-            bool isCoreActivity  = timer.IsType( Timer::CORE_ACTIVITY );
-            bool isVisibleWidth = NormalizedLength * m_Canvas->getWidth() > 1;
-            bool isMainFrameFunction = Capture::GMainFrameFunction && ( Capture::GMainFrameFunction == timer.m_FunctionAddress );
-            bool isSameThreadIdAsSelected = isCoreActivity && timer.m_TID == Capture::GSelectedThreadId;
-            bool isInactive = ( !isContextSwitch && timer.m_FunctionAddress && ( Capture::GVisibleFunctionsMap[timer.m_FunctionAddress] == nullptr ) ) ||
-                              ( Capture::GSelectedThreadId != 0 && isCoreActivity && !isSameThreadIdAsSelected );
-            bool isSelected = &textBox == Capture::GSelectedTextBox;
-
-
-            const unsigned char g = 100;
-            Color grey( g, g, g, 255 );
-            static Color selectionColor( 0, 128, 255, 255 );
-            Color col = m_Layout.GetThreadColor(timer.m_TID);
-            col = isSelected ? selectionColor : isSameThreadIdAsSelected ? col : isInactive ? grey : col;
-            textBox.SetColor( col[0], col[1], col[2] );
-            static int oddAlpha = 210;
-            if( !( timer.m_Depth & 0x1 ) )
-            {
-                col[3] = oddAlpha;
-            }
+        bool isContextSwitch = timer.IsType( Timer::THREAD_ACTIVITY );
+        bool isCoreActivity  = timer.IsType( Timer::CORE_ACTIVITY );
+        bool isVisibleWidth = NormalizedLength * m_Canvas->getWidth() > 1;
+        bool isMainFrameFunction = Capture::GMainFrameFunction && ( Capture::GMainFrameFunction == timer.m_FunctionAddress );
+        bool isSameThreadIdAsSelected = isCoreActivity && timer.m_TID == Capture::GSelectedThreadId;
+        bool isInactive = ( !isContextSwitch && timer.m_FunctionAddress && ( Capture::GVisibleFunctionsMap[timer.m_FunctionAddress] == nullptr ) ) ||
+                          ( Capture::GSelectedThreadId != 0 && isCoreActivity && !isSameThreadIdAsSelected );
+        bool isSelected = Capture::GSelectedTextBox && IsSameTimer( timer, Capture::GSelectedTextBox->GetTimer() );
+
+
+        const unsigned char g = 100;
+        Color grey( g, g, g, 255 );
+        static Color selectionColor( 0, 128, 255, 255 );
+        Color col = m_Layout.GetThreadColor(timer.m_TID);
+        col = isSelected ? selectionColor : isSameThreadIdAsSelected ? col : isInactive ? grey : col;
+        textBox.SetColor( col[0], col[1], col[2] );
+        static int oddAlpha = 210;
+        if( !( timer.m_Depth & 0x1 ) )
+        {
+            col[3] = oddAlpha;
+        }
 
-            float z = isInactive ? GlCanvas::Z_VALUE_BOX_INACTIVE : GlCanvas::Z_VALUE_BOX_ACTIVE;
+        float z = isInactive ? GlCanvas::Z_VALUE_BOX_INACTIVE : GlCanvas::Z_VALUE_BOX_ACTIVE;
 
-            if( isVisibleWidth )
+        if( isVisibleWidth )
+        {
+            Box box;
+            box.m_Vertices[0] = Vec3( pos[0]          , pos[1]          , z );
+            box.m_Vertices[1] = Vec3( pos[0]          , pos[1] + size[1], z );
+            box.m_Vertices[2] = Vec3( pos[0] + size[0], pos[1] + size[1], z );
+            box.m_Vertices[3] = Vec3( pos[0] + size[0], pos[1]          , z );
+            Color colors[4];
+            Fill( colors, col );
+
+            static float coeff = 0.94f;
+            Vec3 dark = Vec3( col[0], col[1], col[2] ) * coeff;
+            colors[1] = Color( (unsigned char)dark[0], (unsigned char)dark[1], (unsigned char)dark[2], (unsigned char)col[3] );
+            colors[0] = colors[1];
+            m_Batcher.AddBox( box, colors, PickingID::BOX, &textBox );
+
+            if( !isContextSwitch )
             {
-                Box box;
-                box.m_Vertices[0] = Vec3( pos[0]          , pos[1]          , z );
-                box.m_Vertices[1] = Vec3( pos[0]          , pos[1] + size[1], z );
-                box.m_Vertices[2] = Vec3( pos[0] + size[0], pos[1] + size[1], z );
-                box.m_Vertices[3] = Vec3( pos[0] + size[0], pos[1]          , z );
-                Color colors[4];
-                Fill( colors, col );
-
-                static float coeff = 0.94f;
-                Vec3 dark = Vec3( col[0], col[1], col[2] ) * coeff;
-                colors[1] = Color( (unsigned char)dark[0], (unsigned char)dark[1], (unsigned char)dark[2], (unsigned char)col[3] );
-                colors[0] = colors[1];
-                m_Batcher.AddBox( box, colors, PickingID::BOX, &textBox );
-
-                if( !isContextSwitch && textBox.GetText().size() == 0 )
+                double elapsedMillis = ( (double)elapsed ) * 0.001;
+                std::string time = GetPrettyTime( elapsedMillis );
+                Function* func = Capture::GSelectedFunctionsMap[timer.m_FunctionAddress];
+
+                const char* name = nullptr;
+                if( func )
                 {
-                    double elapsedMillis = ( (double)elapsed ) * 0.001;
-                    std::string time = GetPrettyTime( elapsedMillis );
-                    Function* func = Capture::GSelectedFunctionsMap[timer.m_FunctionAddress];
+                    std::string extraInfo = GetExtraInfo( timer );
+                    name = func->PrettyNameStr().c_str();
+                    std::string text = Format( "%s %s %s", name, extraInfo.c_str(), time.c_str() );
 
-                    const char* name = nullptr;
-                    if( func )
+                    textBox.SetText( text );
+                }
+                else if( !Capture::IsCapturing() )
+                {
+                    // GZoneNames is populated when capturing, prevent race
+                    // by accessing it only when not capturing.
+                    auto it = Capture::GZoneNames.find( timer.m_FunctionAddress );
+                    if( it != Capture::GZoneNames.end() )
                     {
-                        std::string extraInfo = GetExtraInfo( timer );
-                        name = func->PrettyNameStr().c_str();
-                        std::string text = Format( "%s %s %s", name, extraInfo.c_str(), time.c_str() );
-
+                        name = it->second.c_str();
+                        std::string text = Format( "%s %s", name, time.c_str() );
                         textBox.SetText( text );
                     }
-                    else if( !Capture::IsCapturing() )
-                    {
-                        // GZoneNames is populated when capturing, prevent race
-                        // by accessing it only when not capturing.
-                        auto it = Capture::GZoneNames.find( timer.m_FunctionAddress );
-                        if( it != Capture::GZoneNames.end() )
-                        {
-                            name = it->second.c_str();
-                            std::string text = Format( "%s %s", name, time.c_str() );
-                            textBox.SetText( text );
-                        }
-                    }
-                }
-
-                if( !isCoreActivity )
-                {
-                    //m_VisibleTextBoxes.push_back(&textBox);
-                    float minX = m_SceneBox.GetPosX();
-                    static Color s_Color( 255, 255, 255, 255 );
-
-                    const Vec2 & pos  = textBox.GetPos();
-                    const Vec2 & size = textBox.GetSize();
-                    float posX = std::max( pos[0], minX );
-                    float maxSize = pos[0] + size[0] - posX;
-                    m_TextRendererStatic.AddText( textBox.GetText().c_str()
-                                                , posX
-                                                , textBox.GetPosY() + 1.f
-                                                , GlCanvas::Z_VALUE_TEXT
-                                                , s_Color
-                                                , maxSize );
                 }
             }
-            else
-            {
-                Line line;
-                line.m_Beg = Vec3( pos[0], pos[1]          , z );
-                line.m_End = Vec3( pos[0], pos[1] + size[1], z );
-                Color colors[2];
-                Fill( colors, col );
-                m_Batcher.AddLine( line, colors, PickingID::LINE, &textBox );
-            }
 
-            if( ++m_NumDrawnTextBoxes > numTextBoxes )
+            if( !isCoreActivity )
             {
-                break;
+                float minX = m_SceneBox.GetPosX();
+                static Color s_Color( 255, 255, 255, 255 );
+
+                const Vec2 & pos  = textBox.GetPos();
+                const Vec2 & size = textBox.GetSize();
+                float posX = std::max( pos[0], minX );
+                float maxSize = pos[0] + size[0] - posX;
+                m_TextRendererStatic.AddText( textBox.GetText().c_str()
+                                            , posX
+                                            , textBox.GetPosY() + 1.f
+                                            , GlCanvas::Z_VALUE_TEXT
+                                            , s_Color
+                                            , maxSize );
             }
         }
+        else
+        {
+            Line line;
+            line.m_Beg = Vec3( pos[0], pos[1]          , z );
+            line.m_End = Vec3( pos[0], pos[1] + size[1], z );
+            Color colors[2];
+            Fill( colors, col );
+            m_Batcher.AddLine( line, colors, PickingID::LINE, &textBox );
+        }
 
-        ++TextBoxID;
+        if( ++m_NumDrawnTextBoxes > numTextBoxes )
+        {
+            break;
+        }
     }
 
     if( !a_Picking )
@@ -641,30 +695,23 @@ void TimeGraph::UpdateEvents()
     TickType rawMin = GetRawTimeStampFromUs( m_MinEpochTimeUs );
     TickType rawMax = GetRawTimeStampFromUs( m_MaxEpochTimeUs );
 
-    ScopeLock lock( GEventTracer.GetEventBuffer().GetMutex() );
-
     Color lineColor[2];
     Fill( lineColor, Color(255, 255, 255, 255) );
 
-    for( auto & pair : GEventTracer.GetEventBuffer().GetCallstacks() )
-    {
-        ThreadID threadID = pair.first;
-        std::map< long long, CallstackEvent > & callstacks = pair.second;
+    // Sampling Events, the buffer is read without blocking the event thread
+    std::vector< CallstackEventSpan > spans;
+    GEventTracer.GetEventBuffer().GetCallstackEventSpans( rawMin + 1, rawMax, spans );
 
-        // Sampling Events
-        float ThreadOffset = (float)m_Layout.GetSamplingTrackOffset( threadID );
-        for( auto & callstackPair : callstacks )
+    for( const CallstackEventSpan & span : spans )
+    {
+        float ThreadOffset = (float)m_Layout.GetSamplingTrackOffset( span.m_ThreadId );
+        for( const CallstackEvent & event : span )
         {
-            unsigned long long time = callstackPair.first;
-
-            if( time > rawMin && time < rawMax )
-            {
-                float x = GetWorldFromRawTimeStamp( time );
-                Line line;
-                line.m_Beg = Vec3( x, ThreadOffset, GlCanvas::Z_VALUE_EVENT );
-                line.m_End = Vec3( x, ThreadOffset - m_Layout.m_EventTrackHeight, GlCanvas::Z_VALUE_EVENT );
-                m_Batcher.AddLine( line, lineColor, PickingID::EVENT );
-            }
+            float x = GetWorldFromRawTimeStamp( event.m_Time );
+            Line line;
+            line.m_Beg = Vec3( x, ThreadOffset, GlCanvas::Z_VALUE_EVENT );
+            line.m_End = Vec3( x, ThreadOffset - m_Layout.m_EventTrackHeight, GlCanvas::Z_VALUE_EVENT );
+            m_Batcher.AddLine( line, lineColor, PickingID::EVENT );
         }
     }
 
@@ -724,7 +771,7 @@ void TimeGraph::SelectEvents( float a_WorldStart, float a_WorldEnd, ThreadID a_T
 //-----------------------------------------------------------------------------
 void TimeGraph::Draw( bool a_Picking )
 {
-    if( m_TextBoxes.keep( GParams.m_MaxNumTimers ) || (!a_Picking && m_NeedsUpdatePrimitives) || a_Picking )
+    if( m_TimerIndex.Keep( GParams.m_MaxNumTimers ) || (!a_Picking && m_NeedsUpdatePrimitives) || a_Picking )
     {
         UpdatePrimitives( a_Picking );
     }
@@ -739,16 +786,12 @@ void TimeGraph::Draw( bool a_Picking )
 void TimeGraph::UpdateThreadIds()
 {
     {
-        ScopeLock lock( GEventTracer.GetEventBuffer().GetMutex() );
         m_EventCount.clear();
+        GEventTracer.GetEventBuffer().GetNumEventsPerThread( m_EventCount );
 
-        for( auto & pair : GEventTracer.GetEventBuffer().GetCallstacks() )
+        for( auto & pair : m_EventCount )
         {
             ThreadID threadID = pair.first;
-            std::map< long long, CallstackEvent > & callstacks = pair.second;
-
-            m_EventCount[threadID] = (uint32_t)callstacks.size();
-
             if( m_ThreadDepths.find( threadID ) == m_ThreadDepths.end() )
             {
                 m_ThreadDepths[threadID] = 0;
@@ -986,10 +1029,10 @@ bool TimeGraph::IsVisible( const Timer & a_Timer )
 //-----------------------------------------------------------------------------
 void TimeGraph::GetBounds(Vec2 & a_Min, Vec2 & a_Max)
 {
-    if( m_TextBoxes.size() > 0 )
+    if( m_VisibleTextBoxes.size() > 0 )
     {
-        TextBox dummyBox /*= m_TextBoxes[0]*/;
-        for( TextBox & box : m_TextBoxes )
+        TextBox dummyBox;
+        for( TextBox & box : m_VisibleTextBoxes )
         {
             dummyBox.Expand( box );
         }
@@ -6,6 +6,7 @@
 #include "Core.h"
 #include "TextBox.h"
 #include "BlockChain.h"
+#include "TimerIndex.h"
 #include "ContextSwitch.h"
 #include "EventTracer.h"
 #include "TimeGraphLayout.h"
@@ -38,7 +39,10 @@ public:
     void SelectEvents( float a_WorldStart, float a_WorldEnd, ThreadID a_TID );
 
     void ProcessTimer( Timer & a_Timer );
+    void ProcessTimers( Timer* a_Timers, size_t a_NumTimers );
+    bool PreProcessTimer( const Timer & a_Timer );
     void UpdateThreadDepth( int a_ThreadId, int a_Depth );
+    void AddPendingThreadDepths( const std::map< ThreadID, int > & a_Depths );
     void UpdateMaxTimeStamp( TickType a_Time );
     void AddContextSwitch();
     
@@ -71,7 +75,6 @@ public:
 
     bool IsVisible( const Timer & a_Timer );
     int GetNumDrawnTextBoxes(){ return m_NumDrawnTextBoxes; }
-    void AddTextBox( const TextBox& a_TextBox );
     void AddContextSwitch( const ContextSwitch & a_CS );
     void SetPickingManager( class PickingManager* a_Manager ){ m_PickingManager = a_Manager; }
     void SetCanvas( GlCanvas* a_Canvas );
@@ -81,7 +84,7 @@ public:
     TextRenderer*                   m_TextRenderer;
     GlCanvas*                       m_Canvas;
     TextBox                         m_SceneBox;
-    BlockChain<TextBox, 65536>      m_TextBoxes;
+    TimerIndex                      m_TimerIndex;
     int                             m_NumDrawnTextBoxes;
     
     double                          m_RefEpochTimeUs;
@@ -90,6 +93,7 @@ public:
     TickType                        m_SessionMinCounter;
     TickType                        m_SessionMaxCounter;
     std::map< ThreadID, int >       m_ThreadDepths;
+    std::map< ThreadID, int >       m_PendingThreadDepths; // From other threads, guarded by m_Mutex
     std::map< ThreadID, uint32_t >  m_EventCount;
     double                          m_TimeWindowUs;
     float                           m_WorldStartX;
@@ -108,8 +112,8 @@ public:
     TimeGraphLayout                 m_Layout;
     std::map< ThreadID, class EventTrack* > m_EventTracks;
 
-    std::map< DWORD/*ThreadId*/, std::map< long long, ContextSwitch > > m_ContextSwitchesMap;
-    std::map< DWORD/*CoreId*/, std::map< long long, ContextSwitch > >   m_CoreUtilizationMap;
+    std::unordered_map< ThreadID, ContextSwitchStream > m_ThreadContextSwitches;
+    std::vector< ContextSwitchStream >                  m_CoreContextSwitches;
 
     std::map< ThreadID, uint32_t >  m_ThreadCountMap;
 
@@ -117,7 +121,9 @@ public:
     bool                            m_NeedsUpdatePrimitives;
     bool                            m_DrawText;
     bool                            m_NeedsRedraw;
-    std::vector<TextBox*>           m_VisibleTextBoxes;
+    std::vector<Timer>              m_VisibleTimers;
+    BlockChain<TextBox, 65536>      m_VisibleTextBoxes;
+    TextBox                         m_SelectedTextBox;
     Batcher                         m_Batcher;
     PickingManager*                 m_PickingManager;
     Mutex                           m_Mutex;
@@ -0,0 +1,625 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+
+#include "TimerIndex.h"
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+template<class T> void Permute( std::vector<T> & a_Vector, const std::vector<uint32_t> & a_Order )
+{
+    if( a_Vector.empty() )
+        return;
+
+    std::vector<T> permuted( a_Vector.size() );
+    for( size_t i = 0; i < a_Order.size(); ++i )
+    {
+        permuted[i] = a_Vector[a_Order[i]];
+    }
+
+    a_Vector.swap( permuted );
+}
+
+//-----------------------------------------------------------------------------
+template<class T> void EraseFront( std::vector<T> & a_Vector, uint32_t a_Num )
+{
+    a_Vector.erase( a_Vector.begin(), a_Vector.begin() + std::min( (size_t)a_Num, a_Vector.size() ) );
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::Add( const Timer & a_Timer )
+{
+    if( m_Start.empty() )
+    {
+        m_Depth = a_Timer.m_Depth;
+    }
+    else if( a_Timer.m_Start < m_Start.back() )
+    {
+        // Out of order timer, we'll sort on next query
+        m_IsSorted = false;
+    }
+
+    m_Start.push_back( a_Timer.m_Start );
+    m_End.push_back( a_Timer.m_End );
+    m_FunctionAddress.push_back( a_Timer.m_FunctionAddress );
+    m_CallstackHash.push_back( a_Timer.m_CallstackHash );
+    m_TID.push_back( a_Timer.m_TID );
+    m_Type.push_back( a_Timer.m_Type );
+    m_SessionID.push_back( a_Timer.m_SessionID );
+    m_Processor.push_back( a_Timer.m_Processor );
+
+    for( int i = 0; i < 2; ++i )
+    {
+        std::vector< DWORD64 > & userData = m_UserData[i];
+        if( a_Timer.m_UserData[i] && userData.empty() )
+        {
+            userData.resize( m_Start.size() - 1, 0 );
+        }
+
+        if( !userData.empty() )
+        {
+            userData.push_back( a_Timer.m_UserData[i] );
+        }
+    }
+
+    if( m_IsSorted )
+    {
+        TickType maxEnd = m_MaxEnd.empty() ? a_Timer.m_End : std::max( m_MaxEnd.back(), a_Timer.m_End );
+        m_MaxEnd.push_back( maxEnd );
+        AddToLods( End() - 1 );
+    }
+}
+
+//-----------------------------------------------------------------------------
+Timer TimerTrack::GetTimer( uint32_t a_Index ) const
+{
+    Timer timer;
+    timer.m_Start = m_Start[a_Index];
+    timer.m_End = m_End[a_Index];
+    timer.m_FunctionAddress = m_FunctionAddress[a_Index];
+    timer.m_CallstackHash = m_CallstackHash[a_Index];
+    timer.m_TID = m_TID[a_Index];
+    timer.m_Type = (Timer::Type)m_Type[a_Index];
+    timer.m_SessionID = m_SessionID[a_Index];
+    timer.m_Processor = m_Processor[a_Index];
+    timer.m_Depth = m_Depth;
+
+    for( int i = 0; i < 2; ++i )
+    {
+        if( !m_UserData[i].empty() )
+        {
+            timer.m_UserData[i] = m_UserData[i][a_Index];
+        }
+    }
+
+    return timer;
+}
+
+//-----------------------------------------------------------------------------
+static inline void AddToBucket( std::vector< TimerBucket > & a_Lod, uint64_t a_Index, uint32_t a_First, uint32_t a_Count, TickType a_MaxDuration )
+{
+    if( !a_Lod.empty() && a_Lod.back().m_Index == a_Index )
+    {
+        TimerBucket & bucket = a_Lod.back();
+        bucket.m_Count += a_Count;
+        bucket.m_MaxDuration = std::max( bucket.m_MaxDuration, a_MaxDuration );
+    }
+    else
+    {
+        a_Lod.push_back( TimerBucket{ a_Index, a_First, a_Count, a_MaxDuration } );
+    }
+}
+
+//-----------------------------------------------------------------------------
+static inline bool Compresses( size_t a_NumBuckets, size_t a_NumFinerItems )
+{
+    return a_NumBuckets <= TimerTrack::LOD_MIN_BUCKETS || a_NumBuckets * 2 <= a_NumFinerItems;
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::AddToLods( uint32_t a_Index )
+{
+    TickType start = m_Start[a_Index];
+    TickType end = m_End[a_Index];
+    TickType duration = end > start ? end - start : 0;
+    size_t numFinerItems = m_Start.size();
+
+    for( int level = 0; level < LOD_NUM_LEVELS; ++level )
+    {
+        if( m_LodSkipSize[level] )
+        {
+            continue;
+        }
+
+        std::vector< TimerBucket > & lod = m_Lods[level];
+        AddToBucket( lod, start >> ( LOD_BASE_SHIFT + level ), a_Index, 1, duration );
+
+        if( !Compresses( lod.size(), numFinerItems ) )
+        {
+            SkipLod( level );
+            continue;
+        }
+
+        numFinerItems = lod.size();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::SkipLod( int a_Level )
+{
+    std::vector< TimerBucket >().swap( m_Lods[a_Level] );
+    m_LodSkipSize[a_Level] = std::max( (uint32_t)m_Start.size(), 1u );
+}
+
+//-----------------------------------------------------------------------------
+bool TimerTrack::BuildLod( int a_Level )
+{
+    std::vector< TimerBucket > & lod = m_Lods[a_Level];
+    lod.clear();
+
+    int source = a_Level - 1;
+    while( source >= 0 && m_LodSkipSize[source] )
+    {
+        --source;
+    }
+
+    size_t numFinerItems = 0;
+    if( source >= 0 )
+    {
+        // Coarse buckets are unions of consecutive finer buckets
+        int shift = a_Level - source;
+        for( const TimerBucket & bucket : m_Lods[source] )
+        {
+            AddToBucket( lod, bucket.m_Index >> shift, bucket.m_First, bucket.m_Count, bucket.m_MaxDuration );
+        }
+
+        numFinerItems = m_Lods[source].size();
+    }
+    else
+    {
+        for( uint32_t i = 0; i < (uint32_t)m_Start.size(); ++i )
+        {
+            TickType duration = m_End[i] > m_Start[i] ? m_End[i] - m_Start[i] : 0;
+            AddToBucket( lod, m_Start[i] >> ( LOD_BASE_SHIFT + a_Level ), i, 1, duration );
+        }
+
+        numFinerItems = m_Start.size();
+    }
+
+    if( !Compresses( lod.size(), numFinerItems ) )
+    {
+        SkipLod( a_Level );
+        return false;
+    }
+
+    m_LodSkipSize[a_Level] = 0;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+int TimerTrack::GetStoredLodLevel( int a_Level )
+{
+    // Finer buckets still fit in a pixel, -1 falls back to the timers
+    for( int level = a_Level; level >= 0; --level )
+    {
+        if( m_LodSkipSize[level] == 0 )
+        {
+            return level;
+        }
+
+        if( m_Start.size() >= 2 * (size_t)m_LodSkipSize[level] && BuildLod( level ) )
+        {
+            return level;
+        }
+    }
+
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+int TimerTrack::GetLodLevel( TickType a_PixelTicks )
+{
+    // Use the coarsest level whose buckets still fit in a pixel
+    if( a_PixelTicks < ( 1ull << LOD_BASE_SHIFT ) )
+    {
+        return -1;
+    }
+
+    int level = 0;
+    while( level + 1 < LOD_NUM_LEVELS && ( 1ull << ( LOD_BASE_SHIFT + level + 1 ) ) <= a_PixelTicks )
+    {
+        ++level;
+    }
+
+    return level;
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::UpdateMaxEnd()
+{
+    m_MaxEnd.resize( End() );
+    TickType maxEnd = 0;
+    for( uint32_t i = 0; i < End(); ++i )
+    {
+        maxEnd = std::max( maxEnd, m_End[i] );
+        m_MaxEnd[i] = maxEnd;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::UpdateMaxEndAndLods()
+{
+    UpdateMaxEnd();
+
+    for( int level = 0; level < LOD_NUM_LEVELS; ++level )
+    {
+        m_Lods[level].clear();
+        m_LodSkipSize[level] = 0;
+    }
+
+    for( uint32_t i = 0; i < End(); ++i )
+    {
+        AddToLods( i );
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::Sort()
+{
+    EraseTrimmed();
+
+    std::vector<uint32_t> order( Size() );
+    for( uint32_t i = 0; i < Size(); ++i )
+    {
+        order[i] = i;
+    }
+
+    std::stable_sort( order.begin(), order.end(), [this]( uint32_t a_A, uint32_t a_B )
+    {
+        return m_Start[a_A] < m_Start[a_B];
+    } );
+
+    Permute( m_Start, order );
+    Permute( m_End, order );
+    Permute( m_FunctionAddress, order );
+    Permute( m_CallstackHash, order );
+    Permute( m_TID, order );
+    Permute( m_Type, order );
+    Permute( m_SessionID, order );
+    Permute( m_Processor, order );
+    Permute( m_UserData[0], order );
+    Permute( m_UserData[1], order );
+
+    UpdateMaxEndAndLods();
+    m_IsSorted = true;
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::EraseFront( uint32_t a_NumTimers )
+{
+    m_Begin += std::min( a_NumTimers, Size() );
+
+    // Moving the live timers is paid for by the trimmed ones
+    if( m_Begin >= Size() )
+    {
+        Compact();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::EraseTrimmed()
+{
+    uint32_t num = m_Begin;
+    if( num == 0 )
+        return;
+
+    ::EraseFront( m_Start, num );
+    ::EraseFront( m_End, num );
+    ::EraseFront( m_FunctionAddress, num );
+    ::EraseFront( m_CallstackHash, num );
+    ::EraseFront( m_TID, num );
+    ::EraseFront( m_Type, num );
+    ::EraseFront( m_SessionID, num );
+    ::EraseFront( m_Processor, num );
+    ::EraseFront( m_UserData[0], num );
+    ::EraseFront( m_UserData[1], num );
+    ::EraseFront( m_MaxEnd, num );
+    m_Begin = 0;
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::Compact()
+{
+    uint32_t num = m_Begin;
+    EraseTrimmed();
+
+    // Drop whole buckets, the first one left can straddle the trimmed timers
+    for( int level = 0; level < LOD_NUM_LEVELS; ++level )
+    {
+        std::vector< TimerBucket > & lod = m_Lods[level];
+        if( m_LodSkipSize[level] )
+        {
+            m_LodSkipSize[level] = std::max( std::min( m_LodSkipSize[level], End() ), 1u );
+            continue;
+        }
+
+        size_t numTrimmed = 0;
+        while( numTrimmed < lod.size() && lod[numTrimmed].m_First + lod[numTrimmed].m_Count <= num )
+        {
+            ++numTrimmed;
+        }
+
+        ::EraseFront( lod, (uint32_t)numTrimmed );
+
+        for( TimerBucket & bucket : lod )
+        {
+            if( bucket.m_First < num )
+            {
+                bucket.m_Count -= num - bucket.m_First;
+                bucket.m_First = 0;
+            }
+            else
+            {
+                bucket.m_First -= num;
+            }
+        }
+    }
+
+    // Trimmed timers could still extend the running max end
+    if( m_IsSorted )
+    {
+        UpdateMaxEnd();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void TimerTrack::GetTimersInRange( TickType a_Min, TickType a_Max, TickType a_PixelTicks, std::vector<Timer> & o_Timers )
+{
+    if( !m_IsSorted )
+    {
+        Sort();
+    }
+
+    uint32_t first = (uint32_t)( std::lower_bound( m_MaxEnd.begin() + m_Begin, m_MaxEnd.end(), a_Min ) - m_MaxEnd.begin() );
+    int level = GetStoredLodLevel( GetLodLevel( a_PixelTicks ) );
+
+    if( level < 0 )
+    {
+        for( uint32_t i = first; i < End(); ++i )
+        {
+            if( m_Start[i] > a_Max )
+            {
+                break;
+            }
+
+            if( m_End[i] >= a_Min )
+            {
+                o_Timers.push_back( GetTimer( i ) );
+            }
+        }
+
+        return;
+    }
+
+    // Find bucket containing the first visible timer
+    const std::vector< TimerBucket > & lod = m_Lods[level];
+    auto it = std::upper_bound( lod.begin(), lod.end(), first, []( uint32_t a_Index, const TimerBucket & a_Bucket )
+    {
+        return a_Index < a_Bucket.m_First;
+    } );
+
+    if( it != lod.begin() )
+    {
+        --it;
+    }
+
+    for( ; it != lod.end(); ++it )
+    {
+        const TimerBucket & bucket = *it;
+        uint32_t begin = std::max( bucket.m_First, first );
+        uint32_t end = bucket.m_First + bucket.m_Count;
+
+        if( begin >= end )
+        {
+            continue;
+        }
+
+        if( m_Start[begin] > a_Max )
+        {
+            break;
+        }
+
+        // Whole bucket is narrower than a pixel, emit a single representative
+        if( bucket.m_MaxDuration <= a_PixelTicks )
+        {
+            o_Timers.push_back( GetTimer( begin ) );
+            continue;
+        }
+
+        // Keep wide timers, collapse the sub-pixel ones
+        bool hasSubPixelTimer = false;
+        for( uint32_t i = begin; i < end; ++i )
+        {
+            if( m_Start[i] > a_Max )
+            {
+                break;
+            }
+
+            if( m_End[i] < a_Min )
+            {
+                continue;
+            }
+
+            if( m_End[i] > m_Start[i] + a_PixelTicks )
+            {
+                o_Timers.push_back( GetTimer( i ) );
+            }
+            else if( !hasSubPixelTimer )
+            {
+                o_Timers.push_back( GetTimer( i ) );
+                hasSubPixelTimer = true;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+uint64_t TimerIndex::GetTrackKey( const Timer & a_Timer )
+{
+    if( a_Timer.IsCoreActivity() )
+    {
+        return 0x8000000000000000ull | (uint8_t)a_Timer.m_Processor;
+    }
+
+    return ( (uint64_t)(uint32_t)a_Timer.m_TID << 8 ) | (uint8_t)a_Timer.m_Depth;
+}
+
+//-----------------------------------------------------------------------------
+void TimerIndex::Add( const Timer & a_Timer )
+{
+    ScopeLock lock( m_Mutex );
+    m_Tracks[GetTrackKey( a_Timer )].Add( a_Timer );
+    ++m_NumTimers;
+}
+
+//-----------------------------------------------------------------------------
+void TimerIndex::Add( const Timer* a_Timers, size_t a_NumTimers )
+{
+    ScopeLock lock( m_Mutex );
+
+    TimerTrack* track = nullptr;
+    uint64_t trackKey = 0;
+
+    for( size_t i = 0; i < a_NumTimers; ++i )
+    {
+        const Timer & timer = a_Timers[i];
+
+        // Consecutive timers often belong to the same track
+        uint64_t key = GetTrackKey( timer );
+        if( track == nullptr || key != trackKey )
+        {
+            track = &m_Tracks[key];
+            trackKey = key;
+        }
+
+        track->Add( timer );
+    }
+
+    m_NumTimers += (uint32_t)a_NumTimers;
+}
+
+//-----------------------------------------------------------------------------
+void TimerIndex::Clear()
+{
+    ScopeLock lock( m_Mutex );
+    m_Tracks.clear();
+    m_NumTimers = 0;
+}
+
+//-----------------------------------------------------------------------------
+bool TimerIndex::Keep( uint32_t a_MaxTimers )
+{
+    if( m_NumTimers <= a_MaxTimers )
+    {
+        return false;
+    }
+
+    ScopeLock lock( m_Mutex );
+
+    // Drop oldest timers with some slack so that we don't do this every frame
+    const uint32_t slack = 64 * 1024;
+    uint32_t numToRemove = std::min( (uint32_t)m_NumTimers, m_NumTimers - a_MaxTimers + slack );
+
+    TickType minTime = ~0ull;
+    TickType maxTime = 0;
+    for( auto & pair : m_Tracks )
+    {
+        TimerTrack & track = pair.second;
+        if( !track.m_IsSorted )
+        {
+            track.Sort();
+        }
+
+        if( track.Size() )
+        {
+            minTime = std::min( minTime, track.m_Start[track.Begin()] );
+            maxTime = std::max( maxTime, track.m_Start.back() + 1 );
+        }
+    }
+
+    // Find earliest time before which at least numToRemove timers start
+    while( minTime < maxTime )
+    {
+        TickType mid = minTime + ( maxTime - minTime ) / 2;
+        uint64_t count = 0;
+        for( auto & pair : m_Tracks )
+        {
+            std::vector< TickType > & start = pair.second.m_Start;
+            auto begin = start.begin() + pair.second.Begin();
+            count += std::lower_bound( begin, start.end(), mid ) - begin;
+        }
+
+        if( count >= numToRemove )
+            maxTime = mid;
+        else
+            minTime = mid + 1;
+    }
+
+    for( auto it = m_Tracks.begin(); it != m_Tracks.end(); )
+    {
+        TimerTrack & track = it->second;
+        auto begin = track.m_Start.begin() + track.Begin();
+        uint32_t num = (uint32_t)( std::lower_bound( begin, track.m_Start.end(), maxTime ) - begin );
+
+        if( num == track.Size() )
+        {
+            m_NumTimers -= num;
+            it = m_Tracks.erase( it );
+            continue;
+        }
+
+        if( num > 0 )
+        {
+            track.EraseFront( num );
+            m_NumTimers -= num;
+        }
+
+        ++it;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void TimerIndex::GetTimersInRange( TickType a_Min, TickType a_Max, TickType a_PixelTicks, std::vector<Timer> & o_Timers )
+{
+    ScopeLock lock( m_Mutex );
+
+    for( auto & pair : m_Tracks )
+    {
+        pair.second.GetTimersInRange( a_Min, a_Max, a_PixelTicks, o_Timers );
+    }
+}
+
+//-----------------------------------------------------------------------------
+TickType TimerIndex::GetMinTime()
+{
+    ScopeLock lock( m_Mutex );
+
+    TickType minTime = ~0ull;
+    for( auto & pair : m_Tracks )
+    {
+        TimerTrack & track = pair.second;
+        if( !track.m_IsSorted )
+        {
+            track.Sort();
+        }
+
+        if( track.Size() )
+        {
+            minTime = std::min( minTime, track.m_Start[track.Begin()] );
+        }
+    }
+
+    return minTime;
+}
@@ -0,0 +1,123 @@
+//-----------------------------------
+// Copyright Pierric Gimmig 2013-2017
+//-----------------------------------
+#pragma once
+
+#include "Core.h"
+#include "ScopeTimer.h"
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Summary of the timers of a track whose start time falls in the same
+// power-of-two sized time bucket.
+struct TimerBucket
+{
+    uint64_t m_Index;       // Start time >> bucket shift
+    uint32_t m_First;       // Index of first timer in track
+    uint32_t m_Count;
+    TickType m_MaxDuration;
+};
+
+//-----------------------------------------------------------------------------
+// Timers of a single track (thread/depth or core) stored as columns sorted
+// by start time. Depth is the same for the whole track. Timers before m_Begin
+// were trimmed, the columns are only compacted once the trimmed timers
+// outnumber the live ones. Indices are positions in the columns, live timers
+// are [Begin(), End()).
+// m_MaxEnd[i] is the largest end time of timers [0..i], it is monotonic so
+// the first timer that can overlap a time range is found by binary search.
+// m_Lods is a pyramid of time buckets used to collapse sub-pixel timers
+// into a single representative when zoomed out. A level is only stored while
+// it has at most half the buckets of the next finer stored level (or timers),
+// sparse levels are skipped and queries use the finer level instead. Skipped
+// levels are rebuilt from the level below once the track doubled in size.
+struct TimerTrack
+{
+    TimerTrack() : m_Begin(0), m_Depth(0), m_IsSorted(true) { memset( m_LodSkipSize, 0, sizeof( m_LodSkipSize ) ); }
+
+    static const int LOD_BASE_SHIFT = 12;
+    static const int LOD_NUM_LEVELS = 20;
+    static const uint32_t LOD_MIN_BUCKETS = 2;
+
+    void Add( const Timer & a_Timer );
+    void Sort();
+    void EraseFront( uint32_t a_NumTimers );
+    void GetTimersInRange( TickType a_Min, TickType a_Max, TickType a_PixelTicks, std::vector<Timer> & o_Timers );
+    Timer GetTimer( uint32_t a_Index ) const;
+    uint32_t Begin() const { return m_Begin; }
+    uint32_t End() const { return (uint32_t)m_Start.size(); }
+    uint32_t Size() const { return End() - m_Begin; }
+
+    static int GetLodLevel( TickType a_PixelTicks );
+
+protected:
+    void AddToLods( uint32_t a_Index );
+    bool BuildLod( int a_Level );
+    void SkipLod( int a_Level );
+    int  GetStoredLodLevel( int a_Level );
+    void UpdateMaxEndAndLods();
+    void UpdateMaxEnd();
+    void EraseTrimmed();
+    void Compact();
+
+public:
+    std::vector< TickType >    m_Start;
+    std::vector< TickType >    m_End;
+    std::vector< DWORD64 >     m_FunctionAddress;
+    std::vector< DWORD64 >     m_CallstackHash;
+    std::vector< int >         m_TID;
+    std::vector< uint8_t >     m_Type;
+    std::vector< int8_t >      m_SessionID;
+    std::vector< int8_t >      m_Processor;
+    std::vector< DWORD64 >     m_UserData[2]; // Only allocated once a timer carries user data
+    std::vector< TickType >    m_MaxEnd;
+    std::vector< TimerBucket > m_Lods[LOD_NUM_LEVELS];
+    uint32_t                   m_LodSkipSize[LOD_NUM_LEVELS]; // Track size when the level was skipped, 0 if stored
+    uint32_t                   m_Begin;
+    int8_t                     m_Depth;
+    bool                       m_IsSorted;
+};
+
+//-----------------------------------------------------------------------------
+// Columnar, time-indexed storage of the timers shown in the TimeGraph.
+// Timers are only turned into TextBoxes once they are visible, culling
+// costs O(log n + visible) per track.
+class TimerIndex
+{
+public:
+    TimerIndex() : m_NumTimers(0) {}
+
+    void Add( const Timer & a_Timer );
+    void Add( const Timer* a_Timers, size_t a_NumTimers );
+    void Clear();
+    bool Keep( uint32_t a_MaxTimers );
+    void GetTimersInRange( TickType a_Min, TickType a_Max, TickType a_PixelTicks, std::vector<Timer> & o_Timers );
+    TickType GetMinTime();
+    uint32_t GetNumTimers() const { return m_NumTimers; }
+    size_t GetNumTracks() const { return m_Tracks.size(); }
+
+    template<class Func> void ForEachTimer( Func a_Func );
+
+    static uint64_t GetTrackKey( const Timer & a_Timer );
+
+protected:
+    Mutex                                      m_Mutex;
+    std::unordered_map< uint64_t, TimerTrack > m_Tracks;
+    std::atomic<uint32_t>                      m_NumTimers;
+};
+
+//-----------------------------------------------------------------------------
+template<class Func> void TimerIndex::ForEachTimer( Func a_Func )
+{
+    ScopeLock lock( m_Mutex );
+
+    for( auto & pair : m_Tracks )
+    {
+        TimerTrack & track = pair.second;
+        for( uint32_t i = track.Begin(); i < track.End(); ++i )
+        {
+            a_Func( track.GetTimer( i ) );
+        }
+    }
+}
@@ -157,6 +157,10 @@ void OrbitMainWindow::ParseCommandlineArguments()
         {
             m_Headless = true;
         }
+        else if( arg.startsWith( "benchmark" ) )
+        {
+            m_Headless = true;
+        }
         else if( arg == "dev" )
         {
             m_IsDev = true;
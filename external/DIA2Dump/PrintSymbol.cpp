@@ -745,7 +745,7 @@ void OrbitAddGlobalSymbol(IDiaSymbol* pSymbol)
         //Var.m_DataKind  = dataKind;
         //Var.m_TypeIndex = index;
 
-        GPdbDbg->AddGlobal(Var);
+        GetParsingPdb()->AddGlobal(Var);
     }
 }
 
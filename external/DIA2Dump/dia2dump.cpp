@@ -894,7 +894,7 @@ bool DumpAllFunctions( IDiaSymbol *pGlobal )
 
         if( Func.m_PrettyName.size() && Func.m_PrettyName[0] != TEXT( '`' ) )
         {
-			GPdbDbg->AddFunction(Func);
+			GetParsingPdb()->AddFunction(Func);
         }
 
 		pSymbol.Release();
@@ -954,7 +954,7 @@ bool DumpTypes(IDiaSymbol *pGlobal)
             orbitType.m_Length = ulLen;
         }
 
-        GPdbDbg->AddType( orbitType );
+        GetParsingPdb()->AddType( orbitType );
         ++g_NumUserTypes;
         pSymbol.Release();
     }
@@ -1517,8 +1517,8 @@ void ParseDll(const char* a_FileName)
             func.m_PrettyName = func.m_Name;
             func.m_Address = i.symRVA;
             func.m_Module = s2ws(i.moduleName);
-            func.m_Pdb = GPdbDbg.get();
-            GPdbDbg->AddFunction( func );
+            func.m_Pdb = GetParsingPdb();
+            GetParsingPdb()->AddFunction( func );
         }
 
         DestructParsedPE(pe);